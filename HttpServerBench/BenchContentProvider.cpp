@@ -0,0 +1,83 @@
+/*
+ * Modern CI
+ * Copyright (C) 2012-2013 Sascha Cunz <sascha@babbelbox.org>
+ *
+ * This program is free software; you can redistribute it and/or modify it under the terms of the
+ * GNU General Public License (Version 2) as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without
+ * even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this program; if
+ * not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <QUrl>
+
+#include "libHttpServer/Request.hpp"
+#include "libHttpServer/Response.hpp"
+
+#include "HttpServerBench/BenchContentProvider.hpp"
+
+BenchContentProvider::BenchContentProvider( const QString& prefix, const QList< int >& sizes,
+                                            QObject* parent )
+    : HTTP::ContentProvider( parent )
+    , mPrefix( prefix )
+{
+    foreach( int size, sizes )
+    {
+        mBodies.insert( size, QByteArray( size, 'x' ) );
+    }
+}
+
+bool BenchContentProvider::canHandle( const QUrl& url ) const
+{
+    return url.path().startsWith( mPrefix );
+}
+
+void BenchContentProvider::newRequest( HTTP::Request* request )
+{
+    HTTP::Response* res = request->response();
+
+    bool ok = false;
+    int size = request->url().path().mid( mPrefix.length() ).toInt( &ok );
+
+    QHash< int, QByteArray >::ConstIterator it = mBodies.constFind( size );
+    if( !ok || it == mBodies.constEnd() )
+    {
+        res->finish( HTTP::NotFound );
+        return;
+    }
+
+    res->addHeader( "Content-Type", "application/octet-stream" );
+    res->addBody( it.value() );
+    res->finish( HTTP::Ok );
+}
+
+BenchRequestHandler::BenchRequestHandler( const QByteArray& prefix, const QList< int >& sizes )
+    : mPrefix( prefix )
+{
+    foreach( int size, sizes )
+    {
+        mBodies.insert( size, QByteArray( size, 'x' ) );
+    }
+}
+
+void BenchRequestHandler::handle( const HTTP::RequestView& request,
+                                  HTTP::ResponseWriter& response )
+{
+    bool ok = false;
+    int size = request.path().mid( mPrefix.length() ).toInt( &ok );
+
+    QHash< int, QByteArray >::ConstIterator it = mBodies.constFind( size );
+    if( !ok || it == mBodies.constEnd() )
+    {
+        response.setStatus( HTTP::NotFound );
+        return;
+    }
+
+    response.addHeader( "Content-Type", "application/octet-stream" );
+    response.addBody( it.value() );
+}
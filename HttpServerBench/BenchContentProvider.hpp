@@ -0,0 +1,59 @@
+/*
+ * Modern CI
+ * Copyright (C) 2012-2013 Sascha Cunz <sascha@babbelbox.org>
+ *
+ * This program is free software; you can redistribute it and/or modify it under the terms of the
+ * GNU General Public License (Version 2) as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without
+ * even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this program; if
+ * not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef HTTP_BENCH_CONTENT_PROVIDER_HPP
+#define HTTP_BENCH_CONTENT_PROVIDER_HPP
+
+#include <QHash>
+
+#include "libHttpServer/ContentProvider.hpp"
+#include "libHttpServer/RequestHandler.hpp"
+
+/*
+ * Answers "<prefix><size>" with a body of that many bytes. The bodies are built up front, so
+ * serving them is read only and the provider can be used from all worker threads at once.
+ */
+class BenchContentProvider : public HTTP::ContentProvider
+{
+public:
+    BenchContentProvider( const QString& prefix, const QList< int >& sizes, QObject* parent );
+
+public:
+    bool canHandle( const QUrl& url ) const;
+    void newRequest( HTTP::Request* request );
+
+private:
+    QString                     mPrefix;
+    QHash< int, QByteArray >    mBodies;
+};
+
+/*
+ * The same answers through the IRequestHandler path, to compare it with a ContentProvider.
+ */
+class BenchRequestHandler : public HTTP::IRequestHandler
+{
+public:
+    BenchRequestHandler( const QByteArray& prefix, const QList< int >& sizes );
+
+public:
+    void handle( const HTTP::RequestView& request, HTTP::ResponseWriter& response );
+
+private:
+    QByteArray                  mPrefix;
+    QHash< int, QByteArray >    mBodies;
+};
+
+#endif
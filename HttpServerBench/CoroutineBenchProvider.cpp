@@ -0,0 +1,61 @@
+/*
+ * Modern CI
+ * Copyright (C) 2012-2013 Sascha Cunz <sascha@babbelbox.org>
+ *
+ * This program is free software; you can redistribute it and/or modify it under the terms of the
+ * GNU General Public License (Version 2) as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without
+ * even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this program; if
+ * not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+#include <QUrl>
+
+#include "libHttpServer/Coroutine.hpp"
+
+#include "HttpServerBench/CoroutineBenchProvider.hpp"
+
+class CoroutineBenchProvider : public HTTP::CoroutineContentProvider
+{
+public:
+    CoroutineBenchProvider( const QString& prefix, QObject* parent )
+        : HTTP::CoroutineContentProvider( parent )
+        , mPrefix( prefix )
+    {
+    }
+
+public:
+    bool canHandle( const QUrl& url ) const
+    {
+        return url.path().startsWith( mPrefix );
+    }
+
+    HTTP::Task<> handle( HTTP::Request& request, HTTP::Response& response )
+    {
+        int steps = request.url().path().mid( mPrefix.length() ).toInt();
+
+        co_await HTTP::bodyReceived( request );
+        for( int i = 0; i < steps; i++ )
+        {
+            co_await HTTP::sleep( request, 0 );
+        }
+
+        response.addHeader( "Content-Type", "text/plain" );
+        response.addBody( QByteArray::number( steps ) );
+        response.finish( HTTP::Ok );
+    }
+
+private:
+    QString mPrefix;
+};
+
+HTTP::ContentProvider* createCoroutineBenchProvider( const QString& prefix, QObject* parent )
+{
+    return new CoroutineBenchProvider( prefix, parent );
+}
@@ -0,0 +1,37 @@
+/*
+ * Modern CI
+ * Copyright (C) 2012-2013 Sascha Cunz <sascha@babbelbox.org>
+ *
+ * This program is free software; you can redistribute it and/or modify it under the terms of the
+ * GNU General Public License (Version 2) as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without
+ * even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this program; if
+ * not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+#ifndef HTTP_BENCH_COROUTINE_BENCH_PROVIDER_HPP
+#define HTTP_BENCH_COROUTINE_BENCH_PROVIDER_HPP
+
+#include <QString>
+
+class QObject;
+
+namespace HTTP
+{
+    class ContentProvider;
+}
+
+/*
+ * Answers "<prefix><steps>" from a coroutine handler that suspends that many times before it
+ * responds, to measure what a co_await costs. Only its source is built as C++20, so this header
+ * does not include Coroutine.hpp.
+ */
+HTTP::ContentProvider* createCoroutineBenchProvider( const QString& prefix, QObject* parent );
+
+#endif
@@ -0,0 +1,267 @@
+/*
+ * Modern CI
+ * Copyright (C) 2012-2013 Sascha Cunz <sascha@babbelbox.org>
+ *
+ * This program is free software; you can redistribute it and/or modify it under the terms of the
+ * GNU General Public License (Version 2) as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without
+ * even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this program; if
+ * not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <QCoreApplication>
+#include <QEventLoop>
+#include <QTcpSocket>
+#include <QTimer>
+
+#include "HttpServerBench/LoadGenerator.hpp"
+
+LoadOptions::LoadOptions()
+    : mAddress( QHostAddress::LocalHost )
+    , mPort( 0 )
+    , mConnections( 8 )
+    , mPipeline( 1 )
+    , mDuration( 10000 )
+{
+}
+
+LoadWorker::LoadWorker( const LoadOptions& options, int index, QObject* parent )
+    : QThread( parent )
+    , mOptions( options )
+    , mNextPath( index )
+    , mRequests( 0 )
+    , mErrors( 0 )
+    , mBytesReceived( 0 )
+{
+}
+
+qint64 LoadWorker::requests() const
+{
+    return mRequests;
+}
+
+qint64 LoadWorker::errors() const
+{
+    return mErrors;
+}
+
+qint64 LoadWorker::bytesReceived() const
+{
+    return mBytesReceived;
+}
+
+const QVector< qint64 >& LoadWorker::latencies() const
+{
+    return mLatencies;
+}
+
+void LoadWorker::run()
+{
+    mClock.start();
+
+    QList< LoadClient* > clients;
+    for( int i = 0; i < mOptions.mConnections; i++ )
+    {
+        LoadClient* c = new LoadClient( this );
+        clients.append( c );
+        c->start();
+    }
+
+    QEventLoop loop;
+    QTimer::singleShot( mOptions.mDuration, &loop, SLOT(quit()) );
+    loop.exec();
+
+    qDeleteAll( clients );
+}
+
+LoadClient::LoadClient( LoadWorker* worker )
+    : mWorker( worker )
+    , mSocket( NULL )
+    , mPos( 0 )
+    , mOutstanding( 0 )
+    , mBatchStart( 0 )
+{
+}
+
+/*
+ * (Re)connects; whatever was in flight on an old socket is lost.
+ */
+void LoadClient::start()
+{
+    if( mSocket )
+    {
+        mSocket->disconnect( this );
+        mSocket->deleteLater();
+    }
+
+    mBuffer.clear();
+    mPos = 0;
+    mOutstanding = 0;
+
+    mSocket = new QTcpSocket( this );
+    connect( mSocket, SIGNAL(connected()), this, SLOT(connected()) );
+    connect( mSocket, SIGNAL(readyRead()), this, SLOT(readyRead()) );
+    connect( mSocket, SIGNAL(error(QAbstractSocket::SocketError)), this, SLOT(failed()) );
+    mSocket->connectToHost( mWorker->mOptions.mAddress, mWorker->mOptions.mPort );
+}
+
+void LoadClient::connected()
+{
+    mSocket->setSocketOption( QAbstractSocket::LowDelayOption, 1 );
+    sendBatch();
+}
+
+void LoadClient::failed()
+{
+    mWorker->mErrors++;
+    start();
+}
+
+void LoadClient::sendBatch()
+{
+    const LoadOptions& options = mWorker->mOptions;
+
+    QByteArray batch;
+    for( int i = 0; i < options.mPipeline; i++ )
+    {
+        const QByteArray& path = options.mPaths[ mWorker->mNextPath++ % options.mPaths.count() ];
+        batch += "GET " + path + " HTTP/1.1\r\n"
+                 "Host: localhost\r\n"
+                 "User-Agent: HttpServerBench\r\n"
+                 "Accept: */*\r\n"
+                 "\r\n";
+    }
+
+    mOutstanding = options.mPipeline;
+    mBatchStart = mWorker->mClock.nsecsElapsed();
+    mSocket->write( batch );
+}
+
+void LoadClient::readyRead()
+{
+    mBuffer += mSocket->readAll();
+
+    for( ;; )
+    {
+        bool close = false;
+        int result = takeResponse( close );
+
+        if( result == 0 )
+        {
+            return;
+        }
+
+        if( result < 0 || !mOutstanding )
+        {
+            failed();
+            return;
+        }
+
+        mWorker->mLatencies.append( ( mWorker->mClock.nsecsElapsed() - mBatchStart ) / 1000 );
+        mWorker->mRequests++;
+        mOutstanding--;
+
+        if( close )
+        {
+            // Whatever is still in flight is lost with the connection
+            if( mOutstanding )
+            {
+                mWorker->mErrors++;
+            }
+            start();
+            return;
+        }
+
+        if( !mOutstanding )
+        {
+            sendBatch();
+        }
+    }
+}
+
+static int findHeader( const QByteArray& buffer, int from, int to, const char* name )
+{
+    int nameLength = int( qstrlen( name ) );
+    for( int pos = buffer.indexOf( '\n', from ) + 1; pos > 0 && pos < to;
+         pos = buffer.indexOf( '\n', pos ) + 1 )
+    {
+        if( !qstrnicmp( buffer.constData() + pos, name, nameLength ) &&
+                buffer.at( pos + nameLength ) == ':' )
+        {
+            return pos + nameLength + 1;
+        }
+    }
+    return -1;
+}
+
+/*
+ * Takes one response with a Content-Length delimited body out of the buffer; the server under
+ * test answers everything the bench requests that way. Returns 1 if there was one, 0 if it is
+ * not complete yet and -1 if it cannot be parsed.
+ */
+int LoadClient::takeResponse( bool& close )
+{
+    int headerEnd = mBuffer.indexOf( "\r\n\r\n", mPos );
+    if( headerEnd == -1 )
+    {
+        return 0;
+    }
+    headerEnd += 4;
+
+    if( !mBuffer.mid( mPos, 9 ).startsWith( "HTTP/1." ) )
+    {
+        return -1;
+    }
+
+    int value = findHeader( mBuffer, mPos, headerEnd, "Content-Length" );
+    if( value == -1 )
+    {
+        return -1;
+    }
+    int length = mBuffer.mid( value, mBuffer.indexOf( '\r', value ) - value ).trimmed().toInt();
+
+    if( mBuffer.count() < headerEnd + length )
+    {
+        return 0;
+    }
+
+    value = findHeader( mBuffer, mPos, headerEnd, "Connection" );
+    close = value != -1 &&
+            mBuffer.mid( value, mBuffer.indexOf( '\r', value ) - value )
+            .trimmed().toLower() == "close";
+
+    mWorker->mBytesReceived += headerEnd + length - mPos;
+    mPos = headerEnd + length;
+
+    if( mPos == mBuffer.count() )
+    {
+        mBuffer.clear();
+        mPos = 0;
+    }
+    else if( mPos > 64 * 1024 )
+    {
+        mBuffer.remove( 0, mPos );
+        mPos = 0;
+    }
+
+    return 1;
+}
+
+LoadCompletion::LoadCompletion( int workers, QObject* parent )
+    : QObject( parent )
+    , mRemaining( workers )
+{
+}
+
+void LoadCompletion::workerFinished()
+{
+    if( --mRemaining == 0 )
+    {
+        QCoreApplication::quit();
+    }
+}
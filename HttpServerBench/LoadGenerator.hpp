@@ -0,0 +1,120 @@
+/*
+ * Modern CI
+ * Copyright (C) 2012-2013 Sascha Cunz <sascha@babbelbox.org>
+ *
+ * This program is free software; you can redistribute it and/or modify it under the terms of the
+ * GNU General Public License (Version 2) as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without
+ * even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this program; if
+ * not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef HTTP_BENCH_LOAD_GENERATOR_HPP
+#define HTTP_BENCH_LOAD_GENERATOR_HPP
+
+#include <QThread>
+#include <QVector>
+#include <QHostAddress>
+#include <QElapsedTimer>
+
+class QTcpSocket;
+
+struct LoadOptions
+{
+    LoadOptions();
+
+    QHostAddress        mAddress;
+    quint16             mPort;
+    int                 mConnections;   // Per load thread
+    int                 mPipeline;      // Requests written before reading the responses
+    int                 mDuration;      // msecs
+    QList< QByteArray > mPaths;         // Requested in turn
+};
+
+class LoadWorker;
+
+/*
+ * One keep-alive connection of a LoadWorker. It writes mPipeline requests, and the next batch
+ * as soon as all of their responses were read; the latency of a request is measured from
+ * writing its batch until its response was read completely.
+ */
+class LoadClient : public QObject
+{
+    Q_OBJECT
+public:
+    LoadClient( LoadWorker* worker );
+
+public:
+    void start();
+
+private slots:
+    void connected();
+    void readyRead();
+    void failed();
+
+private:
+    void sendBatch();
+    int takeResponse( bool& close );
+
+private:
+    LoadWorker*     mWorker;
+    QTcpSocket*     mSocket;
+    QByteArray      mBuffer;
+    int             mPos;           // Start of unparsed data in mBuffer
+    int             mOutstanding;   // Responses of the current batch still to come
+    qint64          mBatchStart;    // nsecs on the worker's clock
+};
+
+/*
+ * One thread of the load generator. All of its connections are driven by the thread's event
+ * loop, so each of them has requests outstanding at the same time.
+ */
+class LoadWorker : public QThread
+{
+    Q_OBJECT
+public:
+    LoadWorker( const LoadOptions& options, int index, QObject* parent );
+
+public:
+    qint64 requests() const;
+    qint64 errors() const;
+    qint64 bytesReceived() const;
+    const QVector< qint64 >& latencies() const;
+
+protected:
+    void run();
+
+private:
+    friend class LoadClient;
+    LoadOptions         mOptions;
+    int                 mNextPath;
+    qint64              mRequests;
+    qint64              mErrors;
+    qint64              mBytesReceived;
+    QVector< qint64 >   mLatencies;     // usecs
+    QElapsedTimer       mClock;
+};
+
+/*
+ * Quits the application's event loop once all LoadWorkers are done. It counts their finished()
+ * signals rather than asking isFinished(), which only turns true after the signal was emitted.
+ */
+class LoadCompletion : public QObject
+{
+    Q_OBJECT
+public:
+    LoadCompletion( int workers, QObject* parent );
+
+private slots:
+    void workerFinished();
+
+private:
+    int                 mRemaining;
+};
+
+#endif
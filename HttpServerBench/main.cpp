@@ -0,0 +1,263 @@
+/*
+ * Modern CI
+ * Copyright (C) 2012-2013 Sascha Cunz <sascha@babbelbox.org>
+ *
+ * This program is free software; you can redistribute it and/or modify it under the terms of the
+ * GNU General Public License (Version 2) as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without
+ * even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this program; if
+ * not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <stdio.h>
+
+#include <QCoreApplication>
+#include <QStringList>
+#include <QThread>
+
+#include "libHttpServer/Server.hpp"
+#include "libHttpServer/ContentProvider.hpp"
+#include "libHttpServer/Metrics.hpp"
+
+#include "HttpServerBench/BenchContentProvider.hpp"
+#include "HttpServerBench/CoroutineBenchProvider.hpp"
+#include "HttpServerBench/LoadGenerator.hpp"
+
+class NullAccessLog : public HTTP::IAccessLog
+{
+public:
+    void access( int, HTTP::Version, HTTP::Method, const QUrl&, const QHostAddress&, quint16,
+                 HTTP::StatusCode )
+    {
+    }
+};
+
+static void usage()
+{
+    fprintf( stderr,
+             "Usage: HttpServerBench [options]\n"
+             "  --server-threads N   Worker threads of the server (default: half the cores)\n"
+             "  --engine qt|epoll|uring\n"
+             "                       Event engine of the server (default: qt)\n"
+             "  --client-threads N   Load generator threads (default: 2)\n"
+             "  --connections N      Keep-alive connections per load thread (default: 8)\n"
+             "  --pipeline N         Requests in flight per connection (default: 1)\n"
+             "  --duration S         Seconds to run (default: 10)\n"
+             "  --sizes A,B,...      Response body sizes to request in turn (default: 0,1024,16384)\n"
+             "  --static DIR         Serve DIR below /static/ ...\n"
+             "  --path P             ... and request P (repeatable) instead of the sized bodies\n"
+             "  --handler            Answer the sized bodies with an IRequestHandler\n"
+#ifdef HTTP_BENCH_HAVE_COROUTINES
+             "  --coroutine N        Request /coroutine/N, which suspends N times before answering\n"
+#endif
+             "  --metrics            Print the server's metrics afterwards\n" );
+}
+
+static qint64 percentile( const QVector< qint64 >& sorted, double p )
+{
+    if( sorted.isEmpty() )
+    {
+        return 0;
+    }
+
+    int i = int( p * ( sorted.count() - 1 ) + 0.5 );
+    return sorted[ i ];
+}
+
+int main( int argc, char** argv )
+{
+    QCoreApplication app( argc, argv );
+
+    int serverThreads = qMax( QThread::idealThreadCount() / 2, 1 );
+    int clientThreads = 2;
+    bool printMetrics = false;
+    bool useHandler = false;
+    HTTP::EventEngine engine = HTTP::QtEventEngine;
+    QList< int > sizes;
+    QString staticDir;
+    int coroutineSteps = -1;
+
+    LoadOptions options;
+
+    QStringList args = app.arguments();
+    for( int i = 1; i < args.count(); i++ )
+    {
+        const QString& arg = args[ i ];
+        QString value = i + 1 < args.count() ? args[ i + 1 ] : QString();
+
+        if( arg == QLatin1String( "--metrics" ) )
+        {
+            printMetrics = true;
+            continue;
+        }
+
+        if( arg == QLatin1String( "--handler" ) )
+        {
+            useHandler = true;
+            continue;
+        }
+
+        if( value.isEmpty() )
+        {
+            usage();
+            return 1;
+        }
+        i++;
+
+        if( arg == QLatin1String( "--server-threads" ) )
+            serverThreads = value.toInt();
+        else if( arg == QLatin1String( "--engine" ) && value == QLatin1String( "qt" ) )
+            engine = HTTP::QtEventEngine;
+        else if( arg == QLatin1String( "--engine" ) && value == QLatin1String( "epoll" ) )
+            engine = HTTP::EpollEventEngine;
+        else if( arg == QLatin1String( "--engine" ) && value == QLatin1String( "uring" ) )
+            engine = HTTP::UringEventEngine;
+        else if( arg == QLatin1String( "--client-threads" ) )
+            clientThreads = qMax( value.toInt(), 1 );
+        else if( arg == QLatin1String( "--connections" ) )
+            options.mConnections = qMax( value.toInt(), 1 );
+        else if( arg == QLatin1String( "--pipeline" ) )
+            options.mPipeline = qMax( value.toInt(), 1 );
+        else if( arg == QLatin1String( "--duration" ) )
+            options.mDuration = qMax( value.toInt(), 1 ) * 1000;
+        else if( arg == QLatin1String( "--static" ) )
+            staticDir = value;
+        else if( arg == QLatin1String( "--path" ) )
+            options.mPaths.append( value.toUtf8() );
+#ifdef HTTP_BENCH_HAVE_COROUTINES
+        else if( arg == QLatin1String( "--coroutine" ) )
+            coroutineSteps = qMax( value.toInt(), 0 );
+#endif
+        else if( arg == QLatin1String( "--sizes" ) )
+        {
+            foreach( const QString& s, value.split( QLatin1Char( ',' ) ) )
+            {
+                sizes.append( s.toInt() );
+            }
+        }
+        else
+        {
+            usage();
+            return 1;
+        }
+    }
+
+    if( sizes.isEmpty() )
+    {
+        sizes << 0 << 1024 << 16384;
+    }
+
+    if( coroutineSteps >= 0 )
+    {
+        options.mPaths.append( "/coroutine/" + QByteArray::number( coroutineSteps ) );
+    }
+
+    if( options.mPaths.isEmpty() )
+    {
+        foreach( int size, sizes )
+        {
+            options.mPaths.append( "/bench/" + QByteArray::number( size ) );
+        }
+    }
+
+    NullAccessLog accessLog;
+    BenchRequestHandler handler( "/bench/", sizes );
+
+    HTTP::Server server;
+    server.setAccessLog( &accessLog );
+    server.setWorkerThreads( serverThreads );
+    server.setEventEngine( engine );
+    server.addProvider( new BenchContentProvider( QLatin1String( "/bench/" ), sizes, &server ) );
+    if( useHandler )
+    {
+        server.addHandler( "/bench/", &handler );
+    }
+#ifdef HTTP_BENCH_HAVE_COROUTINES
+    server.addProvider( createCoroutineBenchProvider( QLatin1String( "/coroutine/" ), &server ) );
+#endif
+    if( !staticDir.isEmpty() )
+    {
+        server.addProvider( new HTTP::StaticContentProvider( QLatin1String( "/static/" ),
+                                                             staticDir, &server ) );
+    }
+
+    if( !server.listen( QHostAddress::LocalHost ) )
+    {
+        fprintf( stderr, "Cannot listen on the loopback interface\n" );
+        return 1;
+    }
+
+    options.mPort = server.serverPort();
+
+    const char* engineName = "qt";
+    if( server.eventEngine() == HTTP::EpollEventEngine )
+        engineName = "epoll";
+    else if( server.eventEngine() == HTTP::UringEventEngine )
+        engineName = "uring";
+
+    printf( "Server threads: %i (%s); load threads: %i x %i connections; pipeline: %i; %i s\n",
+            serverThreads, engineName,
+            clientThreads, options.mConnections, options.mPipeline, options.mDuration / 1000 );
+
+    LoadCompletion completion( clientThreads, &app );
+
+    QList< LoadWorker* > workers;
+    for( int i = 0; i < clientThreads; i++ )
+    {
+        LoadWorker* w = new LoadWorker( options, i, &app );
+        QObject::connect( w, SIGNAL(finished()), &completion, SLOT(workerFinished()) );
+        workers.append( w );
+    }
+
+    QElapsedTimer clock;
+    clock.start();
+
+    foreach( LoadWorker* w, workers )
+    {
+        w->start();
+    }
+
+    // The event loop runs until the last worker finished; their results are safe to read once
+    // they have returned from run()
+    app.exec();
+
+    foreach( LoadWorker* w, workers )
+    {
+        w->wait();
+    }
+
+    double seconds = clock.nsecsElapsed() / 1e9;
+
+    qint64 requests = 0;
+    qint64 errors = 0;
+    qint64 bytes = 0;
+    QVector< qint64 > latencies;
+    foreach( LoadWorker* w, workers )
+    {
+        requests += w->requests();
+        errors += w->errors();
+        bytes += w->bytesReceived();
+        latencies += w->latencies();
+    }
+    qSort( latencies );
+
+    printf( "Requests: %lli; errors: %lli\n", requests, errors );
+    printf( "Throughput: %.0f req/s; %.2f MiB/s\n",
+            requests / seconds, bytes / seconds / ( 1024 * 1024 ) );
+    printf( "Latency (us): p50 %lli; p90 %lli; p99 %lli; p99.9 %lli; max %lli\n",
+            percentile( latencies, 0.5 ), percentile( latencies, 0.9 ),
+            percentile( latencies, 0.99 ), percentile( latencies, 0.999 ),
+            latencies.isEmpty() ? 0 : latencies.last() );
+
+    if( printMetrics )
+    {
+        printf( "\n%s", server.metrics().toText().constData() );
+    }
+
+    return errors ? 2 : 0;
+}
@@ -0,0 +1,267 @@
+/*
+ * Modern CI
+ * Copyright (C) 2012-2013 Sascha Cunz <sascha@babbelbox.org>
+ *
+ * This program is free software; you can redistribute it and/or modify it under the terms of the
+ * GNU General Public License (Version 2) as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without
+ * even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this program; if
+ * not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <stdio.h>
+
+#include <QCoreApplication>
+#include <QEvent>
+#include <QFile>
+#include <QTcpServer>
+#include <QTcpSocket>
+
+#include "libHttpServer/Server.hpp"
+#include "libHttpServer/ContentProvider.hpp"
+
+#include "libHttpServer/Internal/Server.hpp"
+#include "libHttpServer/Internal/Connection.hpp"
+#include "libHttpServer/Internal/RoundRobinServer.hpp"
+#include "libHttpServer/Internal/Transport.hpp"
+#include "libHttpServer/Internal/AllocStats.hpp"
+
+#include "HttpServerMicroBench/AllocBudget.hpp"
+
+using namespace HTTP;
+
+static const int sWarmUp = 1000;
+static const int sMeasured = 10000;
+static const double sSlack = 0.5;   // Allocations per request a stage may drop below its budget
+
+static const char sRequest[] =
+    "GET /cached/app.js HTTP/1.1\r\n"
+    "Host: ci.example.org\r\n"
+    "Connection: keep-alive\r\n"
+    "Accept: */*\r\n"
+    "User-Agent: Mozilla/5.0 (X11; Linux x86_64) AppleWebKit/537.31 (KHTML, like Gecko)\r\n"
+    "Accept-Encoding: gzip,deflate\r\n"
+    "\r\n";
+
+class NullAccessLog : public IAccessLog
+{
+public:
+    void access( int, Version, Method, const QUrl&, const QHostAddress&, quint16, StatusCode )
+    {
+    }
+};
+
+/*
+ * Answers everything with the same prebuilt body, as a response cache would.
+ */
+class CachedProvider : public ContentProvider
+{
+public:
+    CachedProvider()
+        : ContentProvider( NULL )
+        , mBody( 2048, 'x' )
+    {
+    }
+
+    bool canHandle( const QUrl& ) const
+    {
+        return true;
+    }
+
+    void newRequest( Request* request )
+    {
+        Response* res = request->response();
+        res->addHeader( "Content-Type", "application/javascript" );
+        res->addBody( mBody );
+        res->finish( Ok );
+    }
+
+    QByteArray          mBody;
+};
+
+static bool readBudgets( const QString& fileName, double* budgets )
+{
+    QFile f( fileName );
+    if( !f.open( QFile::ReadOnly ) )
+    {
+        return false;
+    }
+
+    while( !f.atEnd() )
+    {
+        QList< QByteArray > fields = f.readLine().simplified().split( ' ' );
+        if( fields.count() != 2 || fields[ 0 ].startsWith( '#' ) )
+        {
+            continue;
+        }
+
+        for( int i = AllocStats::Parse; i < AllocStats::StageCount; i++ )
+        {
+            if( fields[ 0 ] == AllocStats::stageName( AllocStats::Stage( i ) ) )
+            {
+                budgets[ i ] = fields[ 1 ].toDouble();
+            }
+        }
+    }
+
+    return true;
+}
+
+static bool writeBudgets( const QString& fileName, const double* measured )
+{
+    QFile f( fileName );
+    if( !f.open( QFile::WriteOnly | QFile::Truncate ) )
+    {
+        return false;
+    }
+
+    f.write( "# Allocations per keep-alive GET served from cache, per stage\n" );
+    for( int i = AllocStats::Parse; i < AllocStats::StageCount; i++ )
+    {
+        f.write( AllocStats::stageName( AllocStats::Stage( i ) ) );
+        f.write( " " );
+        f.write( QByteArray::number( measured[ i ], 'f', 2 ) );
+        f.write( "\n" );
+    }
+
+    return true;
+}
+
+/*
+ * Drives requests through a Connection over a loopback socket and compares the allocations per
+ * request of each stage against the budgets in `budgetFile` (or records them there). Returns
+ * the process exit code: non-zero if any stage has no budget or does not match it. Budgets are
+ * the measured counts, so a stage that got leaner fails too, until they are recorded again.
+ */
+int checkAllocationBudgets( const QString& budgetFile, bool record )
+{
+#ifndef HTTP_SERVER_ALLOC_COUNTING
+    Q_UNUSED( budgetFile );
+    Q_UNUSED( record );
+    fprintf( stderr, "Allocation budgets need a build with HTTP_SERVER_ALLOC_COUNTING\n" );
+    return 1;
+#else
+    double budgets[ AllocStats::StageCount ];
+    for( int i = 0; i < AllocStats::StageCount; i++ )
+    {
+        budgets[ i ] = -1;
+    }
+
+    if( !record && !readBudgets( budgetFile, budgets ) )
+    {
+        fprintf( stderr, "Cannot read %s\n", qPrintable( budgetFile ) );
+        return 1;
+    }
+
+    QTcpServer listener;
+    QTcpSocket client;
+    if( !listener.listen( QHostAddress::LocalHost ) )
+    {
+        fprintf( stderr, "Cannot listen on the loopback interface\n" );
+        return 1;
+    }
+
+    client.connectToHost( QHostAddress::LocalHost, listener.serverPort() );
+    if( !client.waitForConnected( 5000 ) || !listener.waitForNewConnection( 5000 ) )
+    {
+        fprintf( stderr, "Cannot connect over the loopback interface\n" );
+        return 1;
+    }
+    QTcpSocket* socket = listener.nextPendingConnection();
+
+    NullAccessLog accessLog;
+    CachedProvider provider;
+    Server server;
+    ServerPrivate priv( &server );
+    priv.mAccessLog = &accessLog;
+    priv.mProviders.append( &provider );
+
+    Establisher* establisher = new Establisher( &priv );
+    Connection* connection = new Connection( new QtTransport( socket ), &priv,
+                                            establisher );
+
+    const int length = int( sizeof( sRequest ) ) - 1;
+    for( int i = 0; i < sWarmUp + sMeasured; i++ )
+    {
+        if( i == sWarmUp )
+        {
+            AllocStats::reset();
+        }
+
+        connection->received( sRequest, length );
+
+        {
+            AllocStage stage( AllocStats::Write );
+            socket->flush();
+        }
+
+        // Drain the client; this does not count towards the checked stages
+
+        while( client.bytesAvailable() || client.waitForReadyRead( 0 ) )
+        {
+            client.readAll();
+        }
+
+        // What the event loop would do between two reads: queued calls and deleteLater()s
+        QCoreApplication::processEvents();
+        QCoreApplication::sendPostedEvents( 0, QEvent::DeferredDelete );
+    }
+
+    double measured[ AllocStats::StageCount ];
+    for( int i = 0; i < AllocStats::StageCount; i++ )
+    {
+        measured[ i ] = double( AllocStats::allocations( AllocStats::Stage( i ) ) ) / sMeasured;
+    }
+
+    delete establisher;
+
+    if( record )
+    {
+        if( !writeBudgets( budgetFile, measured ) )
+        {
+            fprintf( stderr, "Cannot write %s\n", qPrintable( budgetFile ) );
+            return 1;
+        }
+    }
+
+    int failed = 0;
+    printf( "%-10s %12s %12s\n", "stage", "allocs/req", "budget" );
+    for( int i = AllocStats::Parse; i < AllocStats::StageCount; i++ )
+    {
+        const char* name = AllocStats::stageName( AllocStats::Stage( i ) );
+        bool over = budgets[ i ] >= 0 && measured[ i ] > budgets[ i ] + 0.005;
+        bool under = budgets[ i ] >= 0 && measured[ i ] < budgets[ i ] - sSlack;
+
+        if( record )
+        {
+            printf( "%-10s %12.2f %12.2f\n", name, measured[ i ], measured[ i ] );
+        }
+        else if( budgets[ i ] >= 0 )
+        {
+            printf( "%-10s %12.2f %12.2f%s\n", name, measured[ i ], budgets[ i ],
+                    over ? "  OVER BUDGET" : under ? "  UNDER BUDGET" : "" );
+        }
+        else
+        {
+            printf( "%-10s %12.2f %12s  NO BUDGET\n", name, measured[ i ], "-" );
+        }
+
+        if( !record && ( over || under || budgets[ i ] < 0 ) )
+        {
+            failed++;
+        }
+    }
+
+    if( failed )
+    {
+        fprintf( stderr, "Record the budgets again with --record-budgets if this is intended\n" );
+    }
+
+    return failed ? 2 : 0;
+#endif
+}
@@ -0,0 +1,88 @@
+/*
+ * Modern CI
+ * Copyright (C) 2012-2013 Sascha Cunz <sascha@babbelbox.org>
+ *
+ * This program is free software; you can redistribute it and/or modify it under the terms of the
+ * GNU General Public License (Version 2) as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without
+ * even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this program; if
+ * not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <stdlib.h>
+
+#include "HttpServerMicroBench/AllocCounter.hpp"
+
+#include "libHttpServer/Internal/AllocStats.hpp"
+
+#ifdef Q_CC_MSVC
+static __declspec( thread ) qint64 tAllocations = 0;
+#else
+static __thread qint64 tAllocations = 0;
+#endif
+
+#ifdef __GLIBC__
+
+static inline void countAllocation()
+{
+    tAllocations++;
+#ifdef HTTP_SERVER_ALLOC_COUNTING
+    HTTP::AllocStats::count();
+#endif
+}
+
+extern "C"
+{
+    void* __libc_malloc( size_t size );
+    void* __libc_calloc( size_t count, size_t size );
+    void* __libc_realloc( void* p, size_t size );
+    void* __libc_memalign( size_t alignment, size_t size );
+
+    void* malloc( size_t size )
+    {
+        countAllocation();
+        return __libc_malloc( size );
+    }
+
+    void* calloc( size_t count, size_t size )
+    {
+        countAllocation();
+        return __libc_calloc( count, size );
+    }
+
+    void* realloc( void* p, size_t size )
+    {
+        countAllocation();
+        return __libc_realloc( p, size );
+    }
+
+    void* memalign( size_t alignment, size_t size )
+    {
+        countAllocation();
+        return __libc_memalign( alignment, size );
+    }
+}
+
+bool AllocCounter::isAvailable()
+{
+    return true;
+}
+
+#else
+
+bool AllocCounter::isAvailable()
+{
+    return false;
+}
+
+#endif
+
+qint64 AllocCounter::allocations()
+{
+    return tAllocations;
+}
@@ -0,0 +1,36 @@
+/*
+ * Modern CI
+ * Copyright (C) 2012-2013 Sascha Cunz <sascha@babbelbox.org>
+ *
+ * This program is free software; you can redistribute it and/or modify it under the terms of the
+ * GNU General Public License (Version 2) as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without
+ * even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this program; if
+ * not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef HTTP_ALLOC_COUNTER_HPP
+#define HTTP_ALLOC_COUNTER_HPP
+
+#include <QtGlobal>
+
+/*
+ * Counts the heap allocations of the calling thread. On glibc this executable interposes
+ * malloc() and friends, which also catches operator new and Qt's own allocations.
+ *
+ * With HTTP_SERVER_ALLOC_COUNTING, every allocation is also reported to HTTP::AllocStats, so it
+ * can be attributed to a stage of request processing.
+ */
+class AllocCounter
+{
+public:
+    static bool isAvailable();
+    static qint64 allocations();
+};
+
+#endif
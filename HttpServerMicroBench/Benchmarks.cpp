@@ -0,0 +1,452 @@
+/*
+ * Modern CI
+ * Copyright (C) 2012-2013 Sascha Cunz <sascha@babbelbox.org>
+ *
+ * This program is free software; you can redistribute it and/or modify it under the terms of the
+ * GNU General Public License (Version 2) as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without
+ * even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this program; if
+ * not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <string.h>
+
+#include <QTcpSocket>
+#include <QDateTime>
+
+#include "libHttpServer/Server.hpp"
+#include "libHttpServer/ContentProvider.hpp"
+
+#include "libHttpServer/Internal/Http.hpp"
+#include "libHttpServer/Internal/Server.hpp"
+#include "libHttpServer/Internal/Connection.hpp"
+#include "libHttpServer/Internal/Request.hpp"
+#include "libHttpServer/Internal/Response.hpp"
+#include "libHttpServer/Internal/RoundRobinServer.hpp"
+#include "libHttpServer/Internal/Transport.hpp"
+#include "libHttpServer/Internal/WebSocketFrame.hpp"
+#include "libHttpServer/Internal/http_scan.h"
+
+#include "HttpServerMicroBench/Benchmarks.hpp"
+
+namespace HTTP
+{
+
+    class MicroBenchmarkAccess
+    {
+    public:
+        typedef Request::Data   RequestData;
+        typedef Response::Data  ResponseData;
+    };
+
+}
+
+using namespace HTTP;
+
+typedef MicroBenchmarkAccess::RequestData   RequestData;
+typedef MicroBenchmarkAccess::ResponseData  ResponseData;
+
+/*
+ * Takes every request the server dispatches, without answering it.
+ */
+class CollectingProvider : public ContentProvider
+{
+public:
+    CollectingProvider()
+        : ContentProvider( NULL )
+    {
+    }
+
+    bool canHandle( const QUrl& ) const
+    {
+        return true;
+    }
+
+    void newRequest( Request* request )
+    {
+        mRequests.append( request );
+    }
+
+    QList< Request* > mRequests;
+};
+
+/*
+ * http_parser_execute() with the Connection's callbacks, i.e. parsing plus building the
+ * Request and dispatching it to a provider. With a piece size, the data arrives in pieces of
+ * that many bytes, like from a slow client.
+ */
+class ConnectionParseBenchmark : public MicroBenchmark
+{
+public:
+    ConnectionParseBenchmark( const CorpusEntry& entry, int pieceSize = 0 )
+        : MicroBenchmark( pieceSize ? "parse/connection-pieces/" + entry.mName
+                                    : "parse/connection/" + entry.mName )
+        , mData( entry.mData )
+        , mPieceSize( pieceSize ? pieceSize : entry.mData.size() )
+        , mServer( NULL )
+        , mPrivate( NULL )
+        , mEstablisher( NULL )
+        , mConnection( NULL )
+    {
+    }
+
+    void setUp()
+    {
+        mServer = new Server;
+        mPrivate = new ServerPrivate( mServer );
+        mPrivate->mProviders.append( &mProvider );
+        mEstablisher = new Establisher( mPrivate );
+        mConnection = new Connection( new QtTransport( new QTcpSocket ), mPrivate,
+                                      mEstablisher );
+    }
+
+    void run( qint64 iterations )
+    {
+        for( qint64 i = 0; i < iterations; i++ )
+        {
+            for( int pos = 0; pos < mData.size(); pos += mPieceSize )
+            {
+                mConnection->received( mData.constData() + pos,
+                                       qMin( mPieceSize, mData.size() - pos ) );
+            }
+            gBenchSink += mProvider.mRequests.count();
+            qDeleteAll( mProvider.mRequests );
+            mProvider.mRequests.clear();
+        }
+    }
+
+    void tearDown()
+    {
+        delete mEstablisher;    // Takes the connection with it
+        delete mPrivate;
+        delete mServer;
+    }
+
+private:
+    QByteArray          mData;
+    int                 mPieceSize;
+    CollectingProvider  mProvider;
+    Server*             mServer;
+    ServerPrivate*      mPrivate;
+    Establisher*        mEstablisher;
+    Connection*         mConnection;
+};
+
+/*
+ * The bare parser without any callbacks, as the lower bound for the above. Runs with each
+ * implementation of the parser's scanners the CPU supports; the default one has no suffix.
+ */
+class RawParseBenchmark : public MicroBenchmark
+{
+public:
+    RawParseBenchmark( const CorpusEntry& entry, http_scan_level level, const char* suffix )
+        : MicroBenchmark( "parse/raw" + QByteArray( suffix ) + "/" + entry.mName )
+        , mData( entry.mData )
+        , mLevel( level )
+        , mPrevious( HTTP_SCAN_SCALAR )
+    {
+        memset( &mSettings, 0, sizeof( mSettings ) );
+    }
+
+    void setUp()
+    {
+        mPrevious = http_scan_current_level();
+        http_scan_set_level( mLevel );
+    }
+
+    void run( qint64 iterations )
+    {
+        for( qint64 i = 0; i < iterations; i++ )
+        {
+            http_parser parser;
+            http_parser_init( &parser, HTTP_REQUEST );
+            gBenchSink += http_parser_execute( &parser, &mSettings, mData.constData(),
+                                               mData.size() );
+        }
+    }
+
+    void tearDown()
+    {
+        http_scan_set_level( mPrevious );
+    }
+
+private:
+    QByteArray              mData;
+    http_parser_settings    mSettings;
+    http_scan_level         mLevel;
+    http_scan_level         mPrevious;
+};
+
+/*
+ * Storing all headers of one request, the way the parser hands them over.
+ */
+class AppendHeadersBenchmark : public MicroBenchmark
+{
+public:
+    AppendHeadersBenchmark( const CorpusEntry& entry )
+        : MicroBenchmark( "request/appendHeaderData/" + entry.mName )
+    {
+        QList< QByteArray > lines = entry.mData.split( '\n' );
+        for( int i = 1; i < lines.count(); i++ )
+        {
+            QByteArray line = lines[ i ].trimmed();
+            int colon = line.indexOf( ':' );
+            if( colon <= 0 )
+            {
+                break;
+            }
+            mNames.append( line.left( colon ) );
+            mValues.append( line.mid( colon + 1 ).trimmed() );
+        }
+    }
+
+    void run( qint64 iterations )
+    {
+        for( qint64 i = 0; i < iterations; i++ )
+        {
+            RequestData d;
+            for( int j = 0; j < mNames.count(); j++ )
+            {
+                d.appendHeaderData( mNames[ j ], mValues[ j ] );
+            }
+            gBenchSink += d.mHeaders.count();
+        }
+    }
+
+private:
+    QList< QByteArray > mNames;
+    QList< QByteArray > mValues;
+};
+
+/*
+ * Status line and header block of a typical static file response.
+ */
+class SerializeHeadersBenchmark : public MicroBenchmark
+{
+public:
+    SerializeHeadersBenchmark()
+        : MicroBenchmark( "response/serializeHeaders" )
+    {
+    }
+
+    void setUp()
+    {
+        QDateTime now = QDateTime::currentDateTimeUtc();
+
+        mData.mFlags = ResponseData::KeepAlive | ResponseData::BodyIsFixed;
+        mData.mBody.append( BodySegment( QByteArray( 4096, 'x' ) ) );
+        mData.mHeaders.insert( "Content-Type", "text/css" );
+        mData.mHeaders.insert( "Cache-Control", "max-age=1200" );
+        mData.mHeaders.insert( "Expires", toRfc1123date( now.addSecs( 1200 ) ) );
+        mData.mHeaders.insert( "Last-Modified", toRfc1123date( now.addDays( -3 ) ) );
+        mData.mHeaders.insert( "ETag", "\"2f1c03-1000-4f8b1c3a9e2c0\"" );
+    }
+
+    void run( qint64 iterations )
+    {
+        for( qint64 i = 0; i < iterations; i++ )
+        {
+            gBenchSink += mData.serializeHeaders( Ok ).size();
+        }
+    }
+
+private:
+    ResponseData    mData;
+};
+
+class FormatDateBenchmark : public MicroBenchmark
+{
+public:
+    FormatDateBenchmark()
+        : MicroBenchmark( "date/toRfc1123date" )
+        , mDate( QDate( 2013, 4, 12 ), QTime( 9, 41, 17 ), Qt::UTC )
+    {
+    }
+
+    void run( qint64 iterations )
+    {
+        for( qint64 i = 0; i < iterations; i++ )
+        {
+            gBenchSink += toRfc1123date( mDate ).size();
+        }
+    }
+
+private:
+    QDateTime   mDate;
+};
+
+class ParseDateBenchmark : public MicroBenchmark
+{
+public:
+    ParseDateBenchmark()
+        : MicroBenchmark( "date/fromRfc1123date" )
+        , mText( "Fri, 12 Apr 2013 09:41:17 GMT" )
+    {
+    }
+
+    void run( qint64 iterations )
+    {
+        for( qint64 i = 0; i < iterations; i++ )
+        {
+            gBenchSink += fromRfc1123date( mText ).isValid();
+        }
+    }
+
+private:
+    QByteArray  mText;
+};
+
+class StatusTextBenchmark : public MicroBenchmark
+{
+public:
+    StatusTextBenchmark()
+        : MicroBenchmark( "lookup/code2Text" )
+    {
+    }
+
+    void run( qint64 iterations )
+    {
+        static const int codes[ 8 ] = { 200, 304, 404, 200, 301, 500, 200, 206 };
+        for( qint64 i = 0; i < iterations; i++ )
+        {
+            gBenchSink += qint64( code2Text( codes[ i & 7 ] ) != NULL );
+        }
+    }
+};
+
+class MethodBenchmark : public MicroBenchmark
+{
+public:
+    MethodBenchmark()
+        : MicroBenchmark( "lookup/method" )
+    {
+    }
+
+    void run( qint64 iterations )
+    {
+        for( qint64 i = 0; i < iterations; i++ )
+        {
+            gBenchSink += method( (unsigned char)( i % ( HTTP_PURGE + 1 ) ) );
+        }
+    }
+};
+
+class MimeTypeBenchmark : public MicroBenchmark
+{
+public:
+    MimeTypeBenchmark()
+        : MicroBenchmark( "static/mimeType" )
+        , mProvider( NULL )
+    {
+        mPaths << QLatin1String( "/static/css/main.css" )
+               << QLatin1String( "/static/js/app.js" )
+               << QLatin1String( "/static/img/logo.png" );
+    }
+
+    void setUp()
+    {
+        mProvider = new StaticContentProvider( QLatin1String( "/static/" ),
+                                               QLatin1String( "/nonexistent" ), NULL );
+    }
+
+    void run( qint64 iterations )
+    {
+        for( qint64 i = 0; i < iterations; i++ )
+        {
+            gBenchSink += mProvider->mimeType( mPaths[ int( i % mPaths.count() ) ] ).size();
+        }
+    }
+
+    void tearDown()
+    {
+        delete mProvider;
+        mProvider = NULL;
+    }
+
+private:
+    QStringList             mPaths;
+    StaticContentProvider*  mProvider;
+};
+
+/*
+ * Unmasking a 16 KiB WebSocket payload, as it comes out of one read; starting at an odd
+ * position in the key, as after a frame header that spanned two reads.
+ */
+class WebSocketUnmaskBenchmark : public MicroBenchmark
+{
+public:
+    WebSocketUnmaskBenchmark( bool scalar )
+        : MicroBenchmark( scalar ? "websocket/unmask-scalar" : "websocket/unmask" )
+        , mScalar( scalar )
+        , mPayload( 16 * 1024, 'x' )
+        , mTarget( 16 * 1024, '\0' )
+    {
+        mKey[ 0 ] = 0x37;
+        mKey[ 1 ] = 0xfa;
+        mKey[ 2 ] = 0x21;
+        mKey[ 3 ] = 0x3d;
+    }
+
+    void run( qint64 iterations )
+    {
+        char* target = mTarget.data();
+        for( qint64 i = 0; i < iterations; i++ )
+        {
+            if( mScalar )
+            {
+                WebSocketFrame::unmaskScalar( target, mPayload.constData(), mPayload.size(),
+                                              mKey, 1 );
+            }
+            else
+            {
+                WebSocketFrame::unmask( target, mPayload.constData(), mPayload.size(), mKey, 1 );
+            }
+            gBenchSink += target[ i & 0x3fff ];
+        }
+    }
+
+private:
+    bool            mScalar;
+    QByteArray      mPayload;
+    QByteArray      mTarget;
+    unsigned char   mKey[ 4 ];
+};
+
+MicroBenchmarks createBenchmarks( const Corpus& corpus )
+{
+    MicroBenchmarks b;
+    http_scan_level defaultLevel = http_scan_current_level();
+    http_scan_level bestLevel = http_scan_best_level();
+
+    foreach( const CorpusEntry& entry, corpus )
+    {
+        b.append( new RawParseBenchmark( entry, defaultLevel, "" ) );
+        if( defaultLevel != HTTP_SCAN_SCALAR )
+        {
+            b.append( new RawParseBenchmark( entry, HTTP_SCAN_SCALAR, "-scalar" ) );
+        }
+        if( bestLevel == HTTP_SCAN_AVX2 && defaultLevel != HTTP_SCAN_AVX2 )
+        {
+            b.append( new RawParseBenchmark( entry, HTTP_SCAN_AVX2, "-avx2" ) );
+        }
+        b.append( new ConnectionParseBenchmark( entry ) );
+        b.append( new ConnectionParseBenchmark( entry, 8 ) );
+        b.append( new AppendHeadersBenchmark( entry ) );
+    }
+
+    b.append( new SerializeHeadersBenchmark );
+    b.append( new FormatDateBenchmark );
+    b.append( new ParseDateBenchmark );
+    b.append( new StatusTextBenchmark );
+    b.append( new MethodBenchmark );
+    b.append( new MimeTypeBenchmark );
+    b.append( new WebSocketUnmaskBenchmark( false ) );
+    b.append( new WebSocketUnmaskBenchmark( true ) );
+
+    return b;
+}
@@ -0,0 +1,115 @@
+/*
+ * Modern CI
+ * Copyright (C) 2012-2013 Sascha Cunz <sascha@babbelbox.org>
+ *
+ * This program is free software; you can redistribute it and/or modify it under the terms of the
+ * GNU General Public License (Version 2) as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without
+ * even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this program; if
+ * not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <stdio.h>
+
+#include <QElapsedTimer>
+
+#include "HttpServerMicroBench/MicroBenchmark.hpp"
+#include "HttpServerMicroBench/AllocCounter.hpp"
+
+volatile qint64 gBenchSink = 0;
+
+MicroBenchmark::MicroBenchmark( const QByteArray& name )
+    : mName( name )
+{
+}
+
+MicroBenchmark::~MicroBenchmark()
+{
+}
+
+QByteArray MicroBenchmark::name() const
+{
+    return mName;
+}
+
+void MicroBenchmark::setUp()
+{
+}
+
+void MicroBenchmark::tearDown()
+{
+}
+
+MicroBenchmarkRunner::MicroBenchmarkRunner()
+    : mMinTime( 200 )
+{
+}
+
+void MicroBenchmarkRunner::setFilter( const QByteArray& filter )
+{
+    mFilter = filter;
+}
+
+void MicroBenchmarkRunner::setMinTime( int msecs )
+{
+    mMinTime = qMax( msecs, 1 );
+}
+
+void MicroBenchmarkRunner::run( const MicroBenchmarks& benchmarks )
+{
+    printf( "%-36s %12s %12s %12s\n", "benchmark", "iterations", "ns/op", "allocs/op" );
+
+    foreach( MicroBenchmark* b, benchmarks )
+    {
+        if( !mFilter.isEmpty() && !b->name().contains( mFilter ) )
+        {
+            continue;
+        }
+
+        b->setUp();
+
+        // Warm up caches and lazily built state, and find an iteration count that takes long
+        // enough to measure
+        qint64 iterations = 16;
+        b->run( iterations );
+        forever
+        {
+            QElapsedTimer t;
+            t.start();
+            b->run( iterations );
+            if( t.elapsed() * 10 >= mMinTime || iterations >= ( Q_INT64_C( 1 ) << 28 ) )
+            {
+                break;
+            }
+            iterations *= 2;
+        }
+        iterations *= 10;
+
+        qint64 allocations = AllocCounter::allocations();
+        QElapsedTimer t;
+        t.start();
+
+        b->run( iterations );
+
+        qint64 nsecs = t.nsecsElapsed();
+        allocations = AllocCounter::allocations() - allocations;
+
+        b->tearDown();
+
+        if( AllocCounter::isAvailable() )
+        {
+            printf( "%-36s %12lli %12.1f %12.2f\n", b->name().constData(), iterations,
+                    double( nsecs ) / iterations, double( allocations ) / iterations );
+        }
+        else
+        {
+            printf( "%-36s %12lli %12.1f %12s\n", b->name().constData(), iterations,
+                    double( nsecs ) / iterations, "n/a" );
+        }
+    }
+}
@@ -0,0 +1,69 @@
+/*
+ * Modern CI
+ * Copyright (C) 2012-2013 Sascha Cunz <sascha@babbelbox.org>
+ *
+ * This program is free software; you can redistribute it and/or modify it under the terms of the
+ * GNU General Public License (Version 2) as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without
+ * even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this program; if
+ * not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef HTTP_MICRO_BENCHMARK_HPP
+#define HTTP_MICRO_BENCHMARK_HPP
+
+#include <QByteArray>
+#include <QList>
+
+/*
+ * One measured operation. run() must perform the operation exactly `iterations` times; setUp()
+ * and tearDown() are not measured.
+ */
+class MicroBenchmark
+{
+public:
+    MicroBenchmark( const QByteArray& name );
+    virtual ~MicroBenchmark();
+
+public:
+    QByteArray name() const;
+
+    virtual void setUp();
+    virtual void run( qint64 iterations ) = 0;
+    virtual void tearDown();
+
+private:
+    QByteArray  mName;
+};
+
+typedef QList< MicroBenchmark* > MicroBenchmarks;
+
+/*
+ * Runs each benchmark long enough for a stable figure (about `minTime` msecs after a warm up)
+ * and prints ns/op and allocations/op.
+ */
+class MicroBenchmarkRunner
+{
+public:
+    MicroBenchmarkRunner();
+
+public:
+    void setFilter( const QByteArray& filter );
+    void setMinTime( int msecs );
+
+    void run( const MicroBenchmarks& benchmarks );
+
+private:
+    QByteArray  mFilter;
+    int         mMinTime;
+};
+
+// Benchmarks store results here, so the compiler cannot drop the measured work
+extern volatile qint64 gBenchSink;
+
+#endif
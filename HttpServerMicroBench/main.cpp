@@ -0,0 +1,85 @@
+/*
+ * Modern CI
+ * Copyright (C) 2012-2013 Sascha Cunz <sascha@babbelbox.org>
+ *
+ * This program is free software; you can redistribute it and/or modify it under the terms of the
+ * GNU General Public License (Version 2) as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without
+ * even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this program; if
+ * not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <stdio.h>
+
+#include <QCoreApplication>
+#include <QStringList>
+
+#include "HttpServerMicroBench/Benchmarks.hpp"
+#include "HttpServerMicroBench/AllocBudget.hpp"
+
+static void usage()
+{
+    fprintf( stderr,
+             "Usage: HttpServerMicroBench [options] [filter]\n"
+             "  --corpus FILE    Also run the request benchmarks on a raw capture (repeatable)\n"
+             "  --time MSECS     Minimum measuring time per benchmark (default: 200)\n"
+             "  --check-budgets FILE   Instead, compare allocations per request and stage\n"
+             "                         against FILE; exits non-zero if one is exceeded\n"
+             "  --record-budgets FILE  Instead, write the current allocations to FILE\n"
+             "  filter           Only run benchmarks whose name contains this\n" );
+}
+
+int main( int argc, char** argv )
+{
+    QCoreApplication app( argc, argv );
+
+    Corpus corpus = builtinCorpus();
+    MicroBenchmarkRunner runner;
+
+    QStringList args = app.arguments();
+    for( int i = 1; i < args.count(); i++ )
+    {
+        const QString& arg = args[ i ];
+
+        if( arg == QLatin1String( "--corpus" ) && i + 1 < args.count() )
+        {
+            if( !loadCorpusFile( args[ ++i ], corpus ) )
+            {
+                fprintf( stderr, "Cannot read %s\n", qPrintable( args[ i ] ) );
+                return 1;
+            }
+        }
+        else if( arg == QLatin1String( "--time" ) && i + 1 < args.count() )
+        {
+            runner.setMinTime( args[ ++i ].toInt() );
+        }
+        else if( arg == QLatin1String( "--check-budgets" ) && i + 1 < args.count() )
+        {
+            return checkAllocationBudgets( args[ ++i ], false );
+        }
+        else if( arg == QLatin1String( "--record-budgets" ) && i + 1 < args.count() )
+        {
+            return checkAllocationBudgets( args[ ++i ], true );
+        }
+        else if( arg.startsWith( QLatin1String( "--" ) ) )
+        {
+            usage();
+            return 1;
+        }
+        else
+        {
+            runner.setFilter( arg.toUtf8() );
+        }
+    }
+
+    MicroBenchmarks benchmarks = createBenchmarks( corpus );
+    runner.run( benchmarks );
+    qDeleteAll( benchmarks );
+
+    return 0;
+}
@@ -0,0 +1,574 @@
+/*
+ * Modern CI
+ * Copyright (C) 2012-2013 Sascha Cunz <sascha@babbelbox.org>
+ *
+ * This program is free software; you can redistribute it and/or modify it under the terms of the
+ * GNU General Public License (Version 2) as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without
+ * even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this program; if
+ * not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <QUrl>
+#include <QDateTime>
+#include <QElapsedTimer>
+#include <QAbstractSocket>
+
+#ifdef Q_OS_UNIX
+#include <unistd.h>
+#endif
+
+#include "libHttpServer/Internal/AccessLog.hpp"
+#include "libHttpServer/Internal/Connection.hpp"
+
+namespace HTTP
+{
+
+    AccessLogRing::AccessLogRing()
+        : mHead( 0 )
+        , mTail( 0 )
+        , mOrphaned( 0 )
+    {
+    }
+
+    /*
+     * Returns the slot to fill, or NULL if the ring is full. Must be followed by endPush().
+     */
+    AccessRecord* AccessLogRing::beginPush()
+    {
+        int head = mHead;
+        int next = ( head + 1 ) % Size;
+
+        if( next == mTail.fetchAndAddAcquire( 0 ) )
+        {
+            return NULL;
+        }
+
+        return &mRecords[ head ];
+    }
+
+    void AccessLogRing::endPush()
+    {
+        int head = mHead;
+        mHead.fetchAndStoreRelease( ( head + 1 ) % Size );
+    }
+
+    int AccessLogRing::pop( AccessRecord* records, int max )
+    {
+        int tail = mTail;
+        int head = mHead.fetchAndAddAcquire( 0 );
+        int count = 0;
+
+        while( tail != head && count < max )
+        {
+            records[ count++ ] = mRecords[ tail ];
+            tail = ( tail + 1 ) % Size;
+        }
+
+        mTail.fetchAndStoreRelease( tail );
+        return count;
+    }
+
+    bool AccessLogRing::isOrphaned() const
+    {
+        return const_cast< QAtomicInt& >( mOrphaned ).fetchAndAddAcquire( 0 ) != 0;
+    }
+
+    void AccessLogRing::orphan()
+    {
+        mOrphaned.fetchAndStoreRelease( 1 );
+    }
+
+    AccessLogRingHandle::AccessLogRingHandle( AccessLogRing* ring )
+        : mRing( ring )
+    {
+    }
+
+    AccessLogRingHandle::~AccessLogRingHandle()
+    {
+        mRing->orphan();
+    }
+
+    FileAccessLogWriter::FileAccessLogWriter( FileAccessLogPrivate* log )
+        : mLog( log )
+        , mStop( false )
+        , mLastSecond( -1 )
+    {
+    }
+
+    void FileAccessLogWriter::stop()
+    {
+        QMutexLocker l( &mStopMutex );
+        mStop = true;
+        mStopCondition.wakeAll();
+    }
+
+    void FileAccessLogWriter::run()
+    {
+        QElapsedTimer sinceSync;
+        sinceSync.start();
+
+        QByteArray out;
+        bool unsynced = false;
+
+        forever
+        {
+            bool stopping;
+            {
+                QMutexLocker l( &mStopMutex );
+                if( !mStop )
+                {
+                    mStopCondition.wait( &mStopMutex, ulong( int( mLog->mFlushInterval ) ) );
+                }
+                stopping = mStop;
+            }
+
+            if( drain( out ) )
+            {
+                mLog->mFile.write( out );
+                mLog->mFile.flush();
+                out.clear();
+                unsynced = true;
+            }
+
+            if( unsynced && ( stopping || sinceSync.elapsed() >= int( mLog->mSyncInterval ) ) )
+            {
+                #ifdef Q_OS_UNIX
+                ::fsync( mLog->mFile.handle() );
+                #endif
+                unsynced = false;
+                sinceSync.restart();
+            }
+
+            if( stopping )
+            {
+                return;
+            }
+        }
+    }
+
+    bool FileAccessLogWriter::drain( QByteArray& out )
+    {
+        enum { BatchSize = 64 };
+        AccessRecord records[ BatchSize ];
+
+        QMutexLocker l( &mLog->mRingsMutex );
+
+        int i = 0;
+        while( i < mLog->mRings.count() )
+        {
+            AccessLogRing* ring = mLog->mRings[ i ];
+
+            // Must be checked before popping, or we could miss the thread's last records
+            bool orphaned = ring->isOrphaned();
+
+            int count;
+            while( ( count = ring->pop( records, BatchSize ) ) > 0 )
+            {
+                for( int j = 0; j < count; j++ )
+                {
+                    format( records[ j ], out );
+                }
+            }
+
+            if( orphaned )
+            {
+                mLog->mRings.removeAt( i );
+                delete ring;
+                continue;
+            }
+
+            i++;
+        }
+
+        return !out.isEmpty();
+    }
+
+    static QByteArray remoteAddrText( const AccessRecord& record )
+    {
+        if( record.mRemoteIsIPv6 )
+        {
+            Q_IPV6ADDR addr;
+            memcpy( &addr, record.mRemoteAddr, 16 );
+            return QHostAddress( addr ).toString().toLatin1();
+        }
+
+        char buffer[ 16 ];
+        sprintf( buffer, "%u.%u.%u.%u", record.mRemoteAddr[ 0 ], record.mRemoteAddr[ 1 ],
+                 record.mRemoteAddr[ 2 ], record.mRemoteAddr[ 3 ] );
+        return QByteArray( buffer );
+    }
+
+    static const char* versionText( const AccessRecord& record )
+    {
+        switch( record.mVersion )
+        {
+        case 0:     return "HTTP/1.0";
+        case 1:     return "HTTP/1.1";
+        default:    return "HTTP/?";
+        }
+    }
+
+    void FileAccessLogWriter::format( const AccessRecord& record, QByteArray& out )
+    {
+        qint64 second = record.mTime / 1000;
+        if( second != mLastSecond )
+        {
+            static const char* const months[] = { "Jan", "Feb", "Mar", "Apr", "May", "Jun", "Jul",
+                                                  "Aug", "Sep", "Oct", "Nov", "Dec" };
+            char buffer[ 32 ];
+
+            QDateTime dt = QDateTime::fromMSecsSinceEpoch( second * 1000 ).toUTC();
+            QDate d = dt.date();
+            QTime t = dt.time();
+
+            sprintf( buffer, "[%.2d/%s/%.4d:%.2d:%.2d:%.2d +0000]", d.day(), months[ d.month() - 1 ],
+                     d.year(), t.hour(), t.minute(), t.second() );
+            mCommonTime = buffer;
+
+            sprintf( buffer, "%.4d-%.2d-%.2dT%.2d:%.2d:%.2d", d.year(), d.month(), d.day(),
+                     t.hour(), t.minute(), t.second() );
+            mJsonTime = buffer;
+
+            mLastSecond = second;
+        }
+
+        switch( mLog->mFormat )
+        {
+        case FileAccessLog::CommonLogFormat:    formatCommon( record, out, false );   break;
+        case FileAccessLog::CombinedLogFormat:  formatCommon( record, out, true );    break;
+        case FileAccessLog::JsonFormat:         formatJson( record, out );            break;
+        }
+    }
+
+    static void appendQuoted( QByteArray& out, const char* data, int length )
+    {
+        out += '"';
+        if( !length )
+        {
+            out += '-';
+        }
+        for( int i = 0; i < length; i++ )
+        {
+            if( data[ i ] == '"' )
+            {
+                out += '\\';
+            }
+            out += data[ i ];
+        }
+        out += '"';
+    }
+
+    void FileAccessLogWriter::formatCommon( const AccessRecord& record, QByteArray& out,
+                                            bool combined )
+    {
+        const char* method = method2text( Method( record.mMethod ) );
+
+        out += remoteAddrText( record );
+        out += " - - ";
+        out += mCommonTime;
+        out += " \"";
+        out += method ? method : "-";
+        out += ' ';
+        out.append( record.mUrl, record.mUrlLength );
+        out += ' ';
+        out += versionText( record );
+        out += "\" ";
+        out += QByteArray::number( record.mStatus );
+
+        if( record.mCompleted )
+        {
+            out += ' ';
+            out += QByteArray::number( record.mBytesOut );
+        }
+        else
+        {
+            out += " -";
+        }
+
+        if( combined )
+        {
+            out += ' ';
+            appendQuoted( out, record.mReferer, record.mRefererLength );
+            out += ' ';
+            appendQuoted( out, record.mUserAgent, record.mUserAgentLength );
+        }
+
+        out += '\n';
+    }
+
+    static void appendJsonString( QByteArray& out, const char* data, int length )
+    {
+        out += '"';
+        for( int i = 0; i < length; i++ )
+        {
+            unsigned char c = data[ i ];
+            if( c == '"' || c == '\\' )
+            {
+                out += '\\';
+                out += char( c );
+            }
+            else if( c < 0x20 )
+            {
+                char buffer[ 8 ];
+                sprintf( buffer, "\\u%.4x", c );
+                out += buffer;
+            }
+            else
+            {
+                out += char( c );
+            }
+        }
+        out += '"';
+    }
+
+    void FileAccessLogWriter::formatJson( const AccessRecord& record, QByteArray& out )
+    {
+        const char* method = method2text( Method( record.mMethod ) );
+        char millis[ 8 ];
+        sprintf( millis, ".%.3dZ", int( record.mTime % 1000 ) );
+
+        out += "{\"time\":\"";
+        out += mJsonTime;
+        out += millis;
+        out += "\",\"connection\":";
+        out += QByteArray::number( record.mConnectionId );
+        out += ",\"remote\":\"";
+        out += remoteAddrText( record );
+        out += "\",\"port\":";
+        out += QByteArray::number( record.mRemotePort );
+        out += ",\"method\":\"";
+        out += method ? method : "-";
+        out += "\",\"url\":";
+        appendJsonString( out, record.mUrl, record.mUrlLength );
+        if( record.mUrlTruncated )
+        {
+            out += ",\"truncated\":true";
+        }
+        out += ",\"version\":\"";
+        out += versionText( record );
+        out += "\",\"status\":";
+        out += QByteArray::number( record.mStatus );
+
+        if( record.mCompleted )
+        {
+            out += ",\"userAgent\":";
+            appendJsonString( out, record.mUserAgent, record.mUserAgentLength );
+            out += ",\"referer\":";
+            appendJsonString( out, record.mReferer, record.mRefererLength );
+            out += ",\"bytesIn\":";
+            out += QByteArray::number( record.mBytesIn );
+            out += ",\"bytesOut\":";
+            out += QByteArray::number( record.mBytesOut );
+            out += ",\"parseUs\":";
+            out += QByteArray::number( record.mHeaderParseTime );
+            out += ",\"handlerUs\":";
+            out += QByteArray::number( record.mHandlerTime );
+            out += ",\"firstByteUs\":";
+            out += QByteArray::number( record.mTimeToFirstByte );
+            out += ",\"totalUs\":";
+            out += QByteArray::number( record.mTotalTime );
+        }
+
+        out += "}\n";
+    }
+
+    FileAccessLogPrivate::FileAccessLogPrivate( const QString& fileName,
+                                                FileAccessLog::Format format )
+        : mFormat( format )
+        , mFile( fileName )
+        , mFlushInterval( 200 )
+        , mSyncInterval( 1000 )
+        , mDropped( 0 )
+        , mWriter( NULL )
+    {
+    }
+
+    AccessLogRing* FileAccessLogPrivate::localRing()
+    {
+        if( mLocalRing.hasLocalData() )
+        {
+            return mLocalRing.localData()->mRing;
+        }
+
+        AccessLogRing* ring = new AccessLogRing;
+        {
+            QMutexLocker l( &mRingsMutex );
+            mRings.append( ring );
+        }
+
+        mLocalRing.setLocalData( new AccessLogRingHandle( ring ) );
+        return ring;
+    }
+
+    /*
+     * The log must outlive its use by the server: Unset it with Server::setAccessLog() before
+     * destroying it.
+     */
+    FileAccessLog::FileAccessLog( const QString& fileName, Format format )
+        : d( new FileAccessLogPrivate( fileName, format ) )
+    {
+        if( d->mFile.open( QFile::WriteOnly | QFile::Append ) )
+        {
+            d->mWriter = new FileAccessLogWriter( d );
+            d->mWriter->start( QThread::LowPriority );
+        }
+    }
+
+    FileAccessLog::~FileAccessLog()
+    {
+        if( d->mWriter )
+        {
+            d->mWriter->stop();
+            d->mWriter->wait();
+            delete d->mWriter;
+        }
+
+        qDeleteAll( d->mRings );
+        delete d;
+    }
+
+    bool FileAccessLog::isOpen() const
+    {
+        return d->mWriter != NULL;
+    }
+
+    FileAccessLog::Format FileAccessLog::format() const
+    {
+        return d->mFormat;
+    }
+
+    void FileAccessLog::setFlushInterval( int msecs )
+    {
+        d->mFlushInterval = qMax( msecs, 1 );
+    }
+
+    int FileAccessLog::flushInterval() const
+    {
+        return d->mFlushInterval;
+    }
+
+    void FileAccessLog::setSyncInterval( int msecs )
+    {
+        d->mSyncInterval = qMax( msecs, 0 );
+    }
+
+    int FileAccessLog::syncInterval() const
+    {
+        return d->mSyncInterval;
+    }
+
+    quint64 FileAccessLog::droppedRecords() const
+    {
+        return uint( int( d->mDropped ) );
+    }
+
+    static int copyText( char* dest, int max, const QByteArray& text )
+    {
+        int length = qMin( text.count(), max );
+        memcpy( dest, text.constData(), length );
+        return length;
+    }
+
+    /*
+     * Fills in what both kinds of records have in common. Returns NULL if the ring is full.
+     */
+    AccessRecord* FileAccessLogPrivate::beginRecord( AccessLogRing*& ring, int connectionId,
+                                                     Version version, Method method,
+                                                     const QHostAddress& remoteAddr,
+                                                     quint16 remotePort, StatusCode status )
+    {
+        if( !mWriter )
+        {
+            return NULL;
+        }
+
+        ring = localRing();
+        AccessRecord* r = ring->beginPush();
+        if( !r )
+        {
+            mDropped.ref();
+            return NULL;
+        }
+
+        r->mTime = QDateTime::currentMSecsSinceEpoch();
+        r->mConnectionId = connectionId;
+        r->mStatus = qint16( status );
+        r->mVersion = version == V_1_0 ? 0 : version == V_1_1 ? 1 : -1;
+        r->mMethod = qint8( method );
+        r->mRemotePort = remotePort;
+        r->mCompleted = 0;
+
+        if( remoteAddr.protocol() == QAbstractSocket::IPv6Protocol )
+        {
+            Q_IPV6ADDR addr = remoteAddr.toIPv6Address();
+            memcpy( r->mRemoteAddr, &addr, 16 );
+            r->mRemoteIsIPv6 = 1;
+        }
+        else
+        {
+            quint32 addr = remoteAddr.toIPv4Address();
+            r->mRemoteAddr[ 0 ] = quint8( addr >> 24 );
+            r->mRemoteAddr[ 1 ] = quint8( addr >> 16 );
+            r->mRemoteAddr[ 2 ] = quint8( addr >> 8 );
+            r->mRemoteAddr[ 3 ] = quint8( addr );
+            r->mRemoteIsIPv6 = 0;
+        }
+
+        return r;
+    }
+
+    void FileAccessLog::access( int connectionId, Version version, Method method, const QUrl& url,
+                                const QHostAddress& remoteAddr, quint16 remotePort,
+                                StatusCode response )
+    {
+        AccessLogRing* ring = NULL;
+        AccessRecord* r = d->beginRecord( ring, connectionId, version, method, remoteAddr,
+                                          remotePort, response );
+        if( !r )
+        {
+            return;
+        }
+
+        QByteArray u = url.toEncoded();
+        r->mUrlLength = quint16( copyText( r->mUrl, AccessRecord::MaxUrlLength, u ) );
+        r->mUrlTruncated = r->mUrlLength < u.count();
+
+        ring->endPush();
+    }
+
+    void FileAccessLog::requestCompleted( const RequestRecord& record )
+    {
+        AccessLogRing* ring = NULL;
+        AccessRecord* r = d->beginRecord( ring, record.mConnectionId, record.mVersion,
+                                          record.mMethod, record.mRemoteAddr, record.mRemotePort,
+                                          record.mStatus );
+        if( !r )
+        {
+            return;
+        }
+
+        r->mUrlLength = quint16( copyText( r->mUrl, AccessRecord::MaxUrlLength, record.mUrl ) );
+        r->mUrlTruncated = r->mUrlLength < record.mUrl.count();
+
+        r->mCompleted = 1;
+        r->mUserAgentLength = quint8( copyText( r->mUserAgent, AccessRecord::MaxHeaderLength,
+                                                record.mUserAgent ) );
+        r->mRefererLength = quint8( copyText( r->mReferer, AccessRecord::MaxHeaderLength,
+                                              record.mReferer ) );
+        r->mBytesIn = record.mBytesIn;
+        r->mBytesOut = record.mBytesOut;
+        r->mHeaderParseTime = record.mHeaderParseTime;
+        r->mHandlerTime = record.mHandlerTime;
+        r->mTimeToFirstByte = record.mTimeToFirstByte;
+        r->mTotalTime = record.mTotalTime;
+
+        ring->endPush();
+    }
+
+}
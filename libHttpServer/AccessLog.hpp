@@ -0,0 +1,76 @@
+/*
+ * Modern CI
+ * Copyright (C) 2012-2013 Sascha Cunz <sascha@babbelbox.org>
+ *
+ * This program is free software; you can redistribute it and/or modify it under the terms of the
+ * GNU General Public License (Version 2) as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without
+ * even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this program; if
+ * not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef HTTP_ACCESS_LOG_HPP
+#define HTTP_ACCESS_LOG_HPP
+
+#include "libHttpServer/Server.hpp"
+
+namespace HTTP
+{
+
+    class FileAccessLogPrivate;
+
+    /*
+     * Access log that keeps the request path cheap: access() only copies a compact, fixed size
+     * record into a ring buffer owned by the calling thread. A background thread collects the
+     * records from all rings, formats them and appends them to the file in batches.
+     *
+     * If a ring is full (the writer cannot keep up), records are dropped rather than blocking the
+     * worker thread; droppedRecords() tells how many.
+     *
+     * It can be installed either as access log or as request log (Server::setRequestLog()). Only
+     * in the latter case the response size, the Referer / User-Agent for the combined format and
+     * the timings (JSON only) are known. Installing it as both logs each request twice.
+     */
+    class HTTP_SERVER_API FileAccessLog : public IAccessLog, public IRequestLog
+    {
+    public:
+        enum Format
+        {
+            CommonLogFormat,
+            CombinedLogFormat,
+            JsonFormat
+        };
+
+    public:
+        FileAccessLog( const QString& fileName, Format format = CommonLogFormat );
+        ~FileAccessLog();
+
+    public:
+        bool isOpen() const;
+        Format format() const;
+
+        void setFlushInterval( int msecs );
+        int flushInterval() const;
+        void setSyncInterval( int msecs );
+        int syncInterval() const;
+
+        quint64 droppedRecords() const;
+
+    public:
+        void access( int connectionId, Version version, Method method, const QUrl& url,
+                     const QHostAddress& remoteAddr, quint16 remotePort, StatusCode response );
+
+        void requestCompleted( const RequestRecord& record );
+
+    private:
+        FileAccessLogPrivate* d;
+    };
+
+}
+
+#endif
@@ -0,0 +1,274 @@
+/*
+ * Modern CI
+ * Copyright (C) 2012-2013 Sascha Cunz <sascha@babbelbox.org>
+ *
+ * This program is free software; you can redistribute it and/or modify it under the terms of the
+ * GNU General Public License (Version 2) as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without
+ * even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this program; if
+ * not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <QThreadPool>
+#include <QThreadStorage>
+#include <QTimerEvent>
+
+#include "libHttpServer/AsyncWait.hpp"
+
+#include "libHttpServer/Internal/AsyncWait.hpp"
+#include "libHttpServer/Internal/StaticFile.hpp"
+
+namespace HTTP
+{
+
+    AsyncWait::AsyncWait( Callback callback, void* context, QObject* guard )
+        : mCallback( callback )
+        , mContext( context )
+        , mGuard( guard )
+        , mNotifier( NULL )
+        , mPrev( NULL )
+        , mNext( NULL )
+        , mSerial( 0 )
+        , mSender( NULL )
+        , mTimerId( 0 )
+        , mFileRead( false )
+    {
+    }
+
+    AsyncWait::~AsyncWait()
+    {
+        if( mNotifier )
+        {
+            mNotifier->remove( this );
+        }
+    }
+
+    void AsyncWait::start()
+    {
+        Q_ASSERT( !mNotifier );
+        AsyncWaitNotifier::local( true )->add( this );
+    }
+
+    void AsyncWait::waitForSignal( QObject* sender, const char* signal )
+    {
+        start();
+        mSender = sender;
+        mNotifier->watch( sender, signal );
+    }
+
+    void AsyncWait::waitForTimeout( int msecs )
+    {
+        start();
+        mTimerId = mNotifier->startTimer( msecs );
+    }
+
+    /*
+     * Reads the whole file on the global thread pool, so the caller's thread never blocks on the
+     * file system.
+     */
+    void AsyncWait::readFile( const QString& fileName )
+    {
+        start();
+
+        StaticFileQuery query;
+        query.mFileName = fileName;
+
+        StaticFileJob* job = new StaticFileJob( query );
+        mSender = job;
+        QObject::connect( job, SIGNAL(finished()), mNotifier, SLOT(fileLoaded()),
+                          Qt::QueuedConnection );
+        QThreadPool::globalInstance()->start( job );
+    }
+
+    bool AsyncWait::fileRead() const
+    {
+        return mFileRead;
+    }
+
+    QByteArray AsyncWait::fileData() const
+    {
+        return mFileData;
+    }
+
+    /*
+     * Ends the waits guarded by `guard` as if it was deleted. For objects that are reused instead,
+     * such as pooled requests.
+     */
+    void AsyncWait::cancel( QObject* guard )
+    {
+        AsyncWaitNotifier* notifier = AsyncWaitNotifier::local( false );
+        if( notifier )
+        {
+            notifier->cancel( guard );
+        }
+    }
+
+    /*
+     * The notifier has taken us off its list already, so the callback may delete us.
+     */
+    void AsyncWait::fire( bool cancelled )
+    {
+        mCallback( mContext, cancelled );
+    }
+
+    AsyncWaitNotifier::AsyncWaitNotifier()
+        : mFirst( NULL )
+        , mSerial( 0 )
+    {
+    }
+
+    AsyncWaitNotifier::~AsyncWaitNotifier()
+    {
+        while( mFirst )
+        {
+            AsyncWait* wait = mFirst;
+            remove( wait );
+            wait->fire( true );
+        }
+    }
+
+    AsyncWaitNotifier* AsyncWaitNotifier::local( bool create )
+    {
+        static QThreadStorage< AsyncWaitNotifier* > sNotifiers;
+
+        if( !sNotifiers.hasLocalData() )
+        {
+            if( !create )
+            {
+                return NULL;
+            }
+            sNotifiers.setLocalData( new AsyncWaitNotifier );
+        }
+
+        return sNotifiers.localData();
+    }
+
+    void AsyncWaitNotifier::add( AsyncWait* wait )
+    {
+        wait->mNotifier = this;
+        wait->mSerial = mSerial;
+        wait->mPrev = NULL;
+        wait->mNext = mFirst;
+        if( mFirst )
+        {
+            mFirst->mPrev = wait;
+        }
+        mFirst = wait;
+
+        if( wait->mGuard )
+        {
+            connect( wait->mGuard, SIGNAL(destroyed(QObject*)),
+                     this, SLOT(guardDestroyed(QObject*)), Qt::UniqueConnection );
+        }
+    }
+
+    void AsyncWaitNotifier::remove( AsyncWait* wait )
+    {
+        if( wait->mPrev )
+        {
+            wait->mPrev->mNext = wait->mNext;
+        }
+        else
+        {
+            mFirst = wait->mNext;
+        }
+
+        if( wait->mNext )
+        {
+            wait->mNext->mPrev = wait->mPrev;
+        }
+
+        if( wait->mTimerId )
+        {
+            killTimer( wait->mTimerId );
+            wait->mTimerId = 0;
+        }
+
+        wait->mNotifier = NULL;
+        wait->mPrev = wait->mNext = NULL;
+    }
+
+    void AsyncWaitNotifier::watch( QObject* sender, const char* signal )
+    {
+        connect( sender, signal, this, SLOT(signalled()), Qt::UniqueConnection );
+    }
+
+    void AsyncWaitNotifier::cancel( QObject* guard )
+    {
+        notify( ByGuard, guard, 0 );
+    }
+
+    /*
+     * Fires the waits that match. Each callback may start or end any other wait, so we start over
+     * after each one; the serial keeps waits started meanwhile from seeing this notification.
+     */
+    bool AsyncWaitNotifier::notify( Match match, QObject* object, int timerId )
+    {
+        quint32 serial = ++mSerial;
+        bool fired = false;
+
+        AsyncWait* wait = mFirst;
+        while( wait )
+        {
+            bool matches = wait->mSerial != serial &&
+                           ( match == ByGuard ? wait->mGuard == object
+                           : match == ByTimer ? wait->mTimerId == timerId
+                           : wait->mSender == object );
+            if( !matches )
+            {
+                wait = wait->mNext;
+                continue;
+            }
+
+            remove( wait );
+            wait->fire( match == ByGuard );
+            fired = true;
+            wait = mFirst;
+        }
+
+        return fired;
+    }
+
+    void AsyncWaitNotifier::timerEvent( QTimerEvent* event )
+    {
+        if( !notify( ByTimer, NULL, event->timerId() ) )
+        {
+            killTimer( event->timerId() );
+        }
+    }
+
+    void AsyncWaitNotifier::signalled()
+    {
+        notify( BySender, sender(), 0 );
+    }
+
+    void AsyncWaitNotifier::fileLoaded()
+    {
+        StaticFileJob* job = qobject_cast< StaticFileJob* >( sender() );
+        Q_ASSERT( job );
+
+        // The wait may be gone, along with its request
+        for( AsyncWait* wait = mFirst; wait; wait = wait->mNext )
+        {
+            if( wait->mSender == job )
+            {
+                StaticFileResult result = job->result();
+                wait->mFileRead = result.mStatus == Ok;
+                wait->mFileData = result.mData;
+                notify( BySender, job, 0 );
+                return;
+            }
+        }
+    }
+
+    void AsyncWaitNotifier::guardDestroyed( QObject* guard )
+    {
+        notify( ByGuard, guard, 0 );
+    }
+
+}
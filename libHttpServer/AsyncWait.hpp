@@ -0,0 +1,86 @@
+/*
+ * Modern CI
+ * Copyright (C) 2012-2013 Sascha Cunz <sascha@babbelbox.org>
+ *
+ * This program is free software; you can redistribute it and/or modify it under the terms of the
+ * GNU General Public License (Version 2) as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without
+ * even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this program; if
+ * not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef HTTP_ASYNC_WAIT_HPP
+#define HTTP_ASYNC_WAIT_HPP
+
+#include <QObject>
+#include <QByteArray>
+
+#include "libHttpServer/Http.hpp"
+
+namespace HTTP
+{
+
+    class AsyncWaitNotifier;
+
+    /*
+     * Calls a plain function once, from the event loop of the thread it is used in, when a signal
+     * arrives, a timeout expires or a file was read on an I/O thread. Should its guard be deleted
+     * (or its request recycled, see cancel()) before that, the function is called with cancelled
+     * set instead.
+     *
+     * It is no QObject and allocates nothing itself: all waits of a thread are served by one
+     * notifier there, so it can be embedded where the waiting state lives anyway (such as an
+     * awaiter in a coroutine frame). Deleting a pending wait just drops it. It cannot be copied.
+     *
+     * This is what the coroutine handlers in Coroutine.hpp resume on, but nothing about it is
+     * specific to coroutines.
+     */
+    class HTTP_SERVER_API AsyncWait
+    {
+    public:
+        typedef void (*Callback)( void* context, bool cancelled );
+
+        AsyncWait( Callback callback, void* context, QObject* guard );
+        ~AsyncWait();
+
+    public:
+        // Waits are told apart by sender only, so there should be one signal per sender
+        void waitForSignal( QObject* sender, const char* signal );
+        void waitForTimeout( int msecs );
+        void readFile( const QString& fileName );
+
+        bool fileRead() const;
+        QByteArray fileData() const;
+
+        static void cancel( QObject* guard );
+
+    private:
+        friend class AsyncWaitNotifier;
+        void start();
+        void fire( bool cancelled );
+
+    private:
+        Callback            mCallback;
+        void*               mContext;
+        QObject*            mGuard;
+        AsyncWaitNotifier*  mNotifier;  // While pending
+        AsyncWait*          mPrev;      // In mNotifier's list
+        AsyncWait*          mNext;
+        quint32             mSerial;    // When it was started, see AsyncWaitNotifier::notify()
+        QObject*            mSender;    // Or the file job
+        int                 mTimerId;
+        bool                mFileRead;
+        QByteArray          mFileData;
+
+    private:
+        Q_DISABLE_COPY( AsyncWait )
+    };
+
+}
+
+#endif
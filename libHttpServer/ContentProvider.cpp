@@ -14,23 +14,42 @@
  *
  */
 
+#include <limits.h>
+
 #include <QRegExp>
-#include <QFile>
-#include <QFileInfo>
 #include <QString>
 #include <QStringBuilder>
 #include <QUrl>
+#include <QThreadPool>
 
 #include "libHttpServer/ContentProvider.hpp"
 #include "libHttpServer/Request.hpp"
 #include "libHttpServer/Response.hpp"
 
+#include "libHttpServer/Internal/StaticFile.hpp"
+
 namespace HTTP
 {
 
     ContentProvider::ContentProvider( QObject* parent )
         : QObject( parent )
+        , mBandwidthLimit( new QAtomicInt( 0 ) )
+    {
+    }
+
+    /*
+     * Caps the rate at which each single response of this provider is sent. Can be changed at
+     * any time from any thread; at most 2 GB/s can be expressed.
+     */
+    void ContentProvider::setBandwidthLimit( qint64 bytesPerSecond )
+    {
+        mBandwidthLimit->fetchAndStoreRelaxed( int( qBound( Q_INT64_C( 0 ), bytesPerSecond,
+                                                           qint64( INT_MAX ) ) ) );
+    }
+
+    qint64 ContentProvider::bandwidthLimit() const
     {
+        return int( *mBandwidthLimit );
     }
 
     StaticContentProvider::StaticContentProvider( const QString& prefix, const QString& basePath,
@@ -38,7 +57,11 @@ namespace HTTP
         : ContentProvider( parent )
         , mPrefix( prefix )
         , mBasePath( basePath )
+        , mMapThreshold( 64 * 1024 )
+        , mIoPool( NULL )
     {
+        setIoThreads( 4 );
+
         addMimeType( QRegExp( QLatin1String( "*.css" ), Qt::CaseInsensitive, QRegExp::Wildcard ),
                      "text/css" );
         addMimeType( QRegExp( QLatin1String( "*.js" ),  Qt::CaseInsensitive, QRegExp::Wildcard ),
@@ -52,42 +75,74 @@ namespace HTTP
 
     void StaticContentProvider::newRequest( Request* request )
     {
-        Response* res = request->response();
         QString path = request->url().path();
-        QString fn( mBasePath % path );
-        QFileInfo fi( fn );
 
-        if( !fi.exists() )
+        StaticFileQuery query;
+        query.mFileName = mBasePath % path;
+        query.mIfNoneMatch = request->header( "If-None-Match" );
+        query.mIfModifiedSince = request->header( "If-Modified-Since" );
+        query.mMapThreshold = mMapThreshold;
+
+        if( !mIoPool )
         {
-            res->fixBody();
-            res->send( HTTP::NotFound );
+            respond( request, path, loadStaticFile( query ) );
             return;
         }
 
-        if( request->hasHeader( "If-Modified-Since" ) )
-        {
-            QDateTime dt = HTTP::fromRfc1123date( request->header( "If-Modified-Since" ) );
+        StaticFileReply* reply = new StaticFileReply( this, request, path );
+        StaticFileJob* job = new StaticFileJob( query );
+        connect( job, SIGNAL(finished()), reply, SLOT(loaded()), Qt::QueuedConnection );
+        mIoPool->start( job );
+    }
 
-            if( fi.lastModified() <= dt )
-            {
-                res->fixBody();
-                res->send( HTTP::NotModified );
-                return;
-            }
-        }
+    void StaticContentProvider::respond( Request* request, const QString& path,
+                                         const StaticFileResult& result )
+    {
+        Response* res = request->response();
 
-        QFile f( fn );
-        if( !f.open( QFile::ReadOnly ) )
+        if( result.mStatus != HTTP::Ok )
         {
+            if( !result.mETag.isEmpty() )
+            {
+                res->addHeader( "ETag", result.mETag );
+            }
             res->fixBody();
-            res->send( HTTP::NotFound );
+            res->send( result.mStatus );
             return;
         }
 
-        QByteArray a = f.readAll();
-        res->addBody( a );
+        if( result.mMapping )
+        {
+            res->addMappedBody( result.mMapping );
+        }
+        else
+        {
+            res->addBody( result.mData );
+        }
         res->fixBody();
 
+        res->addHeader( "Content-Type", mimeType( path ) );
+        res->addHeader( "Cache-Control", "max-age=1200" );
+        res->addHeader( "Expires", QDateTime::currentDateTimeUtc().addSecs( 1200 ) );
+        res->addHeader( "Last-Modified", result.mLastModified );
+        res->addHeader( "ETag", result.mETag );
+
+        res->send( HTTP::Ok );
+    }
+
+    void StaticContentProvider::addMimeType( const QRegExp& regEx, const QByteArray& mimeType )
+    {
+        MimeTypeInfo mti;
+        mti.mRegEx = regEx;
+        mti.mMimeType = mimeType;
+        mMimeTypes.append( mti );
+    }
+
+    /*
+     * The last matching pattern wins, so later addMimeType() calls can override earlier ones.
+     */
+    QByteArray StaticContentProvider::mimeType( const QString& path ) const
+    {
         QByteArray mimeType = "text/plain";
 
         MimeTypes::ConstIterator it = mMimeTypes.constBegin();
@@ -98,21 +153,38 @@ namespace HTTP
             ++it;
         }
 
-        res->addHeader( "Content-Type", mimeType );
-        res->addHeader( "Cache-Control", "max-age=1200" );
-        res->addHeader( "Expires", QDateTime::currentDateTimeUtc().addSecs( 1200 ) );
-        res->addHeader( "Last-Modified", fi.lastModified() );
+        return mimeType;
+    }
 
-        res->send( HTTP::Ok );
-        return;
+    void StaticContentProvider::setMapThreshold( qint64 bytes )
+    {
+        mMapThreshold = bytes;
     }
 
-    void StaticContentProvider::addMimeType( const QRegExp& regEx, const QByteArray& mimeType )
+    qint64 StaticContentProvider::mapThreshold() const
     {
-        MimeTypeInfo mti;
-        mti.mRegEx = regEx;
-        mti.mMimeType = mimeType;
-        mMimeTypes.append( mti );
+        return mMapThreshold;
+    }
+
+    void StaticContentProvider::setIoThreads( int count )
+    {
+        if( count <= 0 )
+        {
+            delete mIoPool;
+            mIoPool = NULL;
+            return;
+        }
+
+        if( !mIoPool )
+        {
+            mIoPool = new QThreadPool( this );
+        }
+        mIoPool->setMaxThreadCount( count );
+    }
+
+    int StaticContentProvider::ioThreads() const
+    {
+        return mIoPool ? mIoPool->maxThreadCount() : 0;
     }
 
 }
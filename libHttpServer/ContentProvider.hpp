@@ -18,12 +18,18 @@
 #define HTTP_CONTENT_PROVIDER_HPP
 
 #include <QRegExp>
+#include <QAtomicInt>
+#include <QSharedPointer>
 
 #include "libHttpServer/Request.hpp"
 
+class QThreadPool;
+
 namespace HTTP
 {
 
+    class StaticFileResult;
+
     class HTTP_SERVER_API ContentProvider : public QObject
     {
         Q_OBJECT
@@ -33,6 +39,15 @@ namespace HTTP
     public:
         virtual bool canHandle( const QUrl& url ) const = 0;
         virtual void newRequest( Request* request ) = 0;
+
+    public:
+        void setBandwidthLimit( qint64 bytesPerSecond );
+        qint64 bandwidthLimit() const;
+
+    private:
+        friend class Request;
+        // Bytes per second; 0 = unlimited. Shared with our responses, which may outlive us.
+        QSharedPointer< QAtomicInt > mBandwidthLimit;
     };
 
     class HTTP_SERVER_API StaticContentProvider : public ContentProvider
@@ -46,6 +61,17 @@ namespace HTTP
 
     public:
         void addMimeType( const QRegExp& regEx, const QByteArray& mimeType );
+        QByteArray mimeType( const QString& path ) const;
+
+        void setMapThreshold( qint64 bytes );
+        qint64 mapThreshold() const;
+
+        void setIoThreads( int count );
+        int ioThreads() const;
+
+    private:
+        friend class StaticFileReply;
+        void respond( Request* request, const QString& path, const StaticFileResult& result );
 
     private:
         struct MimeTypeInfo
@@ -58,6 +84,10 @@ namespace HTTP
         QString     mPrefix;
         QString     mBasePath;
         MimeTypes   mMimeTypes;
+        qint64      mMapThreshold;  // Files at least this large are served from a shared
+                                    // mapping; 0 = always read into memory
+        QThreadPool* mIoPool;       // File system access happens here; NULL = on the caller's
+                                    // thread
     };
 
 }
@@ -0,0 +1,250 @@
+/*
+ * Modern CI
+ * Copyright (C) 2012-2013 Sascha Cunz <sascha@babbelbox.org>
+ *
+ * This program is free software; you can redistribute it and/or modify it under the terms of the
+ * GNU General Public License (Version 2) as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without
+ * even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this program; if
+ * not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef HTTP_COROUTINE_HPP
+#define HTTP_COROUTINE_HPP
+
+/*
+ * Coroutine handlers for compilers with C++20 coroutines. The library itself does not need them:
+ * everything here is inline and resumes through AsyncWait, so only code that includes this header
+ * has to be built as C++20. A suspension allocates nothing: the wait is part of the awaiter, which
+ * lives in the coroutine frame.
+ *
+ *  class Greeter : public HTTP::CoroutineContentProvider
+ *  {
+ *      HTTP::Task<> handle( HTTP::Request& request, HTTP::Response& response )
+ *      {
+ *          co_await HTTP::bodyReceived( request );
+ *          HTTP::FileContent file = co_await HTTP::readFile( request, fileName );
+ *          co_await HTTP::sleep( request, 100 );
+ *          ...
+ *          response.finish( HTTP::Ok );
+ *      }
+ *  };
+ *
+ * The coroutine starts on the connection's thread and is always resumed there, from its event
+ * loop. If the connection is lost while it is suspended, it is destroyed instead of resumed, along
+ * with a response it did not send yet.
+ */
+
+#if defined( __cpp_impl_coroutine ) && __cpp_impl_coroutine >= 201902L
+
+#include <coroutine>
+#include <exception>
+
+#include "libHttpServer/Request.hpp"
+#include "libHttpServer/Response.hpp"
+#include "libHttpServer/ContentProvider.hpp"
+#include "libHttpServer/AsyncWait.hpp"
+
+namespace HTTP
+{
+
+    template< typename T = void >
+    class Task;
+
+    /*
+     * What a coroutine handler returns. It runs on its own once started and the frame frees itself
+     * when it is done, so there is nothing to await or to keep.
+     */
+    template<>
+    class Task< void >
+    {
+    public:
+        class promise_type
+        {
+        public:
+            Task get_return_object() { return Task(); }
+            std::suspend_never initial_suspend() noexcept { return std::suspend_never(); }
+            std::suspend_never final_suspend() noexcept { return std::suspend_never(); }
+            void return_void() {}
+            void unhandled_exception() { std::terminate(); }
+        };
+    };
+
+    /*
+     * Common part of the awaitables: a suspended coroutine waits on an AsyncWait that is guarded
+     * by the request, so it cannot outlive it. Awaiters are neither copied nor moved; co_await
+     * keeps the one it is given in the frame.
+     */
+    class AsyncAwaiter
+    {
+    protected:
+        AsyncAwaiter( Request& request )
+            : mRequest( request )
+            , mWait( &AsyncAwaiter::wakeUp, this, &request )
+            , mUnsent( NULL )
+        {
+        }
+
+        // While we are suspended, nobody but us sends the response
+        AsyncWait& suspend( std::coroutine_handle<> handle )
+        {
+            Response* response = mRequest.response();
+            mHandle = handle;
+            mUnsent = response->isSent() ? NULL : response;
+            return mWait;
+        }
+
+    private:
+        static void wakeUp( void* context, bool cancelled )
+        {
+            AsyncAwaiter* that = static_cast< AsyncAwaiter* >( context );
+
+            if( !cancelled )
+            {
+                that->mHandle.resume();
+                return;
+            }
+
+            // Nobody is left to send the response; the frame (and we with it) is gone afterwards.
+            // A sent one belongs to the request (or its pool) already.
+            Response* unsent = that->mUnsent;
+            that->mHandle.destroy();
+            delete unsent;
+        }
+
+    protected:
+        Request&                mRequest;
+        AsyncWait               mWait;
+
+    private:
+        std::coroutine_handle<> mHandle;
+        Response*               mUnsent;        // Ours to delete if we are cancelled
+    };
+
+    class BodyReceivedAwaiter : public AsyncAwaiter
+    {
+    public:
+        BodyReceivedAwaiter( Request& request ) : AsyncAwaiter( request ) {}
+
+        bool await_ready() const { return mRequest.state() == Request::Finished; }
+        void await_resume() const {}
+
+        void await_suspend( std::coroutine_handle<> handle )
+        {
+            suspend( handle ).waitForSignal( &mRequest, SIGNAL(completed(HTTP::Request*)) );
+        }
+    };
+
+    class WritableAwaiter : public AsyncAwaiter
+    {
+    public:
+        WritableAwaiter( Request& request ) : AsyncAwaiter( request ) {}
+
+        bool await_ready() const { return mRequest.response()->isWritable(); }
+        void await_resume() const {}
+
+        void await_suspend( std::coroutine_handle<> handle )
+        {
+            Response* response = mRequest.response();
+            suspend( handle ).waitForSignal( response, SIGNAL(writable(HTTP::Response*)) );
+        }
+    };
+
+    class SleepAwaiter : public AsyncAwaiter
+    {
+    public:
+        SleepAwaiter( Request& request, int msecs ) : AsyncAwaiter( request ), mMSecs( msecs ) {}
+
+        bool await_ready() const { return false; }
+        void await_resume() const {}
+
+        void await_suspend( std::coroutine_handle<> handle )
+        {
+            suspend( handle ).waitForTimeout( mMSecs );
+        }
+
+    private:
+        int mMSecs;
+    };
+
+    struct FileContent
+    {
+        bool        mOk;
+        QByteArray  mData;
+    };
+
+    class ReadFileAwaiter : public AsyncAwaiter
+    {
+    public:
+        ReadFileAwaiter( Request& request, const QString& fileName )
+            : AsyncAwaiter( request ), mFileName( fileName ) {}
+
+        bool await_ready() const { return false; }
+
+        void await_suspend( std::coroutine_handle<> handle )
+        {
+            suspend( handle ).readFile( mFileName );
+        }
+
+        FileContent await_resume() const
+        {
+            FileContent content;
+            content.mOk = mWait.fileRead();
+            content.mData = mWait.fileData();
+            return content;
+        }
+
+    private:
+        QString mFileName;
+    };
+
+    // Until the request's body was received completely
+    inline BodyReceivedAwaiter bodyReceived( Request& request )
+    {
+        return BodyReceivedAwaiter( request );
+    }
+
+    // Until a streamed response may take more data (see Response::isWritable())
+    inline WritableAwaiter writable( Request& request )
+    {
+        return WritableAwaiter( request );
+    }
+
+    // Reads a whole file on the I/O thread pool
+    inline ReadFileAwaiter readFile( Request& request, const QString& fileName )
+    {
+        return ReadFileAwaiter( request, fileName );
+    }
+
+    inline SleepAwaiter sleep( Request& request, int msecs )
+    {
+        return SleepAwaiter( request, msecs );
+    }
+
+    /*
+     * A ContentProvider whose requests are handled by a coroutine.
+     */
+    class CoroutineContentProvider : public ContentProvider
+    {
+    public:
+        CoroutineContentProvider( QObject* parent ) : ContentProvider( parent ) {}
+
+    public:
+        virtual Task<> handle( Request& request, Response& response ) = 0;
+
+        void newRequest( Request* request )
+        {
+            handle( *request, *request->response() );
+        }
+    };
+
+}
+
+#endif
+
+#endif
@@ -0,0 +1,358 @@
+/*
+ * Modern CI
+ * Copyright (C) 2012-2013 Sascha Cunz <sascha@babbelbox.org>
+ *
+ * This program is free software; you can redistribute it and/or modify it under the terms of the
+ * GNU General Public License (Version 2) as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without
+ * even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this program; if
+ * not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <QCoreApplication>
+#include <QThread>
+#include <QTimer>
+#include <QUrl>
+
+#include "libHttpServer/EventStream.hpp"
+#include "libHttpServer/Request.hpp"
+#include "libHttpServer/Response.hpp"
+
+#include "libHttpServer/Internal/Http.hpp"
+#include "libHttpServer/Internal/Connection.hpp"
+#include "libHttpServer/Internal/EventStream.hpp"
+
+namespace HTTP
+{
+
+    /*
+     * One chunk of chunked encoding, built once for all subscribers.
+     */
+    static QByteArray frameChunk( const QByteArray& text )
+    {
+        QByteArray size = QByteArray::number( text.size(), 16 );
+
+        QByteArray chunk;
+        chunk.reserve( size.size() + text.size() + 4 );
+        chunk.append( size );
+        chunk.append( CRLF );
+        chunk.append( text );
+        chunk.append( CRLF );
+        return chunk;
+    }
+
+    EventStreamEvent::EventStreamEvent( const QByteArray& text, const QByteArray& chunk,
+                                        bool heartbeat )
+        : QEvent( type() )
+        , mText( text )
+        , mChunk( chunk )
+        , mHeartbeat( heartbeat )
+    {
+    }
+
+    QEvent::Type EventStreamEvent::type()
+    {
+        static int sType = QEvent::registerEventType();
+        return QEvent::Type( sType );
+    }
+
+    EventStreamBucket::EventStreamBucket()
+        : mCount( 0 )
+    {
+    }
+
+    /*
+     * The provider is gone: end all streams properly.
+     */
+    EventStreamBucket::~EventStreamBucket()
+    {
+        while( !mSubscribers.isEmpty() )
+        {
+            end( mSubscribers.count() - 1, false );
+        }
+    }
+
+    void EventStreamBucket::subscribe( Request* request, Response* response )
+    {
+        Subscriber s;
+        s.mRequest = request;
+        s.mConnection = qobject_cast< Connection* >( request->parent() );
+        s.mResponse = response;
+        s.mIdle = false;
+        mSubscribers.append( s );
+        mCount.ref();
+
+        // The request goes with its connection; the response stays with us until it is sent
+        connect( request, SIGNAL(destroyed(QObject*)), this, SLOT(requestDestroyed(QObject*)) );
+
+        if( s.mConnection )
+        {
+            if( s.mConnection->isDraining() )
+            {
+                end( mSubscribers.count() - 1, false );
+                return;
+            }
+
+            connect( s.mConnection, SIGNAL(draining()), this, SLOT(connectionDraining()) );
+        }
+    }
+
+    void EventStreamBucket::customEvent( QEvent* event )
+    {
+        if( event->type() == EventStreamEvent::type() )
+        {
+            deliver( static_cast< EventStreamEvent* >( event ) );
+        }
+    }
+
+    void EventStreamBucket::deliver( const EventStreamEvent* event )
+    {
+        int i = 0;
+        while( i < mSubscribers.count() )
+        {
+            Subscriber& s = mSubscribers[ i ];
+
+            if( event->mHeartbeat && !s.mIdle )
+            {
+                s.mIdle = true;
+                i++;
+                continue;
+            }
+
+            // A subscriber that does not keep up would buffer every event until TCP gives up on
+            // it; end its stream instead, its client can reconnect.
+            if( !s.mResponse->isWritable() ||
+                !s.mResponse->writeShared( event->mText, event->mChunk ) )
+            {
+                end( i, false );
+                continue;
+            }
+
+            s.mIdle = event->mHeartbeat;
+            i++;
+        }
+    }
+
+    void EventStreamBucket::requestDestroyed( QObject* request )
+    {
+        for( int i = 0; i < mSubscribers.count(); i++ )
+        {
+            if( mSubscribers[ i ].mRequest == request )
+            {
+                end( i, true );
+                return;
+            }
+        }
+    }
+
+    void EventStreamBucket::connectionDraining()
+    {
+        int i = 0;
+        while( i < mSubscribers.count() )
+        {
+            if( mSubscribers[ i ].mConnection == sender() )
+            {
+                end( i, false );
+                continue;
+            }
+            i++;
+        }
+    }
+
+    /*
+     * Sending the response ends the stream; if the connection is gone, the response just
+     * deletes itself.
+     */
+    void EventStreamBucket::end( int index, bool requestGone )
+    {
+        Subscriber s = mSubscribers[ index ];
+        mSubscribers.remove( index );
+        mCount.deref();
+
+        if( !requestGone )
+        {
+            disconnect( s.mRequest, SIGNAL(destroyed(QObject*)),
+                        this, SLOT(requestDestroyed(QObject*)) );
+            if( s.mConnection )
+            {
+                disconnect( s.mConnection, SIGNAL(draining()), this, SLOT(connectionDraining()) );
+            }
+        }
+
+        s.mResponse->send();
+    }
+
+    EventStreamProvider::EventStreamProvider( const QString& prefix, QObject* parent )
+        : ContentProvider( parent )
+        , mPrefix( prefix )
+        , mHeartbeat( new QTimer( this ) )
+        , mHeartbeatText( ":\n\n" )
+    {
+        mHeartbeatChunk = frameChunk( mHeartbeatText );
+
+        connect( mHeartbeat, SIGNAL(timeout()), this, SLOT(heartbeat()) );
+        mHeartbeat->start( 15000 );
+    }
+
+    /*
+     * The buckets live in the worker threads, so they are deleted there.
+     */
+    EventStreamProvider::~EventStreamProvider()
+    {
+        QMutexLocker l( &mBucketsMutex );
+        foreach( EventStreamBucket* bucket, mBuckets )
+        {
+            bucket->deleteLater();
+        }
+        mBuckets.clear();
+    }
+
+    bool EventStreamProvider::canHandle( const QUrl& url ) const
+    {
+        return url.path().startsWith( mPrefix );
+    }
+
+    /*
+     * Called on the connection's worker thread, which is where the subscriber's bucket must live.
+     */
+    void EventStreamProvider::newRequest( Request* request )
+    {
+        Response* response = request->response();
+        response->addHeader( "Content-Type", "text/event-stream" );
+        response->addHeader( "Cache-Control", "no-cache" );
+        response->setStreaming();
+        response->sendHeaders( Ok );
+
+        EventStreamBucket* bucket;
+        {
+            QMutexLocker l( &mBucketsMutex );
+            bucket = mBuckets.value( QThread::currentThread() );
+            if( !bucket )
+            {
+                bucket = new EventStreamBucket;
+                mBuckets.insert( QThread::currentThread(), bucket );
+            }
+        }
+
+        bucket->subscribe( request, response );
+    }
+
+    void EventStreamProvider::setHeartbeatInterval( int msecs )
+    {
+        if( msecs > 0 )
+        {
+            mHeartbeat->start( msecs );
+        }
+        else
+        {
+            mHeartbeat->stop();
+        }
+    }
+
+    int EventStreamProvider::heartbeatInterval() const
+    {
+        return mHeartbeat->isActive() ? mHeartbeat->interval() : 0;
+    }
+
+    int EventStreamProvider::subscriberCount() const
+    {
+        int count = 0;
+
+        QMutexLocker l( &mBucketsMutex );
+        foreach( EventStreamBucket* bucket, mBuckets )
+        {
+            count += bucket->mCount;
+        }
+        return count;
+    }
+
+    /*
+     * A line break would end the field early and turn the rest into a line of its own, so any
+     * CR or LF in the value is dropped.
+     */
+    static void appendField( QByteArray& text, const char* name, const QByteArray& value )
+    {
+        if( value.isEmpty() )
+        {
+            return;
+        }
+
+        text.append( name );
+        for( int i = 0; i < value.size(); i++ )
+        {
+            char c = value.at( i );
+            if( c != '\r' && c != '\n' )
+            {
+                text.append( c );
+            }
+        }
+        text.append( '\n' );
+    }
+
+    void EventStreamProvider::broadcast( const QByteArray& data, const QByteArray& event,
+                                         const QByteArray& id )
+    {
+        QByteArray text;
+        text.reserve( data.size() + event.size() + id.size() + 32 );
+
+        appendField( text, "id: ", id );
+        appendField( text, "event: ", event );
+
+        // One data line per line of data; CR, LF and CRLF all end a line
+        int start = 0;
+        for( ;; )
+        {
+            int end = start;
+            while( end < data.size() && data.at( end ) != '\n' && data.at( end ) != '\r' )
+            {
+                end++;
+            }
+
+            text.append( "data: " );
+            text.append( data.constData() + start, end - start );
+            text.append( '\n' );
+
+            if( end == data.size() )
+            {
+                break;
+            }
+
+            start = end + 1;
+            if( data.at( end ) == '\r' && start < data.size() && data.at( start ) == '\n' )
+            {
+                start++;
+            }
+        }
+
+        text.append( '\n' );
+
+        post( text, frameChunk( text ), false );
+    }
+
+    void EventStreamProvider::heartbeat()
+    {
+        post( mHeartbeatText, mHeartbeatChunk, true );
+    }
+
+    /*
+     * One event per worker thread that has subscribers; that thread hands it to each of them.
+     */
+    void EventStreamProvider::post( const QByteArray& text, const QByteArray& chunk,
+                                    bool heartbeat )
+    {
+        QMutexLocker l( &mBucketsMutex );
+        foreach( EventStreamBucket* bucket, mBuckets )
+        {
+            if( bucket->mCount )
+            {
+                QCoreApplication::postEvent( bucket, new EventStreamEvent( text, chunk, heartbeat ) );
+            }
+        }
+    }
+
+}
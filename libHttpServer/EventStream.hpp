@@ -0,0 +1,84 @@
+/*
+ * Modern CI
+ * Copyright (C) 2012-2013 Sascha Cunz <sascha@babbelbox.org>
+ *
+ * This program is free software; you can redistribute it and/or modify it under the terms of the
+ * GNU General Public License (Version 2) as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without
+ * even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this program; if
+ * not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef HTTP_EVENT_STREAM_HPP
+#define HTTP_EVENT_STREAM_HPP
+
+#include <QHash>
+#include <QMutex>
+
+#include "libHttpServer/ContentProvider.hpp"
+
+class QThread;
+class QTimer;
+
+namespace HTTP
+{
+
+    class EventStreamBucket;
+
+    /*
+     * Serves Server-Sent Events (text/event-stream): every request it handles subscribes to the
+     * stream and stays open until the client goes away or the server drains.
+     *
+     * broadcast() may be called from any thread. Each event is serialized once, and every
+     * subscriber gets a reference to that buffer; the subscribers of each worker thread are
+     * served there. Subscribers that were sent nothing during a heartbeat interval get a comment
+     * line instead, so proxies do not time them out. A subscriber whose connection is over its
+     * high water mark when an event arrives is ended, and so is every stream once the server
+     * drains.
+     */
+    class HTTP_SERVER_API EventStreamProvider : public ContentProvider
+    {
+        Q_OBJECT
+    public:
+        EventStreamProvider( const QString& prefix, QObject* parent );
+        ~EventStreamProvider();
+
+    public:
+        bool canHandle( const QUrl& url ) const;
+        void newRequest( Request* request );
+
+    public:
+        // In msecs; 0 turns heartbeats off. Defaults to 15 seconds.
+        void setHeartbeatInterval( int msecs );
+        int heartbeatInterval() const;
+
+        int subscriberCount() const;
+
+    public slots:
+        // Line breaks in event and id are dropped; data may span lines
+        void broadcast( const QByteArray& data, const QByteArray& event = QByteArray(),
+                        const QByteArray& id = QByteArray() );
+
+    private slots:
+        void heartbeat();
+
+    private:
+        void post( const QByteArray& text, const QByteArray& chunk, bool heartbeat );
+
+    private:
+        QString         mPrefix;
+        QTimer*         mHeartbeat;
+        QByteArray      mHeartbeatText;
+        QByteArray      mHeartbeatChunk;
+        mutable QMutex  mBucketsMutex;
+        QHash< QThread*, EventStreamBucket* > mBuckets;
+    };
+
+}
+
+#endif
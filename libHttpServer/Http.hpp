@@ -78,6 +78,7 @@ namespace HTTP
         RequestedRangeNotSatisfiable    = 416,
         ExpectationFailed               = 417,
         IAmATeaport                     = 418,
+        UpgradeRequired                 = 426,
 
         InternalServerError             = 500,
         NotImplemented                  = 501,
@@ -93,6 +94,20 @@ namespace HTTP
         Unsubscribe, Patch, Purge
     };
 
+    enum LatencyStage
+    {
+        ParseLatency,           // First byte of the request until its headers were parsed
+        HandlerLatency,         // Headers parsed until the response was finished
+        TotalLatency            // First byte of the request until the last byte was sent
+    };
+
+    enum EventEngine
+    {
+        QtEventEngine,          // QTcpSocket per connection, driven by Qt's event loop
+        EpollEventEngine,       // Raw sockets in an edge triggered epoll set per thread; Linux only
+        UringEventEngine        // Batched io_uring submissions per thread; Linux 5.6 and later
+    };
+
     typedef QByteArray HeaderName;
     typedef QByteArray HeaderValue;
     typedef QHash< HeaderName, HeaderValue > HeadersHash;
@@ -0,0 +1,162 @@
+/*
+ * Modern CI
+ * Copyright (C) 2012-2013 Sascha Cunz <sascha@babbelbox.org>
+ *
+ * This program is free software; you can redistribute it and/or modify it under the terms of the
+ * GNU General Public License (Version 2) as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without
+ * even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this program; if
+ * not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef HTTP_ACCESS_LOG_PRIVATE_HPP
+#define HTTP_ACCESS_LOG_PRIVATE_HPP
+
+#include <QFile>
+#include <QList>
+#include <QMutex>
+#include <QThread>
+#include <QAtomicInt>
+#include <QWaitCondition>
+#include <QThreadStorage>
+
+#include "libHttpServer/AccessLog.hpp"
+
+namespace HTTP
+{
+
+    /*
+     * What we store per request. Plain data, so writing one is a couple of stores and a memcpy.
+     */
+    struct AccessRecord
+    {
+        enum { MaxUrlLength = 200, MaxHeaderLength = 120 };
+
+        qint64      mTime;              // msecs since epoch
+        qint32      mConnectionId;
+        qint16      mStatus;
+        qint8       mVersion;           // Minor version; -1 = unknown
+        qint8       mMethod;
+        quint16     mRemotePort;
+        quint8      mRemoteIsIPv6;
+        quint8      mRemoteAddr[ 16 ];
+        quint8      mUrlTruncated;
+        quint16     mUrlLength;
+        char        mUrl[ MaxUrlLength ];
+
+        // Only valid if mCompleted is set (recorded through IRequestLog)
+        quint8      mCompleted;
+        quint8      mUserAgentLength;
+        quint8      mRefererLength;
+        char        mUserAgent[ MaxHeaderLength ];
+        char        mReferer[ MaxHeaderLength ];
+        qint64      mBytesIn;
+        qint64      mBytesOut;
+        qint64      mHeaderParseTime;
+        qint64      mHandlerTime;
+        qint64      mTimeToFirstByte;
+        qint64      mTotalTime;
+    };
+
+    /*
+     * Single producer / single consumer ring. The producer is the worker thread that owns it, the
+     * consumer is the log's writer thread. One slot is always kept free to tell full from empty.
+     */
+    class AccessLogRing
+    {
+    public:
+        enum { Size = 1024 };
+
+    public:
+        AccessLogRing();
+
+    public:
+        AccessRecord* beginPush();
+        void endPush();
+
+        int pop( AccessRecord* records, int max );
+
+        bool isOrphaned() const;
+        void orphan();
+
+    private:
+        AccessRecord    mRecords[ Size ];
+        QAtomicInt      mHead;          // Next slot to write; only the producer changes it
+        QAtomicInt      mTail;          // Next slot to read; only the consumer changes it
+        QAtomicInt      mOrphaned;      // Producer thread has finished
+    };
+
+    /*
+     * Lives in a worker thread's QThreadStorage. Once the thread finishes, the ring is handed over
+     * to the writer thread, which drains and deletes it.
+     */
+    class AccessLogRingHandle
+    {
+    public:
+        AccessLogRingHandle( AccessLogRing* ring );
+        ~AccessLogRingHandle();
+
+    public:
+        AccessLogRing* mRing;
+    };
+
+    class FileAccessLogWriter : public QThread
+    {
+    public:
+        FileAccessLogWriter( FileAccessLogPrivate* log );
+
+    public:
+        void stop();
+
+    protected:
+        void run();
+
+    private:
+        bool drain( QByteArray& out );
+        void format( const AccessRecord& record, QByteArray& out );
+        void formatCommon( const AccessRecord& record, QByteArray& out, bool combined );
+        void formatJson( const AccessRecord& record, QByteArray& out );
+
+    private:
+        FileAccessLogPrivate*   mLog;
+        bool                    mStop;
+        QMutex                  mStopMutex;
+        QWaitCondition          mStopCondition;
+        qint64                  mLastSecond;
+        QByteArray              mCommonTime;
+        QByteArray              mJsonTime;
+    };
+
+    class FileAccessLogPrivate
+    {
+    public:
+        FileAccessLogPrivate( const QString& fileName, FileAccessLog::Format format );
+
+    public:
+        AccessLogRing* localRing();
+        AccessRecord* beginRecord( AccessLogRing*& ring, int connectionId, Version version,
+                                   Method method, const QHostAddress& remoteAddr,
+                                   quint16 remotePort, StatusCode status );
+
+    public:
+        FileAccessLog::Format                   mFormat;
+        QFile                                   mFile;
+        QAtomicInt                              mFlushInterval;
+        QAtomicInt                              mSyncInterval;
+        QAtomicInt                              mDropped;
+
+        QMutex                                  mRingsMutex;
+        QList< AccessLogRing* >                 mRings;
+        QThreadStorage< AccessLogRingHandle* >  mLocalRing;
+
+        FileAccessLogWriter*                    mWriter;
+    };
+
+}
+
+#endif
@@ -0,0 +1,70 @@
+/*
+ * Modern CI
+ * Copyright (C) 2012-2013 Sascha Cunz <sascha@babbelbox.org>
+ *
+ * This program is free software; you can redistribute it and/or modify it under the terms of the
+ * GNU General Public License (Version 2) as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without
+ * even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this program; if
+ * not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "libHttpServer/Internal/AllocStats.hpp"
+
+// count() runs inside malloc(), so the state must not need allocating itself
+#ifdef Q_CC_MSVC
+#define HTTP_THREAD_LOCAL __declspec( thread )
+#else
+#define HTTP_THREAD_LOCAL __thread
+#endif
+
+namespace HTTP
+{
+
+    static HTTP_THREAD_LOCAL int         tStage;
+    static HTTP_THREAD_LOCAL qint64      tAllocations[ AllocStats::StageCount ];
+
+    AllocStats::Stage AllocStats::enter( Stage stage )
+    {
+        Stage previous = Stage( tStage );
+        tStage = stage;
+        return previous;
+    }
+
+    void AllocStats::count()
+    {
+        tAllocations[ tStage ]++;
+    }
+
+    qint64 AllocStats::allocations( Stage stage )
+    {
+        return tAllocations[ stage ];
+    }
+
+    void AllocStats::reset()
+    {
+        for( int i = 0; i < StageCount; i++ )
+        {
+            tAllocations[ i ] = 0;
+        }
+    }
+
+    const char* AllocStats::stageName( Stage stage )
+    {
+        switch( stage )
+        {
+        case Idle:      return "idle";
+        case Parse:     return "parse";
+        case Dispatch:  return "dispatch";
+        case Build:     return "build";
+        case Write:     return "write";
+        default:        return NULL;
+        }
+    }
+
+}
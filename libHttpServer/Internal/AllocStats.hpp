@@ -0,0 +1,78 @@
+/*
+ * Modern CI
+ * Copyright (C) 2012-2013 Sascha Cunz <sascha@babbelbox.org>
+ *
+ * This program is free software; you can redistribute it and/or modify it under the terms of the
+ * GNU General Public License (Version 2) as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without
+ * even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this program; if
+ * not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef HTTP_ALLOC_STATS_HPP
+#define HTTP_ALLOC_STATS_HPP
+
+#include <QtGlobal>
+
+namespace HTTP
+{
+
+    /*
+     * Attributes heap allocations to the stage of request processing the calling thread is in.
+     * The library only marks the stages (see HTTP_ALLOC_STAGE); counting needs an allocation hook
+     * that calls count(), which the instrumented micro benchmark build provides.
+     */
+    class AllocStats
+    {
+    public:
+        enum Stage
+        {
+            Idle,
+            Parse,
+            Dispatch,
+            Build,
+            Write,
+
+            StageCount
+        };
+
+    public:
+        static Stage enter( Stage stage );
+        static void count();
+        static qint64 allocations( Stage stage );
+        static void reset();
+        static const char* stageName( Stage stage );
+    };
+
+    class AllocStage
+    {
+    public:
+        AllocStage( AllocStats::Stage stage )
+            : mPrevious( AllocStats::enter( stage ) )
+        {
+        }
+
+        ~AllocStage()
+        {
+            AllocStats::enter( mPrevious );
+        }
+
+    private:
+        AllocStats::Stage mPrevious;
+    };
+
+}
+
+// Counts the rest of the enclosing scope towards the given stage
+#ifdef HTTP_SERVER_ALLOC_COUNTING
+#define HTTP_ALLOC_STAGE( stage ) ::HTTP::AllocStage allocStage( ::HTTP::AllocStats::stage )
+#else
+#define HTTP_ALLOC_STAGE( stage )
+#endif
+
+#endif
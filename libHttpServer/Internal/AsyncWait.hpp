@@ -0,0 +1,74 @@
+/*
+ * Modern CI
+ * Copyright (C) 2012-2013 Sascha Cunz <sascha@babbelbox.org>
+ *
+ * This program is free software; you can redistribute it and/or modify it under the terms of the
+ * GNU General Public License (Version 2) as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without
+ * even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this program; if
+ * not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef HTTP_ASYNC_WAIT_PRIVATE_HPP
+#define HTTP_ASYNC_WAIT_PRIVATE_HPP
+
+#include <QObject>
+
+#include "libHttpServer/AsyncWait.hpp"
+
+class QTimerEvent;
+
+namespace HTTP
+{
+
+    /*
+     * Serves all AsyncWaits of one thread and lives there. Its connections to senders and guards
+     * are made once and kept; the waits are a plain list, which is short, since only suspended
+     * handlers are on it.
+     */
+    class AsyncWaitNotifier : public QObject
+    {
+        Q_OBJECT
+    public:
+        AsyncWaitNotifier();
+        ~AsyncWaitNotifier();
+
+    public:
+        static AsyncWaitNotifier* local( bool create );
+
+        void add( AsyncWait* wait );
+        void remove( AsyncWait* wait );
+        void watch( QObject* sender, const char* signal );
+        void cancel( QObject* guard );
+
+    protected:
+        void timerEvent( QTimerEvent* event );
+
+    private slots:
+        void signalled();
+        void fileLoaded();
+        void guardDestroyed( QObject* guard );
+
+    private:
+        enum Match
+        {
+            BySender,
+            ByTimer,
+            ByGuard
+        };
+
+        bool notify( Match match, QObject* object, int timerId );
+
+    private:
+        AsyncWait*  mFirst;
+        quint32     mSerial;
+    };
+
+}
+
+#endif
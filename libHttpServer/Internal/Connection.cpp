@@ -14,11 +14,24 @@
  *
  */
 
+#include <new>
+
 #include <QTimer>
 
+#include "libHttpServer/ContentProvider.hpp"
+#include "libHttpServer/RequestHandler.hpp"
+#include "libHttpServer/WebSocket.hpp"
+
 #include "libHttpServer/Internal/Http.hpp"
 #include "libHttpServer/Internal/Connection.hpp"
 #include "libHttpServer/Internal/Request.hpp"
+#include "libHttpServer/Internal/RoundRobinServer.hpp"
+#include "libHttpServer/Internal/AllocStats.hpp"
+#include "libHttpServer/Internal/RequestPool.hpp"
+#include "libHttpServer/Internal/Response.hpp"
+#include "libHttpServer/Internal/Executor.hpp"
+#include "libHttpServer/Internal/Transport.hpp"
+#include "libHttpServer/Internal/WebSocket.hpp"
 
 namespace HTTP
 {
@@ -153,19 +166,37 @@ namespace HTTP
         }
     }
 
-    Connection::Connection( QTcpSocket* socket, ServerPrivate* server, Establisher* parent )
+    Connection::Connection( Transport* transport, ServerPrivate* server, Establisher* parent )
         : QObject( parent )
         , mConnectionId( sNextId++ )
         , mServer( server )
-        , mSocket( socket )
+        , mTransport( transport )
         , mNextRequest( NULL )
+        , mStaged( StagedNothing )
+        , mStagedValue( 0 )
+        , mRemoteAddr( transport->peerAddress() )
+        , mRemotePort( transport->peerPort() )
+        , mOutputOffset( 0 )
+        , mOutputBytes( 0 )
+        , mShaper( parent->shaper() )
+        , mMetrics( parent->metrics() )
+        , mPool( parent->pool() )
+        , mAboveHighWater( false )
+        , mCloseWhenDone( false )
+        , mDraining( false )
+        , mAnswered( false )
+        , mInFlight( 0 )
+        , mBytesQueued( 0 )
+        , mBytesSent( 0 )
+        , mWebSocket( NULL )
     {
-        mParser = (http_parser*) malloc( sizeof( http_parser ) );
-        http_parser_init( mParser, HTTP_REQUEST );
-        mParser->data = this;
+        http_parser_init( &mParser, HTTP_REQUEST );
+        mParser.data = this;
 
-        connect( socket, SIGNAL(readyRead()), this, SLOT(dataArrived()) );
-        connect( socket, SIGNAL(disconnected()), this, SLOT(socketLost()) );
+        transport->setConnection( this );
+
+        mMetrics->mConnectionsOpened++;
+        mServer->mOpenConnections.ref();
 
         HTTP_DBG( "New connection %p; Thread=%p", this, QThread::currentThread() );
     }
@@ -174,43 +205,211 @@ namespace HTTP
     {
         HTTP_DBG( "Deleted connection %p; Thread=%p", this, QThread::currentThread() );
 
-        delete mSocket;
-        mSocket = NULL;
+        mMetrics->mConnectionsClosed++;
+
+        if( mShaper )
+        {
+            mShaper->cancel( this );
+        }
+
+        if( mWebSocket )
+        {
+            mWebSocket->d->connectionLost();
+        }
 
-        free( mParser );
-        mParser = NULL;
+        mTransport->release();
+        mTransport = NULL;
+
+        // Retired requests are still our children and go with us; one that was never dispatched
+        // is not
+        if( mNextRequest && !mNextRequest->mRequest->parent() )
+        {
+            delete mNextRequest->mRequest;
+        }
+
+        mServer->connectionClosed();
     }
 
     void Connection::dataArrived()
     {
-        Q_ASSERT( mSocket );
-        Q_ASSERT( mParser );
+        Q_ASSERT( mTransport );
+
+        char buffer[ sReadChunk ];
+        qint64 length;
 
-        while( mSocket->bytesAvailable() )
+        while( !mCloseWhenDone && ( length = mTransport->read( buffer, sReadChunk ) ) > 0 )
         {
-            QByteArray arr = mSocket->readAll();
-            HTTP_DBG( "RECV: %s", arr.constData() );
-            http_parser_execute(mParser, &sParserCallbacks, arr.constData(), arr.size());
+            HTTP_DBG( "RECV: %.*s", int( length ), buffer );
+            received( buffer, size_t( length ) );
+        }
+    }
+
+    /*
+     * Feeds data read from the client to the parser, which in turn dispatches the requests.
+     */
+    void Connection::received( const char* data, size_t length )
+    {
+        HTTP_ALLOC_STAGE( Parse );
+
+        recycleRetired();
+
+        mMetrics->mBytesIn += length;
+
+        if( mWebSocket )
+        {
+            mWebSocket->d->received( data, length );
+            return;
+        }
+
+        while( length )
+        {
+            size_t parsed = http_parser_execute( &mParser, &sParserCallbacks, data, length );
+
+            if( HTTP_PARSER_ERRNO( &mParser ) != HPE_OK )
+            {
+                // The parser cannot recover; answer what we have and give up on the rest
+                mMetrics->mParserErrors++;
+                closeWhenDone();
+                return;
+            }
+
+            data += parsed;
+            length -= parsed;
+
+            // The parser stops after a request that upgrades the connection. If that was not a
+            // WebSocket of ours, the client has to go on speaking HTTP.
+            if( mWebSocket )
+            {
+                if( length )
+                {
+                    mWebSocket->d->received( data, length );
+                }
+                return;
+            }
+
+            if( mCloseWhenDone )
+            {
+                return;
+            }
         }
     }
 
     void Connection::socketLost()
     {
         HTTP_DBG( "Connection %p lost its socket Thread=%p", this, QThread::currentThread() );
+
+        if( mWebSocket )
+        {
+            mWebSocket->d->connectionLost();
+        }
+
         deleteLater();
     }
 
     void Connection::write(const QByteArray& data)
     {
-        if (mOutput.isEmpty()) {
-            mOutput = data;
+        write(BodySegment(data));
+    }
+
+    void Connection::write(const BodySegment& segment)
+    {
+        if (segment.mData.isEmpty()) {
+            return;
         }
-        else {
-            mOutput += data;
+        mOutput.append(segment);
+        mOutputBytes += segment.mData.count();
+        mBytesQueued += segment.mData.count();
+
+        if (!mAboveHighWater && !isWritable()) {
+            mAboveHighWater = true;
         }
+
         maybeSend();
     }
 
+    /*
+     * We only hand data to the socket while its own buffer is below the high water mark; the rest
+     * stays in mOutput (which, unlike the socket's buffer, does not copy mapped files). Writers
+     * that care can check isWritable() and wait for writable().
+     */
+    bool Connection::isWritable() const
+    {
+        return mOutputBytes + mTransport->bytesToWrite() < sHighWaterMark;
+    }
+
+    void Connection::socketBytesWritten()
+    {
+        maybeSend();
+
+        if (mAboveHighWater && mOutputBytes + mTransport->bytesToWrite() < sLowWaterMark) {
+            mAboveHighWater = false;
+            emit writable();
+        }
+    }
+
+    /*
+     * After a response with "Connection: Close" nothing else is read from the client, and the
+     * socket is closed as soon as all output is handed over to it.
+     */
+    void Connection::closeWhenDone()
+    {
+        mCloseWhenDone = true;
+
+        if (mOutput.isEmpty()) {
+            mTransport->disconnectFromHost();
+        }
+    }
+
+    /*
+     * The server is shutting down: the next response tells the client that we close the
+     * connection. A connection that is idle after answering requests is closed right away. One
+     * that has not sent (or we have not read) a request yet gets a grace period for it, since the
+     * client may well have sent one already. Streamed responses hear of it through draining(),
+     * as they would otherwise only end when the drain times out.
+     */
+    void Connection::drain()
+    {
+        mDraining = true;
+
+        if (mWebSocket) {
+            mWebSocket->close(WebSocket::GoingAway);
+            return;
+        }
+
+        if (!mInFlight && !mNextRequest) {
+            if (mAnswered) {
+                closeWhenDone();
+            } else {
+                QTimer::singleShot(sDrainGrace, this, SLOT(drainGraceOver()));
+            }
+            return;
+        }
+
+        emit draining();
+    }
+
+    /*
+     * No request came in during the grace period; the socket is either one a browser opened in
+     * advance, or its client takes too long.
+     */
+    void Connection::drainGraceOver()
+    {
+        if (!mInFlight && !mNextRequest && !mCloseWhenDone) {
+            closeWhenDone();
+        }
+    }
+
+    bool Connection::isDraining() const
+    {
+        return mDraining;
+    }
+
+    void Connection::abort()
+    {
+        mTransport->abort();
+        deleteLater();
+    }
+
     int Connection::id() const
     {
         return mConnectionId;
@@ -221,6 +420,54 @@ namespace HTTP
         return mServer->mHttpServer;
     }
 
+    MetricsShard* Connection::metrics() const
+    {
+        return mMetrics;
+    }
+
+    RequestPool* Connection::pool() const
+    {
+        return mPool;
+    }
+
+    /*
+     * Called when a request's response was sent. The request is recycled once it has also been
+     * received completely, and only when the next data arrives: whoever sent the response might
+     * still be using it further up the stack.
+     */
+    void Connection::retire( Request* request )
+    {
+        maybeRetire( request->d );
+    }
+
+    /*
+     * The result comes back through our Establisher, which outlives us.
+     */
+    void Connection::offload( Request* request, OffloadJob* job )
+    {
+        mServer->mExecutor.submit( new OffloadTask( job, request, parent() ) );
+    }
+
+    void Connection::maybeRetire( Request::Data* request )
+    {
+        if( request->mRetired || request->mState != Request::Finished || !request->mResponse ||
+                !request->mResponse->d->mFlags.testFlag( Response::Data::Sent ) )
+        {
+            return;
+        }
+
+        request->mRetired = true;
+        mRetired.append( request->mRequest );
+    }
+
+    void Connection::recycleRetired()
+    {
+        while( !mRetired.isEmpty() )
+        {
+            mPool->recycle( mRetired.takeLast() );
+        }
+    }
+
     int Connection::onMessageBegin( http_parser* parser )
     {
         Connection* that = static_cast< Connection* >( parser->data );
@@ -229,7 +476,8 @@ namespace HTTP
         HTTP_PARSER_DBG( "PARSER: Message Begin" );
 
         Q_ASSERT( !that->mNextRequest );
-        that->mNextRequest = new Request::Data;
+        that->mNextRequest = that->mPool->takeRequest()->d;
+        that->mNextRequest->mTimer.start();
 
         return 0;
     }
@@ -242,7 +490,7 @@ namespace HTTP
         HTTP_PARSER_DBG( "PARSER: URL" );
 
         Q_ASSERT( that->mNextRequest );
-        that->mNextRequest->mUrl += QByteArray( at, length );
+        that->stage( StagedUrl, at, length );
 
         return 0;
     }
@@ -254,7 +502,12 @@ namespace HTTP
 
         HTTP_PARSER_DBG( "PARSER: Header Field" );
 
-        that->mNextHeader = HeaderName( at, length );
+        if( that->mStaged != StagedName )
+        {
+            that->flushStaged();
+        }
+
+        that->stage( StagedName, at, length );
 
         return 0;
     }
@@ -266,16 +519,108 @@ namespace HTTP
 
         HTTP_PARSER_DBG( "PARSER: Header Value" );
 
+        Q_ASSERT( that->mNextRequest );
+
+        if( that->mStaged == StagedName )
+        {
+            that->mStagedValue = that->mStaging.count();
+        }
+
+        // A folded line just continues the value
+        that->stage( StagedValue, at, length );
+
+        return 0;
+    }
+
+    /*
+     * Collects the pieces of a URL or header in one buffer, so a client that sends byte by byte
+     * does not cost a reallocation per byte. They are turned into a QByteArray once complete.
+     */
+    void Connection::stage( Staged what, const char* data, size_t length )
+    {
+        mStaged = what;
+        mStaging.append( data, int( length ) );
+    }
+
+    void Connection::flushStaged()
+    {
+        Request::Data* req = mNextRequest;
+
+        switch( mStaged )
+        {
+        case StagedUrl:
+            req->mUrl = QByteArray( mStaging.constData(), mStaging.count() );
+            break;
+
+        case StagedValue:
+            HTTP_PARSER_DBG( "Appending '%.*s' to header %.*s",
+                             mStaging.count() - mStagedValue,
+                             mStaging.constData() + mStagedValue,
+                             mStagedValue, mStaging.constData() );
+
+            req->appendHeaderData( HeaderName( mStaging.constData(), mStagedValue ),
+                                   QByteArray( mStaging.constData() + mStagedValue,
+                                               mStaging.count() - mStagedValue ) );
+            break;
+
+        case StagedName:
+            // An empty header, which was never stored
+        case StagedNothing:
+            break;
+        }
+
+        mStaged = StagedNothing;
+        mStaging.resize( 0 );
+    }
+
+    /*
+     * A single large header block must not pin its buffer for the rest of a keep-alive
+     * connection. QVarLengthArray cannot give memory back, so a large one is replaced.
+     */
+    void Connection::trimStaging()
+    {
+        if( mStaging.capacity() > sStagingKeep )
+        {
+            mStaging.~StagingBuffer();
+            new ( &mStaging ) StagingBuffer;
+        }
+    }
+
+    /*
+     * All headers at once, if they arrived in one read; otherwise, onHeaderField() and
+     * onHeaderValue() get them piece by piece.
+     */
+    int Connection::onHeaders( http_parser* parser, const http_header_span* headers,
+                               size_t count )
+    {
+        Connection* that = static_cast< Connection* >( parser->data );
+        Q_ASSERT( that );
+
+        HTTP_PARSER_DBG( "PARSER: %i Headers", int( count ) );
+
         Q_ASSERT( that->mNextRequest );
         Q_ASSERT( that->mNextRequest->mState == Request::ReceivingHeaders );
 
-        QByteArray data( at, length );
+        Request::Data* req = that->mNextRequest;
+        HeaderName name;
 
-        HTTP_PARSER_DBG( "Appending '%s' to header %s",
-                         data.constData(),
-                         that->mNextHeader.constData() );
+        that->flushStaged();    // The URL
 
-        that->mNextRequest->appendHeaderData( that->mNextHeader, data );
+        for( size_t i = 0; i < count; i++ )
+        {
+            const http_header_span& h = headers[ i ];
+
+            // No name: a folded line, continuing the previous header
+            if( h.name )
+            {
+                name = HeaderName( h.name, int( h.name_len ) );
+            }
+
+            if( h.value )
+            {
+                req->appendHeaderData( name, QByteArray( h.value, int( h.value_len ) ) );
+            }
+        }
 
         return 0;
     }
@@ -293,8 +638,10 @@ namespace HTTP
 
         Q_ASSERT( req->mState == Request::ReceivingHeaders );
 
-        req->mRemoteAddr = that->mSocket->peerAddress();
-        req->mRemotePort = that->mSocket->peerPort();
+        that->flushStaged();
+
+        req->mRemoteAddr = that->mRemoteAddr;
+        req->mRemotePort = that->mRemotePort;
 
         if( parser->http_major == 1 && parser->http_minor == 0 )
             req->mVersion = V_1_0;
@@ -305,11 +652,40 @@ namespace HTTP
 
         req->mMethod = method( parser->method );
 
-        that->mNextHeader = HeaderName();
+        req->mHeadersDone = req->mTimer.nsecsElapsed() / 1000;
+        req->mBytesIn = parser->nread;
+
+        that->trimStaging();
 
+        that->mMetrics->mRequests++;
+        that->mInFlight++;
+
+        if( parser->upgrade )
+        {
+            req->mWebSocketHandler = that->mServer->webSocketHandlerFor( req->mUrl );
+            if( req->mWebSocketHandler )
+            {
+                // Answered from onMessageComplete(), like a handler's request
+                req->mState = Request::ReceivingBody;
+                return 0;
+            }
+        }
+
+        req->mHandler = that->mServer->handlerFor( req->mUrl );
+        if( req->mHandler )
+        {
+            // Answered from onMessageComplete(); nobody gets to see the Request object
+            req->mState = Request::ReceivingBody;
+            return 0;
+        }
+
+        req->mRequest->setParent( that );
         req->enterRecvBody();
 
-        that->mServer->newRequest( new Request( that, req ) );
+        {
+            HTTP_ALLOC_STAGE( Dispatch );
+            that->mServer->newRequest( req->mRequest );
+        }
 
         return 0;
     }
@@ -344,34 +720,313 @@ namespace HTTP
         Q_ASSERT( that->mNextRequest );
         Q_ASSERT( that->mNextRequest->mState == Request::ReceivingBody );
 
-        that->mNextRequest->enterFinished();
+        that->flushStaged();    // Trailers of a chunked request
+
+        Request::Data* req = that->mNextRequest;
         that->mNextRequest = NULL;
 
+        if( req->mHandler )
+        {
+            that->handle( req );
+            return 0;
+        }
+
+        if( req->mWebSocketHandler )
+        {
+            that->upgrade( req );
+            return 0;
+        }
+
+        req->enterFinished();
+        that->maybeRetire( req );
+
         return 0;
     }
 
-    void Connection::maybeSend()
+    /*
+     * The whole life of a request that goes to an IRequestHandler: no signals, no Response object
+     * and nothing deferred, the Request just serves as storage and goes back to the pool at once.
+     */
+    void Connection::handle( Request::Data* req )
     {
-        if (mOutput.isEmpty()) {
-            return;
+        req->mState = Request::Finished;
+
+        RequestView view( req->mRequest );
+        ResponseWriter writer;
+        {
+            HTTP_ALLOC_STAGE( Build );
+            req->mHandler->handle( view, writer );
         }
-        if (!mServer->mThrottledTo) {
-            mSocket->write(mOutput.constData(), mOutput.count());
-            mOutput.clear();
-            return;
+
+        bool close = req->mVersion != V_1_1 || mDraining;
+        QByteArray out = writer.serialize( close );
+        StatusCode status = writer.status();
+
+        mMetrics->countResponse( status );
+        qint64 firstByteTime = req->mTimer.nsecsElapsed() / 1000;
+
+        IAccessLog* log = server()->accessLog();
+        if( log )
+        {
+            log->access( mConnectionId, req->mVersion, req->mMethod, QUrl::fromEncoded( req->mUrl ),
+                         req->mRemoteAddr, req->mRemotePort, status );
+        }
+
+        {
+            HTTP_ALLOC_STAGE( Write );
+            write( out );
+        }
+
+        responseCompleted( req->mRequest, status, out.count(), firstByteTime );
+
+        if( close )
+        {
+            closeWhenDone();
+        }
+
+        mPool->recycle( req->mRequest );
+    }
+
+    /*
+     * Answers a WebSocket handshake. If the handler accepts it, the request goes back to the pool
+     * and all further data from the client is handed to the new WebSocket.
+     */
+    void Connection::upgrade( Request::Data* req )
+    {
+        req->mState = Request::Finished;
+
+        QByteArray accept;
+        QByteArray protocol;
+        StatusCode status = WebSocket::Data::handshake( req->mMethod, req->mVersion,
+                                                        req->mHeaders, accept );
+
+        if( status == SwitchProtocols && mDraining )
+        {
+            status = ServerUnavailable;
+        }
+
+        if( status == SwitchProtocols )
+        {
+            RequestView view( req->mRequest );
+            HTTP_ALLOC_STAGE( Build );
+            if( !req->mWebSocketHandler->accept( view, protocol ) )
+            {
+                status = Forbidden;
+            }
+        }
+
+        QByteArray out;
+        if( status == SwitchProtocols )
+        {
+            out = "HTTP/1.1 101 Switching Protocols\r\n"
+                  "Upgrade: websocket\r\n"
+                  "Connection: Upgrade\r\n"
+                  "Sec-WebSocket-Accept: " + accept + "\r\n";
+            if( !protocol.isEmpty() )
+            {
+                out += "Sec-WebSocket-Protocol: " + protocol + "\r\n";
+            }
+            out += "\r\n";
+        }
+        else
+        {
+            ResponseWriter writer;
+            writer.setStatus( status );
+            if( status == UpgradeRequired )
+            {
+                writer.addHeader( "Sec-WebSocket-Version", "13" );
+            }
+            out = writer.serialize( true );
+        }
+
+        mMetrics->countResponse( status );
+        qint64 firstByteTime = req->mTimer.nsecsElapsed() / 1000;
+
+        IAccessLog* log = server()->accessLog();
+        if( log )
+        {
+            log->access( mConnectionId, req->mVersion, req->mMethod, QUrl::fromEncoded( req->mUrl ),
+                         req->mRemoteAddr, req->mRemotePort, status );
         }
 
-        if (mOutput.count() <= mServer->mThrottledTo) {
-            mSocket->write(mOutput.constData(), mOutput.count());
-            mOutput.clear();
+        {
+            HTTP_ALLOC_STAGE( Write );
+            write( out );
+        }
+
+        responseCompleted( req->mRequest, status, out.count(), firstByteTime );
+
+        if( status != SwitchProtocols )
+        {
+            closeWhenDone();
+            mPool->recycle( req->mRequest );
             return;
         }
 
-        mSocket->write(mOutput.constData(), mServer->mThrottledTo);
-        mOutput.remove(0, mServer->mThrottledTo);
+        WebSocket::Data* data = new WebSocket::Data( this );
+        data->mUrl = req->mUrl;
+        data->mHeaders = req->mHeaders;
+        data->mProtocol = protocol;
+        data->mRemoteAddr = req->mRemoteAddr;
+        data->mRemotePort = req->mRemotePort;
+        mWebSocket = new WebSocket( this, data );
+
+        IWebSocketHandler* handler = req->mWebSocketHandler;
+        mPool->recycle( req->mRequest );
+        handler->newSocket( mWebSocket );
+    }
 
-        if (!mOutput.isEmpty()) {
-            QTimer::singleShot(200, this, SLOT(maybeSend()));
+    void Connection::maybeSend()
+    {
+        BandwidthLimits& limits = mServer->mLimits;
+
+        while (!mOutput.isEmpty()) {
+            // bytesWritten() brings us back once the socket has drained
+            qint64 room = sHighWaterMark - mTransport->bytesToWrite();
+            if (room <= 0) {
+                return;
+            }
+
+            qint64 providerRate = mOutput.first().mRateLimit;
+
+            // Only send up to where data with another limit starts
+            qint64 allowed = -mOutputOffset;
+            foreach (const BodySegment& segment, mOutput) {
+                if (segment.mRateLimit != providerRate) {
+                    break;
+                }
+                allowed += segment.mData.count();
+            }
+            allowed = qMin(allowed, room);
+
+            if (!providerRate && !limits.isLimited()) {
+                sendOutput(allowed);
+                continue;
+            }
+
+            qint64 now = mShaper->now();
+            qint64 rate = limits.connectionRate();
+            if (providerRate && (!rate || providerRate < rate)) {
+                rate = providerRate;
+            }
+
+            mBucket.setRate(rate);
+            if (mBucket.isLimited()) {
+                mBucket.refill(now);
+                allowed = qMin(allowed, mBucket.available());
+            }
+
+            if (allowed > 0) {
+                allowed = limits.acquire(mRemoteAddr, allowed);
+            }
+
+            if (allowed <= 0) {
+                mMetrics->mShaperWaits++;
+                mShaper->wait(this);
+                return;
+            }
+
+            if (mBucket.isLimited()) {
+                mBucket.consume(allowed);
+            }
+
+            mMetrics->mShapedBytes += allowed;
+
+            sendOutput(allowed);
+        }
+    }
+
+    void Connection::sendOutput(qint64 bytes)
+    {
+        while (bytes > 0 && !mOutput.isEmpty()) {
+            const QByteArray& data = mOutput.first().mData;
+            int chunk = int(qMin(qint64(data.count() - mOutputOffset), bytes));
+
+            mTransport->write(data.constData() + mOutputOffset, chunk);
+
+            mOutputOffset += chunk;
+            mOutputBytes -= chunk;
+            mBytesSent += chunk;
+            mMetrics->mBytesOut += chunk;
+            bytes -= chunk;
+
+            if (mOutputOffset == data.count()) {
+                mOutput.removeFirst();
+                mOutputOffset = 0;
+            }
+        }
+
+        if (!mPendingRecords.isEmpty()) {
+            recordsSent();
+        }
+
+        if (mOutput.isEmpty() && mCloseWhenDone) {
+            mTransport->disconnectFromHost();
+        }
+    }
+
+    /*
+     * Called by the Response when it has queued its last byte. We note where in the output stream
+     * that byte is, and finish the record once sendOutput() got past it.
+     */
+    void Connection::responseCompleted(Request* request, StatusCode status, qint64 bytesOut,
+                                       qint64 firstByteTime)
+    {
+        Request::Data* req = request->d;
+        mInFlight--;
+        mAnswered = true;
+
+        PendingRecord pending;
+        pending.mEndOffset = mBytesQueued;
+        pending.mTimer = req->mTimer;
+        pending.mRoute = req->mHandler ? static_cast< const void* >( req->mHandler )
+                       : req->mWebSocketHandler ? static_cast< const void* >( req->mWebSocketHandler )
+                       : static_cast< const void* >( req->mProvider );
+
+        // The latency histograms only need the timings
+        RequestRecord& r = pending.mRecord;
+        if (mServer->mRequestLog) {
+            r.mConnectionId = mConnectionId;
+            r.mVersion = req->mVersion;
+            r.mMethod = req->mMethod;
+            r.mUrl = req->mUrl;
+            r.mRemoteAddr = req->mRemoteAddr;
+            r.mRemotePort = req->mRemotePort;
+            r.mUserAgent = req->mHeaders.value("User-Agent");
+            r.mReferer = req->mHeaders.value("Referer");
+        }
+        r.mStatus = status;
+        r.mBytesIn = req->mBytesIn;
+        r.mBytesOut = bytesOut;
+        r.mHeaderParseTime = req->mHeadersDone;
+        r.mHandlerTime = req->mTimer.nsecsElapsed() / 1000 - req->mHeadersDone;
+        r.mTimeToFirstByte = firstByteTime;
+
+        mPendingRecords.append(pending);
+        recordsSent();
+
+        // Covers responses whose headers went out before we started draining
+        if (mDraining && !mInFlight) {
+            closeWhenDone();
+        }
+    }
+
+    void Connection::recordsSent()
+    {
+        while (!mPendingRecords.isEmpty() && mPendingRecords.first().mEndOffset <= mBytesSent) {
+            PendingRecord pending = mPendingRecords.takeFirst();
+            RequestRecord& r = pending.mRecord;
+            r.mTotalTime = pending.mTimer.nsecsElapsed() / 1000;
+
+            RouteHistograms* route = mMetrics->route(pending.mRoute);
+            route->mParse.record(r.mHeaderParseTime);
+            route->mHandler.record(r.mHandlerTime);
+            route->mTotal.record(r.mTotalTime);
+
+            IRequestLog* log = mServer->mRequestLog;
+            if (log) {
+                log->requestCompleted(pending.mRecord);
+            }
         }
     }
 
@@ -382,7 +1037,8 @@ namespace HTTP
         &Connection::onHeaderValue,
         &Connection::onHeadersComplete,
         &Connection::onBody,
-        &Connection::onMessageComplete
+        &Connection::onMessageComplete,
+        &Connection::onHeaders
     };
 
     int Connection::sNextId = 1;
@@ -18,59 +18,151 @@
 #define HTTP_CONNECTION_HPP
 
 #include <QObject>
+#include <QPointer>
+#include <QElapsedTimer>
+#include <QVarLengthArray>
 
 #include "libHttpServer/Http.hpp"
 #include "libHttpServer/Request.hpp"
 
 #include "libHttpServer/Internal/Server.hpp"
+#include "libHttpServer/Internal/MappedFile.hpp"
+#include "libHttpServer/Internal/Throttle.hpp"
 #include "libHttpServer/Internal/http_parser.h"
 
 namespace HTTP
 {
 
     class Establisher;
+    class Transport;
+    class OffloadJob;
+    class RequestPool;
     class Server;
     class Session;
+    class WebSocket;
 
     class Connection : public QObject
     {
         Q_OBJECT
     public:
-        Connection( QTcpSocket* socket, ServerPrivate* server, Establisher* parent );
+        Connection( Transport* transport, ServerPrivate* server, Establisher* parent );
         ~Connection();
 
     private slots:
         void dataArrived();
         void socketLost();
         void maybeSend();
+        void socketBytesWritten();
+        void drainGraceOver();
 
     public:
+        void received( const char* data, size_t length );
         void write( const QByteArray& data );
+        void write( const BodySegment& segment );
+        bool isWritable() const;
+        void closeWhenDone();
+        void drain();
+        bool isDraining() const;
+        void abort();
+        void responseCompleted( Request* request, StatusCode status, qint64 bytesOut,
+                                qint64 firstByteTime );
+        void retire( Request* request );
+        void offload( Request* request, OffloadJob* job );
+
+    signals:
+        void writable();
+        void draining();
 
     public:
         int id() const;
         Server* server() const;
         Session* session() const;
+        MetricsShard* metrics() const;
+        RequestPool* pool() const;
+
+    private:
+        friend class Shaper;
+        friend class Transport;
+        void sendOutput( qint64 bytes );
+        void recordsSent();
+        void maybeRetire( Request::Data* request );
+        void handle( Request::Data* request );
+        void upgrade( Request::Data* request );
+        void recycleRetired();
+
+    private:
+        // What the parser is in the middle of; it may come in many pieces
+        enum Staged
+        {
+            StagedNothing,
+            StagedUrl,
+            StagedName,
+            StagedValue
+        };
+
+        void stage( Staged what, const char* data, size_t length );
+        void flushStaged();
+        void trimStaging();
+
+        typedef QVarLengthArray< char, 256 > StagingBuffer;
+
+    private:
+        // A finished response, waiting for its last byte to be handed to the socket
+        struct PendingRecord
+        {
+            qint64          mEndOffset;
+            QElapsedTimer   mTimer;
+            const void*     mRoute;         // ContentProvider or IRequestHandler
+            RequestRecord   mRecord;
+        };
 
     private:
         int             mConnectionId;
         ServerPrivate*  mServer;
         Session*        mSession;
-        QTcpSocket*     mSocket;
-        http_parser*    mParser;
-        HeaderName      mNextHeader;
+        Transport*      mTransport;
+        http_parser     mParser;
         Request::Data*  mNextRequest;
-        QByteArray      mOutput;
+        Staged          mStaged;
+        int             mStagedValue;   // Offset of the value; the header's name precedes it
+        StagingBuffer   mStaging;       // Grows as needed; trimmed after each header block
+        QHostAddress    mRemoteAddr;
+        quint16         mRemotePort;
+        BodySegments    mOutput;
+        int             mOutputOffset;  // Bytes of mOutput.first() that were already written
+        qint64          mOutputBytes;   // Bytes in mOutput that are still to be written
+        QPointer<Shaper> mShaper;
+        MetricsShard*   mMetrics;
+        RequestPool*    mPool;
+        QList< Request* > mRetired;     // Done; recycled once the current event is handled
+        TokenBucket     mBucket;
+        bool            mAboveHighWater;
+        bool            mCloseWhenDone;
+        bool            mDraining;      // Close after the next response
+        bool            mAnswered;      // At least one response was completed
+        int             mInFlight;      // Requests dispatched, but not answered yet
+        qint64          mBytesQueued;   // Totals over the connection's lifetime
+        qint64          mBytesSent;
+        QList< PendingRecord > mPendingRecords;
+        WebSocket*      mWebSocket;     // Once upgraded, everything read goes there
 
     private:
         static int onMessageBegin( http_parser* parser );
         static int onUrl( http_parser *parser, const char* at, size_t length );
         static int onHeaderField( http_parser *parser, const char* at, size_t length );
         static int onHeaderValue( http_parser* parser, const char* at, size_t length );
+        static int onHeaders( http_parser* parser, const http_header_span* headers,
+                              size_t count );
         static int onHeadersComplete( http_parser* parser );
         static int onBody( http_parser* parser, const char* at, size_t length );
         static int onMessageComplete( http_parser* parser );
 
+        static const qint64 sHighWaterMark = 256 * 1024;
+        static const qint64 sLowWaterMark = 64 * 1024;
+        static const int sReadChunk = 16 * 1024;
+        static const int sDrainGrace = 2000;   // msecs an unused connection gets while draining
+        static const int sStagingKeep = 4096;   // Larger staging buffers are freed after a request
+
         static int sNextId;
         static const http_parser_settings sParserCallbacks;
     };
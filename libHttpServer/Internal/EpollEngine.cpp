@@ -0,0 +1,292 @@
+/*
+ * Modern CI
+ * Copyright (C) 2012-2013 Sascha Cunz <sascha@babbelbox.org>
+ *
+ * This program is free software; you can redistribute it and/or modify it under the terms of the
+ * GNU General Public License (Version 2) as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without
+ * even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this program; if
+ * not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+
+#include <QSocketNotifier>
+
+#include "libHttpServer/Internal/EpollEngine.hpp"
+
+namespace HTTP
+{
+
+    EpollLoop::EpollLoop( QObject* parent )
+        : QObject( parent )
+        , mEpollFd( ::epoll_create1( EPOLL_CLOEXEC ) )
+        , mNotifier( NULL )
+    {
+        if( mEpollFd != -1 )
+        {
+            mNotifier = new QSocketNotifier( mEpollFd, QSocketNotifier::Read, this );
+            connect( mNotifier, SIGNAL(activated(int)), this, SLOT(poll()) );
+        }
+    }
+
+    EpollLoop::~EpollLoop()
+    {
+        delete mNotifier;
+
+        if( mEpollFd != -1 )
+        {
+            ::close( mEpollFd );
+        }
+    }
+
+    bool EpollLoop::isValid() const
+    {
+        return mEpollFd != -1;
+    }
+
+    /*
+     * Registered once for everything; with edge triggering that costs nothing while we are not
+     * interested in writability.
+     */
+    bool EpollLoop::add( int socketDescriptor, EpollTransport* transport )
+    {
+        struct epoll_event ev;
+        ev.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+        ev.data.ptr = transport;
+
+        return ::epoll_ctl( mEpollFd, EPOLL_CTL_ADD, socketDescriptor, &ev ) == 0;
+    }
+
+    /*
+     * Transports are only deleted along with their connection, which is never done synchronously
+     * from an event; so every pointer in a batch stays valid while we work through it.
+     */
+    void EpollLoop::poll()
+    {
+        struct epoll_event events[ MaxEvents ];
+
+        forever
+        {
+            int count = ::epoll_wait( mEpollFd, events, MaxEvents, 0 );
+
+            for( int i = 0; i < count; i++ )
+            {
+                EpollTransport* t = static_cast< EpollTransport* >( events[ i ].data.ptr );
+                t->handleEvents( events[ i ].events );
+            }
+
+            if( count < MaxEvents )
+            {
+                return;
+            }
+        }
+    }
+
+    EpollTransport::EpollTransport( int socketDescriptor )
+        : mFd( socketDescriptor )
+        , mPendingOffset( 0 )
+        , mClosing( false )
+        , mEof( false )
+        , mPeerPort( 0 )
+    {
+        ::fcntl( mFd, F_SETFL, ::fcntl( mFd, F_GETFL ) | O_NONBLOCK );
+        socketPeer( mFd, mPeerAddress, mPeerPort );
+    }
+
+    EpollTransport::~EpollTransport()
+    {
+        // Closing the descriptor also takes it out of the epoll set
+        if( mFd != -1 )
+        {
+            ::close( mFd );
+        }
+    }
+
+    /*
+     * The caller has to read until we return 0, otherwise the edge is lost.
+     */
+    qint64 EpollTransport::read( char* data, qint64 maxLength )
+    {
+        while( mFd != -1 && !mEof )
+        {
+            ssize_t n = ::recv( mFd, data, size_t( maxLength ), 0 );
+            if( n > 0 )
+            {
+                return n;
+            }
+
+            if( n < 0 && errno == EINTR )
+            {
+                continue;
+            }
+
+            if( n == 0 || ( errno != EAGAIN && errno != EWOULDBLOCK ) )
+            {
+                mEof = true;
+            }
+            break;
+        }
+
+        return 0;
+    }
+
+    qint64 EpollTransport::write( const char* data, qint64 length )
+    {
+        if( mFd == -1 || mClosing )
+        {
+            return -1;
+        }
+
+        qint64 sent = 0;
+        if( mPending.isEmpty() )
+        {
+            while( sent < length )
+            {
+                ssize_t n = ::send( mFd, data + sent, size_t( length - sent ), MSG_NOSIGNAL );
+                if( n > 0 )
+                {
+                    sent += n;
+                    continue;
+                }
+
+                if( n < 0 && errno == EINTR )
+                {
+                    continue;
+                }
+
+                // EPOLLERR reports anything else
+                break;
+            }
+        }
+
+        if( sent < length )
+        {
+            mPending.append( data + sent, int( length - sent ) );
+        }
+
+        return length;
+    }
+
+    qint64 EpollTransport::bytesToWrite() const
+    {
+        return mPending.count() - mPendingOffset;
+    }
+
+    void EpollTransport::disconnectFromHost()
+    {
+        mClosing = true;
+
+        if( mPending.isEmpty() )
+        {
+            shutDown();
+        }
+    }
+
+    void EpollTransport::abort()
+    {
+        mPending.clear();
+        mPendingOffset = 0;
+        shutDown();
+    }
+
+    QHostAddress EpollTransport::peerAddress() const
+    {
+        return mPeerAddress;
+    }
+
+    quint16 EpollTransport::peerPort() const
+    {
+        return mPeerPort;
+    }
+
+    void EpollTransport::handleEvents( quint32 events )
+    {
+        if( mFd == -1 )
+        {
+            return;
+        }
+
+        if( events & EPOLLERR )
+        {
+            abort();
+            return;
+        }
+
+        if( events & EPOLLOUT )
+        {
+            flush();
+            written();
+        }
+
+        if( events & ( EPOLLIN | EPOLLRDHUP | EPOLLHUP ) )
+        {
+            readable();
+
+            // Like QTcpSocket, we give up on the connection when the peer stops sending
+            if( mEof )
+            {
+                abort();
+            }
+        }
+    }
+
+    /*
+     * Leaves the descriptor open when we are deleted.
+     */
+    void EpollTransport::disown()
+    {
+        mFd = -1;
+    }
+
+    void EpollTransport::flush()
+    {
+        while( mFd != -1 && mPendingOffset < mPending.count() )
+        {
+            ssize_t n = ::send( mFd, mPending.constData() + mPendingOffset,
+                                size_t( mPending.count() - mPendingOffset ), MSG_NOSIGNAL );
+            if( n > 0 )
+            {
+                mPendingOffset += int( n );
+                continue;
+            }
+
+            if( n < 0 && errno == EINTR )
+            {
+                continue;
+            }
+            return;
+        }
+
+        mPending.clear();
+        mPendingOffset = 0;
+
+        if( mClosing )
+        {
+            shutDown();
+        }
+    }
+
+    void EpollTransport::shutDown()
+    {
+        if( mFd == -1 )
+        {
+            return;
+        }
+
+        ::close( mFd );
+        mFd = -1;
+
+        closed();
+    }
+
+}
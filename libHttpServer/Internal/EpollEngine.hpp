@@ -0,0 +1,97 @@
+/*
+ * Modern CI
+ * Copyright (C) 2012-2013 Sascha Cunz <sascha@babbelbox.org>
+ *
+ * This program is free software; you can redistribute it and/or modify it under the terms of the
+ * GNU General Public License (Version 2) as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without
+ * even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this program; if
+ * not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef HTTP_EPOLL_ENGINE_HPP
+#define HTTP_EPOLL_ENGINE_HPP
+
+#include <QObject>
+#include <QByteArray>
+
+#include "libHttpServer/Internal/Transport.hpp"
+
+class QSocketNotifier;
+
+namespace HTTP
+{
+
+    class EpollTransport;
+
+    /*
+     * One edge triggered epoll set per worker thread. The Qt event loop only watches the epoll
+     * descriptor itself, so its timers and queued calls keep working, while the connections'
+     * sockets never reach Qt.
+     */
+    class EpollLoop : public QObject
+    {
+        Q_OBJECT
+    public:
+        EpollLoop( QObject* parent );
+        ~EpollLoop();
+
+    public:
+        bool isValid() const;
+        bool add( int socketDescriptor, EpollTransport* transport );
+
+    private slots:
+        void poll();
+
+    private:
+        enum { MaxEvents = 256 };
+
+        int                 mEpollFd;
+        QSocketNotifier*    mNotifier;
+    };
+
+    /*
+     * A non-blocking socket in an EpollLoop. Whatever the kernel does not take right away is
+     * kept in mPending and sent as soon as the socket becomes writable again.
+     */
+    class EpollTransport : public Transport
+    {
+    public:
+        EpollTransport( int socketDescriptor );
+        ~EpollTransport();
+
+    public:
+        qint64 read( char* data, qint64 maxLength );
+        qint64 write( const char* data, qint64 length );
+        qint64 bytesToWrite() const;
+        void disconnectFromHost();
+        void abort();
+        QHostAddress peerAddress() const;
+        quint16 peerPort() const;
+
+    public:
+        void handleEvents( quint32 events );
+        void disown();
+
+    private:
+        void flush();
+        void shutDown();
+
+    private:
+        int             mFd;
+        QByteArray      mPending;
+        int             mPendingOffset;
+        bool            mClosing;       // Close once mPending is sent
+        bool            mEof;           // The peer closed or the socket failed
+        QHostAddress    mPeerAddress;
+        quint16         mPeerPort;
+    };
+
+}
+
+#endif
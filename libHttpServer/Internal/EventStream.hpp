@@ -0,0 +1,92 @@
+/*
+ * Modern CI
+ * Copyright (C) 2012-2013 Sascha Cunz <sascha@babbelbox.org>
+ *
+ * This program is free software; you can redistribute it and/or modify it under the terms of the
+ * GNU General Public License (Version 2) as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without
+ * even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this program; if
+ * not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef HTTP_EVENT_STREAM_PRIVATE_HPP
+#define HTTP_EVENT_STREAM_PRIVATE_HPP
+
+#include <QEvent>
+#include <QObject>
+#include <QVector>
+#include <QAtomicInt>
+
+namespace HTTP
+{
+
+    class Connection;
+    class Request;
+    class Response;
+
+    /*
+     * One event, on its way to a worker thread's subscribers. Both buffers are shared by all of
+     * them.
+     */
+    class EventStreamEvent : public QEvent
+    {
+    public:
+        EventStreamEvent( const QByteArray& text, const QByteArray& chunk, bool heartbeat );
+
+    public:
+        static QEvent::Type type();
+
+    public:
+        QByteArray  mText;          // For HTTP/1.0 clients
+        QByteArray  mChunk;         // mText, framed for chunked encoding
+        bool        mHeartbeat;
+    };
+
+    /*
+     * The subscribers of one EventStreamProvider that are served by one thread. It lives in that
+     * thread and is only touched there, except for mCount.
+     */
+    class EventStreamBucket : public QObject
+    {
+        Q_OBJECT
+    public:
+        EventStreamBucket();
+        ~EventStreamBucket();
+
+    public:
+        void subscribe( Request* request, Response* response );
+
+    public:
+        QAtomicInt  mCount;
+
+    protected:
+        void customEvent( QEvent* event );
+
+    private slots:
+        void requestDestroyed( QObject* request );
+        void connectionDraining();
+
+    private:
+        struct Subscriber
+        {
+            QObject*    mRequest;       // Only compared; it may be gone already
+            Connection* mConnection;    // Goes with mRequest
+            Response*   mResponse;
+            bool        mIdle;          // Nothing was sent since the last heartbeat
+        };
+
+        void deliver( const EventStreamEvent* event );
+        void end( int index, bool requestGone );
+
+    private:
+        QVector< Subscriber > mSubscribers;
+    };
+
+}
+
+#endif
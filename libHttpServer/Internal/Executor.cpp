@@ -0,0 +1,298 @@
+/*
+ * Modern CI
+ * Copyright (C) 2012-2013 Sascha Cunz <sascha@babbelbox.org>
+ *
+ * This program is free software; you can redistribute it and/or modify it under the terms of the
+ * GNU General Public License (Version 2) as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without
+ * even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this program; if
+ * not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <QCoreApplication>
+
+#include "libHttpServer/OffloadJob.hpp"
+
+#include "libHttpServer/Internal/Executor.hpp"
+#include "libHttpServer/Internal/Request.hpp"
+
+namespace HTTP
+{
+
+    WorkStealingExecutor::Worker::Worker( WorkStealingExecutor* executor, int index )
+        : mExecutor( executor )
+        , mIndex( index )
+    {
+    }
+
+    void WorkStealingExecutor::Worker::run()
+    {
+        mExecutor->work( mIndex );
+    }
+
+    WorkStealingExecutor::WorkStealingExecutor()
+        : mThreadCount( 0 )
+        , mStarted( 0 )
+        , mNextQueue( 0 )
+        , mPending( 0 )
+        , mStopping( false )
+    {
+    }
+
+    WorkStealingExecutor::~WorkStealingExecutor()
+    {
+        stop();
+    }
+
+    /*
+     * Takes effect when the first task is submitted; later changes are ignored.
+     */
+    void WorkStealingExecutor::setThreadCount( int count )
+    {
+        mThreadCount = qMax( count, 0 );
+    }
+
+    int WorkStealingExecutor::threadCount() const
+    {
+        return mThreadCount ? mThreadCount : qMax( QThread::idealThreadCount(), 1 );
+    }
+
+    void WorkStealingExecutor::start()
+    {
+        QMutexLocker l( &mStartMutex );
+
+        if( mStarted || mStopping )
+        {
+            return;
+        }
+
+        int count = threadCount();
+        for( int i = 0; i < count; i++ )
+        {
+            mQueues.append( new Queue );
+        }
+
+        for( int i = 0; i < count; i++ )
+        {
+            Worker* w = new Worker( this, i );
+            mWorkers.append( w );
+            w->start();
+        }
+
+        mStarted.fetchAndStoreOrdered( 1 );
+    }
+
+    /*
+     * Tasks are deleted after they ran if QRunnable::autoDelete() says so. Once the executor is
+     * stopped, new tasks are deleted right away.
+     */
+    void WorkStealingExecutor::submit( QRunnable* task )
+    {
+        if( !mStarted )
+        {
+            start();
+        }
+
+        QMutexLocker l( &mIdleMutex );
+
+        if( mStopping )
+        {
+            delete task;
+            return;
+        }
+
+        int index = currentWorker();
+        bool local = index != -1;
+        if( !local )
+        {
+            index = int( quint32( mNextQueue.fetchAndAddRelaxed( 1 ) ) % quint32( mQueues.count() ) );
+        }
+
+        Queue* q = mQueues[ index ];
+        {
+            QMutexLocker ql( &q->mMutex );
+            if( local )
+            {
+                q->mLocal.append( task );
+            }
+            else
+            {
+                q->mTasks.append( task );
+            }
+        }
+
+        mPending.ref();
+        mIdle.wakeOne();
+    }
+
+    /*
+     * Lets the workers finish all queued tasks, then ends them.
+     */
+    void WorkStealingExecutor::stop()
+    {
+        QMutexLocker sl( &mStartMutex );
+
+        {
+            QMutexLocker l( &mIdleMutex );
+            mStopping = true;
+            mIdle.wakeAll();
+        }
+
+        foreach( Worker* w, mWorkers )
+        {
+            w->wait();
+        }
+
+        qDeleteAll( mWorkers );
+        mWorkers.clear();
+        qDeleteAll( mQueues );
+        mQueues.clear();
+    }
+
+    void WorkStealingExecutor::work( int index )
+    {
+        forever
+        {
+            QRunnable* task = take( index );
+            if( task )
+            {
+                task->run();
+                if( task->autoDelete() )
+                {
+                    delete task;
+                }
+                continue;
+            }
+
+            QMutexLocker l( &mIdleMutex );
+            if( !mPending )
+            {
+                if( mStopping )
+                {
+                    return;
+                }
+                mIdle.wait( &mIdleMutex );
+            }
+        }
+    }
+
+    /*
+     * Tasks we spawned ourselves are used as a stack, which keeps a task that spawned others
+     * close to its children in the cache; they are finished before we take the next task from
+     * outside, which are served in order. Stealing goes for the oldest task of another queue and
+     * never waits for its lock; should we miss a task that way, mPending brings us back.
+     */
+    QRunnable* WorkStealingExecutor::take( int index )
+    {
+        Queue* own = mQueues[ index ];
+        {
+            QMutexLocker l( &own->mMutex );
+            if( !own->mLocal.isEmpty() )
+            {
+                mPending.deref();
+                return own->mLocal.takeLast();
+            }
+            if( !own->mTasks.isEmpty() )
+            {
+                mPending.deref();
+                return own->mTasks.takeFirst();
+            }
+        }
+
+        int count = mQueues.count();
+        for( int i = 1; i < count; i++ )
+        {
+            Queue* victim = mQueues[ ( index + i ) % count ];
+            if( !victim->mMutex.tryLock() )
+            {
+                continue;
+            }
+
+            QRunnable* task = NULL;
+            if( !victim->mTasks.isEmpty() )
+            {
+                mPending.deref();
+                task = victim->mTasks.takeFirst();
+            }
+            else if( !victim->mLocal.isEmpty() )
+            {
+                mPending.deref();
+                task = victim->mLocal.takeFirst();
+            }
+            victim->mMutex.unlock();
+
+            if( task )
+            {
+                return task;
+            }
+        }
+
+        return NULL;
+    }
+
+    int WorkStealingExecutor::currentWorker() const
+    {
+        Worker* w = dynamic_cast< Worker* >( QThread::currentThread() );
+        return w && w->mExecutor == this ? w->mIndex : -1;
+    }
+
+    OffloadTask::OffloadTask( OffloadJob* job, Request* request, QObject* target )
+        : mJob( job )
+        , mRequest( request )
+        , mGeneration( request->d->mGeneration )
+        , mTarget( target )
+    {
+        // OffloadEvent takes care of us
+        setAutoDelete( false );
+    }
+
+    OffloadTask::~OffloadTask()
+    {
+        delete mJob;
+    }
+
+    void OffloadTask::run()
+    {
+        mJob->run();
+        QCoreApplication::postEvent( mTarget, new OffloadEvent( this ) );
+    }
+
+    /*
+     * Back on the connection's thread, where the QPointer can be trusted.
+     */
+    void OffloadTask::deliver()
+    {
+        if( mRequest && mRequest->d->mGeneration == mGeneration )
+        {
+            mJob->completed( mRequest );
+        }
+    }
+
+    OffloadEvent::OffloadEvent( OffloadTask* task )
+        : QEvent( type() )
+        , mTask( task )
+    {
+    }
+
+    OffloadEvent::~OffloadEvent()
+    {
+        delete mTask;
+    }
+
+    QEvent::Type OffloadEvent::type()
+    {
+        static int sType = QEvent::registerEventType();
+        return QEvent::Type( sType );
+    }
+
+    OffloadTask* OffloadEvent::task() const
+    {
+        return mTask;
+    }
+
+}
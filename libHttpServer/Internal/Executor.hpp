@@ -0,0 +1,135 @@
+/*
+ * Modern CI
+ * Copyright (C) 2012-2013 Sascha Cunz <sascha@babbelbox.org>
+ *
+ * This program is free software; you can redistribute it and/or modify it under the terms of the
+ * GNU General Public License (Version 2) as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without
+ * even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this program; if
+ * not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef HTTP_EXECUTOR_HPP
+#define HTTP_EXECUTOR_HPP
+
+#include <QEvent>
+#include <QList>
+#include <QMutex>
+#include <QPointer>
+#include <QRunnable>
+#include <QThread>
+#include <QVector>
+#include <QWaitCondition>
+
+namespace HTTP
+{
+
+    class OffloadJob;
+    class Request;
+
+    /*
+     * A fixed set of threads, each with its own queue. Tasks submitted from outside are spread
+     * round robin over the queues and run first in, first out, so none of them waits behind
+     * newer ones. Tasks a worker submits itself are kept apart and run newest first. A worker
+     * whose queue ran dry steals the oldest task of the others, so a burst on one queue is
+     * spread across all cores.
+     *
+     * Every queue has its own mutex; the idle mutex is only taken to wake up or put to sleep a
+     * worker.
+     */
+    class WorkStealingExecutor
+    {
+    public:
+        WorkStealingExecutor();
+        ~WorkStealingExecutor();
+
+    public:
+        void setThreadCount( int count );
+        int threadCount() const;
+
+        void submit( QRunnable* task );
+        void stop();
+
+    private:
+        class Worker : public QThread
+        {
+        public:
+            Worker( WorkStealingExecutor* executor, int index );
+
+        protected:
+            void run();
+
+        private:
+            friend class WorkStealingExecutor;
+            WorkStealingExecutor*   mExecutor;
+            int                     mIndex;
+        };
+
+        struct Queue
+        {
+            QMutex              mMutex;
+            QList< QRunnable* > mTasks;     // Submitted from outside; FIFO
+            QList< QRunnable* > mLocal;     // Submitted by the queue's worker; LIFO
+        };
+
+        void start();
+        void work( int index );
+        QRunnable* take( int index );
+        int currentWorker() const;
+
+    private:
+        int                 mThreadCount;   // 0 = QThread::idealThreadCount()
+        QMutex              mStartMutex;
+        QAtomicInt          mStarted;
+        QVector< Queue* >   mQueues;
+        QList< Worker* >    mWorkers;
+        QAtomicInt          mNextQueue;
+        QAtomicInt          mPending;       // Tasks in any queue
+        QMutex              mIdleMutex;
+        QWaitCondition      mIdle;
+        bool                mStopping;      // Guarded by mIdleMutex
+    };
+
+    /*
+     * Carries an OffloadJob to a compute thread and its result back to the Establisher that owns
+     * the request's connection. The request is only looked at on that thread again.
+     */
+    class OffloadTask : public QRunnable
+    {
+    public:
+        OffloadTask( OffloadJob* job, Request* request, QObject* target );
+        ~OffloadTask();
+
+    public:
+        void run();
+        void deliver();
+
+    private:
+        OffloadJob*         mJob;
+        QPointer< Request > mRequest;
+        quint32             mGeneration;    // Tells a recycled request from the one we serve
+        QObject*            mTarget;
+    };
+
+    class OffloadEvent : public QEvent
+    {
+    public:
+        OffloadEvent( OffloadTask* task );
+        ~OffloadEvent();
+
+    public:
+        static QEvent::Type type();
+        OffloadTask* task() const;
+
+    private:
+        OffloadTask*    mTask;
+    };
+
+}
+
+#endif
@@ -0,0 +1,139 @@
+/*
+ * Modern CI
+ * Copyright (C) 2012-2013 Sascha Cunz <sascha@babbelbox.org>
+ *
+ * This program is free software; you can redistribute it and/or modify it under the terms of the
+ * GNU General Public License (Version 2) as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without
+ * even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this program; if
+ * not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <limits.h>
+
+#include "libHttpServer/Internal/Http.hpp"
+#include "libHttpServer/Internal/MappedFile.hpp"
+
+namespace HTTP
+{
+
+    Q_GLOBAL_STATIC( MappedFilePool, sMappedFilePool )
+
+    MappedFile::MappedFile( const QString& fileName, const QByteArray& eTag )
+        : mFile( fileName )
+        , mData( NULL )
+        , mSize( 0 )
+        , mETag( eTag )
+    {
+    }
+
+    MappedFile::~MappedFile()
+    {
+        if( mData )
+        {
+            mFile.unmap( mData );
+            mData = NULL;
+        }
+    }
+
+    bool MappedFile::map()
+    {
+        if( !mFile.open( QFile::ReadOnly ) )
+        {
+            return false;
+        }
+
+        mSize = mFile.size();
+
+        // QByteArray can only address INT_MAX bytes
+        if( mSize <= 0 || mSize > INT_MAX )
+        {
+            return false;
+        }
+
+        mData = mFile.map( 0, mSize );
+        return mData != NULL;
+    }
+
+    QByteArray MappedFile::bytes() const
+    {
+        return QByteArray::fromRawData( reinterpret_cast< const char* >( mData ), int( mSize ) );
+    }
+
+    qint64 MappedFile::size() const
+    {
+        return mSize;
+    }
+
+    QByteArray MappedFile::eTag() const
+    {
+        return mETag;
+    }
+
+    MappedFilePool* MappedFilePool::instance()
+    {
+        return sMappedFilePool();
+    }
+
+    MappedFilePtr MappedFilePool::map( const QString& fileName, const QByteArray& eTag )
+    {
+        QMutexLocker l( &mMutex );
+
+        MappedFilePtr mapping = mFiles.value( fileName ).toStrongRef();
+        if( mapping && mapping->eTag() == eTag )
+        {
+            return mapping;
+        }
+
+        // Either unmapped or the file changed. Holders of an old mapping keep it alive.
+        mapping = MappedFilePtr( new MappedFile( fileName, eTag ) );
+        if( !mapping->map() )
+        {
+            mFiles.remove( fileName );
+            return MappedFilePtr();
+        }
+
+        purge();
+        mFiles.insert( fileName, mapping.toWeakRef() );
+
+        HTTP_DBG( "Mapped %s (%lli bytes)", qPrintable( fileName ), mapping->size() );
+
+        return mapping;
+    }
+
+    void MappedFilePool::purge()
+    {
+        Files::Iterator it = mFiles.begin();
+        while( it != mFiles.end() )
+        {
+            if( it.value().isNull() )
+                it = mFiles.erase( it );
+            else
+                ++it;
+        }
+    }
+
+    BodySegment::BodySegment()
+        : mRateLimit( 0 )
+    {
+    }
+
+    BodySegment::BodySegment( const QByteArray& data )
+        : mData( data )
+        , mRateLimit( 0 )
+    {
+    }
+
+    BodySegment::BodySegment( const MappedFilePtr& mapping )
+        : mData( mapping->bytes() )
+        , mMapping( mapping )
+        , mRateLimit( 0 )
+    {
+    }
+
+}
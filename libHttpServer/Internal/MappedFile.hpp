@@ -0,0 +1,105 @@
+/*
+ * Modern CI
+ * Copyright (C) 2012-2013 Sascha Cunz <sascha@babbelbox.org>
+ *
+ * This program is free software; you can redistribute it and/or modify it under the terms of the
+ * GNU General Public License (Version 2) as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without
+ * even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this program; if
+ * not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef HTTP_MAPPED_FILE_HPP
+#define HTTP_MAPPED_FILE_HPP
+
+#include <QFile>
+#include <QHash>
+#include <QMutex>
+#include <QSharedPointer>
+#include <QWeakPointer>
+
+#include "libHttpServer/Http.hpp"
+
+namespace HTTP
+{
+
+    /*
+     * A read-only memory mapping of a file. The mapping lives as long as the last reference to it;
+     * the file is kept open for that time since Qt unmaps on close.
+     *
+     * Note: Truncating a file while it is mapped will make the next access to the vanished pages
+     * fault. Static content is expected to be replaced (rename) rather than rewritten in place.
+     */
+    class MappedFile
+    {
+    public:
+        ~MappedFile();
+
+    public:
+        QByteArray bytes() const;
+        qint64 size() const;
+        QByteArray eTag() const;
+
+    private:
+        friend class MappedFilePool;
+        MappedFile( const QString& fileName, const QByteArray& eTag );
+        bool map();
+
+    private:
+        QFile       mFile;
+        uchar*      mData;
+        qint64      mSize;
+        QByteArray  mETag;
+    };
+
+    typedef QSharedPointer< MappedFile > MappedFilePtr;
+
+    /*
+     * Process wide pool of mappings, so concurrent requests for the same file (from any worker
+     * thread) share a single mapping. The pool only holds weak references.
+     */
+    class MappedFilePool
+    {
+    public:
+        static MappedFilePool* instance();
+
+    public:
+        MappedFilePtr map( const QString& fileName, const QByteArray& eTag );
+
+    private:
+        void purge();
+
+    private:
+        typedef QHash< QString, QWeakPointer< MappedFile > > Files;
+        QMutex  mMutex;
+        Files   mFiles;
+    };
+
+    /*
+     * A piece of output. If mMapping is set, mData does not own its bytes but refers into that
+     * mapping (which it keeps alive). mRateLimit is the bandwidth limit of the provider that
+     * wrote it, as of then.
+     */
+    class BodySegment
+    {
+    public:
+        BodySegment();
+        BodySegment( const QByteArray& data );
+        BodySegment( const MappedFilePtr& mapping );
+
+    public:
+        QByteArray      mData;
+        MappedFilePtr   mMapping;
+        qint64          mRateLimit;     // Bytes per second; 0 = unlimited
+    };
+
+    typedef QList< BodySegment > BodySegments;
+
+}
+
+#endif
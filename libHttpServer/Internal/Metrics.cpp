@@ -0,0 +1,242 @@
+/*
+ * Modern CI
+ * Copyright (C) 2012-2013 Sascha Cunz <sascha@babbelbox.org>
+ *
+ * This program is free software; you can redistribute it and/or modify it under the terms of the
+ * GNU General Public License (Version 2) as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without
+ * even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this program; if
+ * not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "libHttpServer/Metrics.hpp"
+
+#include "libHttpServer/Internal/Metrics.hpp"
+
+namespace HTTP
+{
+
+    LatencyHistogram::LatencyHistogram()
+    {
+    }
+
+    int LatencyHistogram::bucketOf( qint64 usecs )
+    {
+        if( usecs < LinearBuckets )
+        {
+            return usecs < 0 ? 0 : int( usecs );
+        }
+
+        if( usecs >> ( MaxMagnitude + 1 ) )
+        {
+            return BucketCount - 1;
+        }
+
+        // Position of the highest set bit; at least 6 here
+        quint64 v = quint64( usecs );
+        int magnitude = 0;
+        for( int step = 32; step; step >>= 1 )
+        {
+            if( v >> step )
+            {
+                v >>= step;
+                magnitude += step;
+            }
+        }
+
+        int shift = magnitude - 5;
+        int sub = int( usecs >> shift ) - SubBuckets;
+        return LinearBuckets + ( magnitude - 6 ) * SubBuckets + sub;
+    }
+
+    qint64 LatencyHistogram::highestValueOf( int bucket )
+    {
+        if( bucket < LinearBuckets )
+        {
+            return bucket;
+        }
+
+        int k = bucket - LinearBuckets;
+        int shift = k / SubBuckets + 1;
+        qint64 top = SubBuckets + k % SubBuckets;
+        return ( ( top + 1 ) << shift ) - 1;
+    }
+
+    void LatencyHistogram::record( qint64 usecs )
+    {
+        mBuckets[ bucketOf( usecs ) ]++;
+        mSum += usecs;
+        if( usecs > mMax )
+        {
+            mMax.store( usecs );
+        }
+    }
+
+    void LatencyHistogram::add( const LatencyHistogram& other )
+    {
+        for( int i = 0; i < BucketCount; i++ )
+        {
+            mBuckets[ i ] += other.mBuckets[ i ];
+        }
+        mSum += other.mSum;
+        if( other.mMax > mMax )
+        {
+            mMax.store( other.mMax );
+        }
+    }
+
+    LatencySummary LatencyHistogram::summary() const
+    {
+        LatencySummary s;
+
+        // Counted from the buckets, which might be ahead of mSum while the writer is busy
+        for( int i = 0; i < BucketCount; i++ )
+        {
+            s.mCount += mBuckets[ i ];
+        }
+
+        s.mSum = mSum;
+        s.mMax = mMax;
+
+        if( !s.mCount )
+        {
+            return s;
+        }
+
+        const double quantiles[ 3 ] = { 0.5, 0.99, 0.999 };
+        qint64* results[ 3 ] = { &s.mP50, &s.mP99, &s.mP999 };
+
+        qint64 seen = 0;
+        int q = 0;
+        for( int i = 0; i < BucketCount && q < 3; i++ )
+        {
+            seen += mBuckets[ i ];
+            while( q < 3 && seen >= qint64( quantiles[ q ] * s.mCount + 0.5 ) && seen )
+            {
+                *results[ q++ ] = qMin( highestValueOf( i ), s.mMax );
+            }
+        }
+
+        return s;
+    }
+
+    MetricsShard::MetricsShard()
+    {
+    }
+
+    MetricsShard::~MetricsShard()
+    {
+        qDeleteAll( mRoutes );
+    }
+
+    RouteHistograms* MetricsShard::route( const void* handler )
+    {
+        RouteHistograms* r = mRoutes.value( handler );
+        if( !r )
+        {
+            r = new RouteHistograms;
+
+            QMutexLocker l( &mRoutesMutex );
+            mRoutes.insert( handler, r );
+        }
+        return r;
+    }
+
+    void MetricsShard::addTo( RouteHistogramsHash& routes ) const
+    {
+        QMutexLocker l( &mRoutesMutex );
+
+        RouteHistogramsHash::ConstIterator it = mRoutes.constBegin();
+        while( it != mRoutes.constEnd() )
+        {
+            RouteHistograms*& merged = routes[ it.key() ];
+            if( !merged )
+            {
+                merged = new RouteHistograms;
+            }
+
+            merged->mParse.add( it.value()->mParse );
+            merged->mHandler.add( it.value()->mHandler );
+            merged->mTotal.add( it.value()->mTotal );
+            ++it;
+        }
+    }
+
+    void MetricsShard::countResponse( int statusCode )
+    {
+        if( statusCode >= 0 && statusCode < MaxStatusCode )
+        {
+            mResponses[ statusCode ]++;
+        }
+    }
+
+    void MetricsShard::addTo( ServerMetrics& metrics ) const
+    {
+        metrics.mActiveConnections.append( mConnectionsOpened - mConnectionsClosed );
+        metrics.mRequests += mRequests;
+        metrics.mBytesIn += mBytesIn;
+        metrics.mBytesOut += mBytesOut;
+        metrics.mParserErrors += mParserErrors;
+        metrics.mShapedBytes += mShapedBytes;
+        metrics.mShaperWaits += mShaperWaits;
+
+        for( int i = 0; i < MaxStatusCode; i++ )
+        {
+            if( mResponses[ i ] )
+            {
+                metrics.mResponses[ i ] += mResponses[ i ];
+            }
+        }
+    }
+
+    MetricsRegistry::MetricsRegistry()
+    {
+    }
+
+    MetricsRegistry::~MetricsRegistry()
+    {
+        qDeleteAll( mShards );
+    }
+
+    /*
+     * Shards are kept until the server goes away, even if their thread is removed; otherwise the
+     * totals would jump backwards.
+     */
+    MetricsShard* MetricsRegistry::addShard()
+    {
+        QMutexLocker l( &mMutex );
+
+        MetricsShard* shard = new MetricsShard;
+        mShards.append( shard );
+        return shard;
+    }
+
+    void MetricsRegistry::collect( ServerMetrics& metrics ) const
+    {
+        metrics.mAcceptedConnections = mAcceptedConnections;
+
+        QMutexLocker l( &mMutex );
+        foreach( const MetricsShard* shard, mShards )
+        {
+            shard->addTo( metrics );
+        }
+    }
+
+    /*
+     * Merges the latency histograms of all shards, per route. The caller owns the new entries.
+     */
+    void MetricsRegistry::collect( RouteHistogramsHash& routes ) const
+    {
+        QMutexLocker l( &mMutex );
+        foreach( const MetricsShard* shard, mShards )
+        {
+            shard->addTo( routes );
+        }
+    }
+
+}
@@ -0,0 +1,183 @@
+/*
+ * Modern CI
+ * Copyright (C) 2012-2013 Sascha Cunz <sascha@babbelbox.org>
+ *
+ * This program is free software; you can redistribute it and/or modify it under the terms of the
+ * GNU General Public License (Version 2) as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without
+ * even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this program; if
+ * not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef HTTP_METRICS_PRIVATE_HPP
+#define HTTP_METRICS_PRIVATE_HPP
+
+#include <QList>
+#include <QHash>
+#include <QMutex>
+
+#if defined( _MSC_VER ) && !defined( __GNUC__ )
+#include <intrin.h>
+#endif
+
+namespace HTTP
+{
+
+    class ServerMetrics;
+    class LatencySummary;
+
+    /*
+     * A 64 bit counter with a single writer, which other threads may read at any time. Relaxed
+     * atomic loads and stores are all that takes, as nobody else writes; they also keep a read
+     * on a 32 bit target from seeing half an update.
+     */
+    class MetricsCounter
+    {
+    public:
+        MetricsCounter() : mValue( 0 ) {}
+
+    public:
+        #if defined( __GNUC__ )
+        qint64 load() const { return __atomic_load_n( &mValue, __ATOMIC_RELAXED ); }
+        void store( qint64 value ) { __atomic_store_n( &mValue, value, __ATOMIC_RELAXED ); }
+        #else
+        qint64 load() const
+        {
+            return _InterlockedCompareExchange64( const_cast< qint64* >( &mValue ), 0, 0 );
+        }
+
+        void store( qint64 value )
+        {
+            qint64 old = mValue;
+            while( _InterlockedCompareExchange64( &mValue, value, old ) != old )
+            {
+                old = mValue;
+            }
+        }
+        #endif
+
+        operator qint64() const { return load(); }
+        void operator++( int ) { store( load() + 1 ); }
+        void operator+=( qint64 value ) { store( load() + value ); }
+
+    private:
+        qint64  mValue;
+
+    private:
+        Q_DISABLE_COPY( MetricsCounter )
+    };
+
+    /*
+     * Log-linear histogram of durations in microseconds, in the spirit of HdrHistogram: values
+     * below 64 are counted exactly, above that every power of two is split into 32 buckets, so
+     * any reported value is within about 3% of the recorded one. Memory is fixed (about 9 KiB)
+     * and recording is a handful of shifts and an increment.
+     *
+     * Like the shard counters, a histogram has a single writer; readers merge it with add().
+     * Since there is one, mMax does not need a compare and swap either.
+     */
+    class LatencyHistogram
+    {
+    public:
+        enum
+        {
+            LinearBuckets   = 64,
+            SubBuckets      = 32,
+            MaxMagnitude    = 40,   // 2^40 usecs are about 12 days; anything above is clamped
+            BucketCount     = LinearBuckets + ( MaxMagnitude - 5 ) * SubBuckets
+        };
+
+        LatencyHistogram();
+
+    public:
+        void record( qint64 usecs );
+        void add( const LatencyHistogram& other );
+        LatencySummary summary() const;
+
+    private:
+        static int bucketOf( qint64 usecs );
+        static qint64 highestValueOf( int bucket );
+
+    private:
+        MetricsCounter      mSum;
+        MetricsCounter      mMax;
+        MetricsCounter      mBuckets[ BucketCount ];
+    };
+
+    struct RouteHistograms
+    {
+        LatencyHistogram    mParse;
+        LatencyHistogram    mHandler;
+        LatencyHistogram    mTotal;
+    };
+
+    // Keyed by the ContentProvider or IRequestHandler; NULL stands for requests neither handled
+    typedef QHash< const void*, RouteHistograms* > RouteHistogramsHash;
+
+    /*
+     * The counters of one worker thread. Only that thread ever writes them, so no increment has
+     * to be atomic as a whole; a scrape on another thread may read a slightly stale value, which
+     * is fine for monotonic counters.
+     */
+    class MetricsShard
+    {
+    public:
+        enum { MaxStatusCode = 600 };
+
+        MetricsShard();
+        ~MetricsShard();
+
+    public:
+        void addTo( ServerMetrics& metrics ) const;
+        void addTo( RouteHistogramsHash& routes ) const;
+        void countResponse( int statusCode );
+        RouteHistograms* route( const void* handler );
+
+    public:
+        MetricsCounter      mConnectionsOpened;
+        MetricsCounter      mConnectionsClosed;
+        MetricsCounter      mRequests;
+        MetricsCounter      mBytesIn;
+        MetricsCounter      mBytesOut;
+        MetricsCounter      mParserErrors;
+        MetricsCounter      mShapedBytes;       // Sent while any bandwidth limit applied
+        MetricsCounter      mShaperWaits;       // Times a connection had to wait for tokens
+        MetricsCounter      mResponses[ MaxStatusCode ];
+
+    private:
+        // Only the owning thread inserts, so it may look up without the lock
+        mutable QMutex      mRoutesMutex;
+        RouteHistogramsHash mRoutes;
+    };
+
+    /*
+     * Owns the shards. The mutex only guards the list itself; it is taken when an Establisher
+     * is created and when the counters are merged, never while counting.
+     */
+    class MetricsRegistry
+    {
+    public:
+        MetricsRegistry();
+        ~MetricsRegistry();
+
+    public:
+        MetricsShard* addShard();
+        void collect( ServerMetrics& metrics ) const;
+        void collect( RouteHistogramsHash& routes ) const;
+
+    public:
+        MetricsCounter          mAcceptedConnections;   // Written by the listening thread only
+
+    private:
+        mutable QMutex          mMutex;
+        QList< MetricsShard* >  mShards;
+    };
+
+}
+
+#endif
@@ -20,12 +20,17 @@
 #include <QHostAddress>
 #include <QByteArray>
 #include <QHash>
+#include <QElapsedTimer>
 
 #include "libHttpServer/Request.hpp"
 
 namespace HTTP
 {
 
+    class ContentProvider;
+    class IRequestHandler;
+    class IWebSocketHandler;
+
     class Request::Data
     {
     public:
@@ -36,6 +41,7 @@ namespace HTTP
         void appendBodyData( const QByteArray& data );
         void enterRecvBody();
         void enterFinished();
+        void reset();
 
     public:
         Request*        mRequest;
@@ -48,6 +54,14 @@ namespace HTTP
         quint16         mRemotePort;
         QHostAddress    mRemoteAddr;
         Method          mMethod;
+        ContentProvider* mProvider;
+        IRequestHandler* mHandler;      // Set if the request bypasses Request and Response
+        IWebSocketHandler* mWebSocketHandler;   // Set if the request is a WebSocket handshake
+        QElapsedTimer   mTimer;         // Started with the first byte of the request
+        qint64          mHeadersDone;   // usecs
+        qint64          mBytesIn;
+        bool            mRetired;       // Handed back to the connection for recycling
+        quint32         mGeneration;    // Counts the lives of a pooled request
     };
 }
 
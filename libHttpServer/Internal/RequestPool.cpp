@@ -0,0 +1,109 @@
+/*
+ * Modern CI
+ * Copyright (C) 2012-2013 Sascha Cunz <sascha@babbelbox.org>
+ *
+ * This program is free software; you can redistribute it and/or modify it under the terms of the
+ * GNU General Public License (Version 2) as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without
+ * even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this program; if
+ * not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "libHttpServer/AsyncWait.hpp"
+
+#include "libHttpServer/Internal/RequestPool.hpp"
+#include "libHttpServer/Internal/Request.hpp"
+#include "libHttpServer/Internal/Response.hpp"
+#include "libHttpServer/Internal/Connection.hpp"
+
+namespace HTTP
+{
+
+    RequestPool::RequestPool()
+    {
+    }
+
+    RequestPool::~RequestPool()
+    {
+        qDeleteAll( mRequests );
+        qDeleteAll( mResponses );
+    }
+
+    /*
+     * The request has no parent yet; the connection adopts it when it is dispatched to a
+     * ContentProvider or the newRequest() signal.
+     */
+    Request* RequestPool::takeRequest()
+    {
+        if( mRequests.isEmpty() )
+        {
+            return new Request( NULL, new Request::Data );
+        }
+        return mRequests.takeLast();
+    }
+
+    Response* RequestPool::takeResponse()
+    {
+        if( mResponses.isEmpty() )
+        {
+            return new Response( new Response::Data );
+        }
+        return mResponses.takeLast();
+    }
+
+    /*
+     * Takes back a request whose response was sent, along with that response. Whatever the
+     * handler parented to the request or still waits for on its behalf is gone by now or is
+     * ended here.
+     */
+    void RequestPool::recycle( Request* request )
+    {
+        AsyncWait::cancel( request );
+
+        Response* response = request->d->mResponse;
+
+        if( !request->children().isEmpty() )
+        {
+            QObjectList children = request->children();
+            qDeleteAll( children );
+        }
+
+        request->setParent( NULL );
+        request->disconnect();
+        request->d->reset();
+
+        if( mRequests.count() < MaxFree )
+        {
+            mRequests.append( request );
+        }
+        else
+        {
+            delete request;
+        }
+
+        if( response )
+        {
+            response->disconnect();
+            if( response->d->mConnection )
+            {
+                QObject::disconnect( response->d->mConnection, 0, response, 0 );
+            }
+            response->d->reset();
+
+            if( mResponses.count() < MaxFree )
+            {
+                mResponses.append( response );
+            }
+            else
+            {
+                delete response;
+            }
+        }
+    }
+
+}
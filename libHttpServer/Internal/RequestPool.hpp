@@ -0,0 +1,53 @@
+/*
+ * Modern CI
+ * Copyright (C) 2012-2013 Sascha Cunz <sascha@babbelbox.org>
+ *
+ * This program is free software; you can redistribute it and/or modify it under the terms of the
+ * GNU General Public License (Version 2) as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without
+ * even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this program; if
+ * not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef HTTP_REQUEST_POOL_HPP
+#define HTTP_REQUEST_POOL_HPP
+
+#include <QList>
+
+namespace HTTP
+{
+
+    class Request;
+    class Response;
+
+    /*
+     * Free lists of Request and Response objects, together with their Data, for the connections
+     * of one thread. Objects are reset rather than destroyed when they come back, so the QObject
+     * and its private data are allocated only once.
+     */
+    class RequestPool
+    {
+    public:
+        RequestPool();
+        ~RequestPool();
+
+    public:
+        Request* takeRequest();
+        Response* takeResponse();
+        void recycle( Request* request );
+
+    private:
+        enum { MaxFree = 64 };  // Per kind; a burst beyond that is simply freed again
+
+        QList< Request* >   mRequests;
+        QList< Response* >  mResponses;
+    };
+
+}
+
+#endif
@@ -17,24 +17,33 @@
 #pragma once
 
 #include <QPointer>
+#include <QAtomicInt>
+#include <QSharedPointer>
 
 #include "libHttpServer/Response.hpp"
 
+#include "libHttpServer/Internal/MappedFile.hpp"
+
 namespace HTTP
 {
 
     class Request;
     class Connection;
+    class ContentProvider;
 
     class Response::Data
     {
     public:
+        Data();
+
         enum Flag
         {
             KeepAlive           = 1 << 0,
             Close               = 1 << 1,
             ChunkedEncoding     = 1 << 2,
+            Streaming           = 1 << 3,
 
+            Sent                = 1 << 26,
             BodyIsFixed         = 1 << 27,
             DataIsCompressed    = 1 << 28,
             SendAtOnce          = 1 << 29,
@@ -43,11 +52,21 @@ namespace HTTP
         };
         typedef QFlags< Flag > Flags;
 
+        void reset();
+        int bodySize() const;
+        void write( BodySegment segment );
+        QByteArray serializeHeaders( StatusCode code );
+
         QPointer<Connection>    mConnection;
         QPointer<Request>       mRequest;
+        QSharedPointer< QAtomicInt > mBandwidthLimit;  // The provider's, if any
         Flags                   mFlags;
         HeadersHash             mHeaders;
-        QByteArray              mBodyData;
+        BodySegments            mBody;
+        StatusCode              mStatus;
+        qint64                  mBytesOut;
+        qint64                  mFirstByteTime;     // usecs since the request began
+        quint32                 mGeneration;        // Counts the lives of a pooled response
     };
 
 }
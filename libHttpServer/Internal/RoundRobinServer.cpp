@@ -17,6 +17,19 @@
 #include "libHttpServer/Internal/Http.hpp"
 #include "libHttpServer/Internal/RoundRobinServer.hpp"
 #include "libHttpServer/Internal/Connection.hpp"
+#include "libHttpServer/Internal/Throttle.hpp"
+#include "libHttpServer/Internal/Server.hpp"
+#include "libHttpServer/Internal/RequestPool.hpp"
+#include "libHttpServer/Internal/Executor.hpp"
+#include "libHttpServer/Internal/Transport.hpp"
+
+#ifdef Q_OS_LINUX
+#include "libHttpServer/Internal/EpollEngine.hpp"
+#endif
+
+#ifdef HTTP_SERVER_HAVE_IO_URING
+#include "libHttpServer/Internal/UringEngine.hpp"
+#endif
 
 namespace HTTP
 {
@@ -24,18 +37,134 @@ namespace HTTP
     Establisher::Establisher( ServerPrivate* server )
         : QObject( NULL )
         , mServer( server )
+        , mShaper( new Shaper( this ) )
+        , mMetrics( server->mMetrics.addShard() )
+        , mPool( new RequestPool )
+        , mEpoll( NULL )
+        , mUring( NULL )
+        , mDraining( false )
+    {
+    }
+
+    Establisher::~Establisher()
+    {
+        // Our connections are deleted only after this; they do not return anything to the pool
+        delete mPool;
+    }
+
+    Shaper* Establisher::shaper() const
+    {
+        return mShaper;
+    }
+
+    MetricsShard* Establisher::metrics() const
+    {
+        return mMetrics;
+    }
+
+    RequestPool* Establisher::pool() const
     {
+        return mPool;
+    }
+
+    void Establisher::customEvent( QEvent* event )
+    {
+        if( event->type() == OffloadEvent::type() )
+        {
+            static_cast< OffloadEvent* >( event )->task()->deliver();
+        }
     }
 
     void Establisher::incommingConnection( int socketDescriptor )
     {
-        QTcpSocket* sock = new QTcpSocket( this );
-        sock->setSocketDescriptor( socketDescriptor );
+        Transport* transport = NULL;
+        #ifdef HTTP_SERVER_HAVE_IO_URING
+        UringTransport* uring = NULL;
+        #endif
+        EventEngine engine = mServer->mEventEngine;
+        #ifdef HTTP_SERVER_HAVE_IO_URING
+        if( engine == UringEventEngine )
+        {
+            if( !mUring )
+            {
+                mUring = new UringLoop( this );
+            }
 
-        HTTP_DBG( "incomming connection; Sock=%i; Thread=%p; TcpSocket=%p",
-                  socketDescriptor, QThread::currentThread(), sock );
+            // If the kernel refused, epoll is the next best thing
+            if( mUring->isValid() )
+            {
+                uring = new UringTransport( socketDescriptor, mUring );
+                transport = uring;
+            }
+        }
+        #endif
+
+        #ifdef Q_OS_LINUX
+        if( !transport && ( engine == EpollEventEngine || engine == UringEventEngine ) )
+        {
+            if( !mEpoll )
+            {
+                mEpoll = new EpollLoop( this );
+            }
+
+            EpollTransport* t = new EpollTransport( socketDescriptor );
+            if( mEpoll->add( socketDescriptor, t ) )
+            {
+                transport = t;
+            }
+            else
+            {
+                // Most likely epoll is not available; the socket stays open for Qt
+                t->disown();
+                delete t;
+            }
+        }
+        #endif
 
-        new Connection( sock, mServer, this );
+        if( !transport )
+        {
+            QTcpSocket* sock = new QTcpSocket;
+            sock->setSocketDescriptor( socketDescriptor );
+            transport = new QtTransport( sock );
+        }
+
+        HTTP_DBG( "incomming connection; Sock=%i; Thread=%p; Transport=%p",
+                  socketDescriptor, QThread::currentThread(), transport );
+
+        Connection* c = new Connection( transport, mServer, this );
+
+        #ifdef HTTP_SERVER_HAVE_IO_URING
+        // Only now: if the ring is full, the transport reports itself closed right away, and
+        // there has to be a connection to hear that
+        if( uring )
+        {
+            uring->start();
+        }
+        #endif
+
+        // Accepted just before the listening socket was closed; its first request is still answered
+        if( mDraining )
+        {
+            c->drain();
+        }
+    }
+
+    void Establisher::drain()
+    {
+        mDraining = true;
+
+        foreach( Connection* c, findChildren< Connection* >() )
+        {
+            c->drain();
+        }
+    }
+
+    void Establisher::abortConnections()
+    {
+        foreach( Connection* c, findChildren< Connection* >() )
+        {
+            c->abort();
+        }
     }
 
     RoundRobinServer::RoundRobinServer( QObject* parent, ServerPrivate* server )
@@ -45,6 +174,17 @@ namespace HTTP
     {
     }
 
+    /*
+     * The worker threads must not be running anymore (or be the current thread).
+     */
+    RoundRobinServer::~RoundRobinServer()
+    {
+        foreach( const ThreadInfo& ti, mThreads )
+        {
+            delete ti.mEstablisher;
+        }
+    }
+
     void RoundRobinServer::addThread( QThread* thread )
     {
         QMutexLocker l( &mThreadsMutex );
@@ -58,6 +198,19 @@ namespace HTTP
         mThreads.append( ti );
     }
 
+    /*
+     * Queues a call to a slot of every thread's Establisher.
+     */
+    void RoundRobinServer::invokeOnEstablishers( const char* member )
+    {
+        QMutexLocker l( &mThreadsMutex );
+
+        foreach( const ThreadInfo& ti, mThreads )
+        {
+            QMetaObject::invokeMethod( ti.mEstablisher, member, Qt::QueuedConnection );
+        }
+    }
+
     void RoundRobinServer::removeThread( QThread* thread )
     {
         QMutexLocker l( &mThreadsMutex );
@@ -103,6 +256,8 @@ namespace HTTP
             return;
         }
 
+        mServer->mMetrics.mAcceptedConnections++;
+
         Establisher* e = mThreads[ mNextHandler++ ].mEstablisher;
         QMetaObject::invokeMethod( e, "incommingConnection",
                                    Qt::QueuedConnection, Q_ARG( int, socketDescriptor ) );
@@ -28,18 +28,40 @@ namespace HTTP
 {
 
     class ServerPrivate;
+    class Shaper;
+    class MetricsShard;
+    class RequestPool;
+    class EpollLoop;
+    class UringLoop;
 
     class Establisher : public QObject
     {
         Q_OBJECT
     public:
         Establisher( ServerPrivate* server );
+        ~Establisher();
+
+    public:
+        Shaper* shaper() const;
+        MetricsShard* metrics() const;
+        RequestPool* pool() const;
 
     public slots:
         void incommingConnection( int socketDescriptor );
+        void drain();
+        void abortConnections();
+
+    protected:
+        void customEvent( QEvent* event );
 
     private:
         ServerPrivate*          mServer;
+        Shaper*                 mShaper;
+        MetricsShard*           mMetrics;
+        RequestPool*            mPool;
+        EpollLoop*              mEpoll;         // Created with the first connection that uses it
+        UringLoop*              mUring;         // Likewise
+        bool                    mDraining;
     };
 
     class RoundRobinServer : public QTcpServer
@@ -47,10 +69,12 @@ namespace HTTP
         Q_OBJECT
     public:
         RoundRobinServer( QObject* parent, ServerPrivate* server );
+        ~RoundRobinServer();
 
     public:
         void addThread( QThread* thread );
         void removeThread( QThread* thread );
+        void invokeOnEstablishers( const char* member );
 
     private slots:
         void threadEnded();
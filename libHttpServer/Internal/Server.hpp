@@ -19,24 +19,61 @@
 
 #include "libHttpServer/Server.hpp"
 #include "libHttpServer/Internal/RoundRobinServer.hpp"
+#include "libHttpServer/Internal/Throttle.hpp"
+#include "libHttpServer/Internal/Metrics.hpp"
+#include "libHttpServer/Internal/Executor.hpp"
 
 namespace HTTP
 {
 
     class ContentProvider;
+    class IRequestHandler;
+    class IWebSocketHandler;
 
     class ServerPrivate
     {
+    public:
+        ServerPrivate( Server* server );
+
+    public:
+        struct HandlerRoute
+        {
+            QByteArray          mPrefix;
+            IRequestHandler*    mHandler;
+        };
+
+        struct WebSocketRoute
+        {
+            QByteArray          mPrefix;
+            IWebSocketHandler*  mHandler;
+        };
+
     public:
         Server*             mHttpServer;
         RoundRobinServer*   mTcpServer;
         IAccessLog*         mAccessLog;
-        int                 mThrottledTo;   // Bytes per 10th of second
-                                            // 10240 = 1kB/s; 0 = unlimited
+        IRequestLog*        mRequestLog;
+        BandwidthLimits     mLimits;
+        MetricsRegistry     mMetrics;
         QList< ContentProvider* >   mProviders;
+        QList< HandlerRoute >       mHandlers;
+        QList< WebSocketRoute >     mWebSocketHandlers;
+        int                 mWorkerCount;
+        EventEngine         mEventEngine;
+        QList< QThread* >   mWorkers;
+        WorkStealingExecutor mExecutor;
+        QAtomicInt          mOpenConnections;
+        QAtomicInt          mDraining;
+        bool                mDrained;       // drained() was emitted
 
     public:
         void newRequest( Request* request );
+        void startWorkers( RoundRobinServer* tcpServer );
+        void connectionClosed();
+        IRequestHandler* handlerFor( const QByteArray& url ) const;
+        IWebSocketHandler* webSocketHandlerFor( const QByteArray& url ) const;
+        QString routeName( const void* route ) const;
+        LatencySummary latency( const void* route, LatencyStage stage ) const;
     };
 
 }
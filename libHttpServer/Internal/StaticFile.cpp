@@ -0,0 +1,200 @@
+/*
+ * Modern CI
+ * Copyright (C) 2012-2013 Sascha Cunz <sascha@babbelbox.org>
+ *
+ * This program is free software; you can redistribute it and/or modify it under the terms of the
+ * GNU General Public License (Version 2) as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without
+ * even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this program; if
+ * not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <QFileInfo>
+
+#ifdef Q_OS_UNIX
+#include <sys/stat.h>
+#endif
+
+#include "libHttpServer/Request.hpp"
+#include "libHttpServer/ContentProvider.hpp"
+
+#include "libHttpServer/Internal/StaticFile.hpp"
+
+namespace HTTP
+{
+
+    /*
+     * Strong entity tag derived from the file's identity (inode, size and modification time with
+     * nanosecond resolution where available), so that we never have to read the content to compute
+     * it. Falls back to size and millisecond modification time on other platforms.
+     */
+    static QByteArray entityTag( const QString& fileName, const QFileInfo& fi )
+    {
+        QByteArray tag = "\"";
+
+        #if defined( Q_OS_UNIX )
+        struct stat st;
+        if( ::stat( QFile::encodeName( fileName ).constData(), &st ) == 0 )
+        {
+            #if defined( Q_OS_LINUX )
+            qint64 nsecs = st.st_mtim.tv_nsec;
+            #elif defined( Q_OS_MAC )
+            qint64 nsecs = st.st_mtimespec.tv_nsec;
+            #else
+            qint64 nsecs = 0;
+            #endif
+
+            tag += QByteArray::number( quint64( st.st_ino ), 16 );
+            tag += '-';
+            tag += QByteArray::number( qint64( st.st_size ), 16 );
+            tag += '-';
+            tag += QByteArray::number( qint64( st.st_mtime ) * 1000000000LL + nsecs, 16 );
+            tag += '"';
+            return tag;
+        }
+        #else
+        Q_UNUSED( fileName );
+        #endif
+
+        tag += QByteArray::number( fi.size(), 16 );
+        tag += '-';
+        tag += QByteArray::number( fi.lastModified().toMSecsSinceEpoch(), 16 );
+        tag += '"';
+        return tag;
+    }
+
+    /*
+     * If-None-Match uses the weak comparison function (RFC 7232, 3.2), so a "W/" prefix on the
+     * client's tags is ignored.
+     */
+    static bool matchesEntityTag( const QByteArray& ifNoneMatch, const QByteArray& tag )
+    {
+        foreach( QByteArray candidate, ifNoneMatch.split( ',' ) )
+        {
+            candidate = candidate.trimmed();
+
+            if( candidate == "*" )
+            {
+                return true;
+            }
+
+            if( candidate.startsWith( "W/" ) )
+            {
+                candidate.remove( 0, 2 );
+            }
+
+            if( candidate == tag )
+            {
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    StaticFileQuery::StaticFileQuery()
+        : mMapThreshold( 0 )
+    {
+    }
+
+    StaticFileResult::StaticFileResult()
+        : mStatus( NotFound )
+    {
+    }
+
+    StaticFileResult loadStaticFile( const StaticFileQuery& query )
+    {
+        StaticFileResult result;
+        QFileInfo fi( query.mFileName );
+
+        if( !fi.exists() )
+        {
+            return result;
+        }
+
+        result.mETag = entityTag( query.mFileName, fi );
+        result.mLastModified = fi.lastModified();
+
+        if( !query.mIfNoneMatch.isEmpty() )
+        {
+            // If-None-Match takes precedence over If-Modified-Since (RFC 7232, 6)
+            if( matchesEntityTag( query.mIfNoneMatch, result.mETag ) )
+            {
+                result.mStatus = NotModified;
+                return result;
+            }
+        }
+        else if( !query.mIfModifiedSince.isEmpty() )
+        {
+            QDateTime dt = fromRfc1123date( query.mIfModifiedSince );
+
+            // The header only has a resolution of seconds
+            if( dt.isValid() && result.mLastModified.toTime_t() <= dt.toTime_t() )
+            {
+                result.mStatus = NotModified;
+                return result;
+            }
+        }
+
+        if( query.mMapThreshold > 0 && fi.size() >= query.mMapThreshold )
+        {
+            result.mMapping = MappedFilePool::instance()->map( query.mFileName, result.mETag );
+        }
+
+        if( !result.mMapping )
+        {
+            QFile f( query.mFileName );
+            if( !f.open( QFile::ReadOnly ) )
+            {
+                return result;
+            }
+
+            result.mData = f.readAll();
+        }
+
+        result.mStatus = Ok;
+        return result;
+    }
+
+    StaticFileJob::StaticFileJob( const StaticFileQuery& query )
+        : mQuery( query )
+    {
+        setAutoDelete( false );
+    }
+
+    void StaticFileJob::run()
+    {
+        mResult = loadStaticFile( mQuery );
+        emit finished();
+        deleteLater();
+    }
+
+    StaticFileResult StaticFileJob::result() const
+    {
+        return mResult;
+    }
+
+    StaticFileReply::StaticFileReply( StaticContentProvider* provider, Request* request,
+                                      const QString& path )
+        : QObject( request )
+        , mProvider( provider )
+        , mRequest( request )
+        , mPath( path )
+    {
+    }
+
+    void StaticFileReply::loaded()
+    {
+        StaticFileJob* job = qobject_cast< StaticFileJob* >( sender() );
+        Q_ASSERT( job );
+
+        mProvider->respond( mRequest, mPath, job->result() );
+        deleteLater();
+    }
+
+}
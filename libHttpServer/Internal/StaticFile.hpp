@@ -0,0 +1,109 @@
+/*
+ * Modern CI
+ * Copyright (C) 2012-2013 Sascha Cunz <sascha@babbelbox.org>
+ *
+ * This program is free software; you can redistribute it and/or modify it under the terms of the
+ * GNU General Public License (Version 2) as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without
+ * even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this program; if
+ * not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef HTTP_STATIC_FILE_HPP
+#define HTTP_STATIC_FILE_HPP
+
+#include <QObject>
+#include <QRunnable>
+#include <QDateTime>
+
+#include "libHttpServer/Http.hpp"
+
+#include "libHttpServer/Internal/MappedFile.hpp"
+
+namespace HTTP
+{
+
+    class Request;
+    class StaticContentProvider;
+
+    class StaticFileQuery
+    {
+    public:
+        StaticFileQuery();
+
+    public:
+        QString         mFileName;
+        QByteArray      mIfNoneMatch;
+        QByteArray      mIfModifiedSince;
+        qint64          mMapThreshold;
+    };
+
+    class StaticFileResult
+    {
+    public:
+        StaticFileResult();
+
+    public:
+        StatusCode      mStatus;
+        QByteArray      mETag;
+        QDateTime       mLastModified;
+        QByteArray      mData;
+        MappedFilePtr   mMapping;
+    };
+
+    /*
+     * Does all the blocking work for a static file: stat, revalidation, open and read (or map).
+     * May be called on any thread.
+     */
+    StaticFileResult loadStaticFile( const StaticFileQuery& query );
+
+    /*
+     * Runs loadStaticFile() on an I/O pool thread. The job is created on the connection's thread
+     * and stays owned by it, so finished() is delivered there via a queued connection and the job
+     * deletes itself through that thread's event loop.
+     */
+    class StaticFileJob : public QObject, public QRunnable
+    {
+        Q_OBJECT
+    public:
+        StaticFileJob( const StaticFileQuery& query );
+
+    public:
+        void run();
+        StaticFileResult result() const;
+
+    signals:
+        void finished();
+
+    private:
+        StaticFileQuery     mQuery;
+        StaticFileResult    mResult;
+    };
+
+    /*
+     * Receives a StaticFileJob's result on the connection's thread. It is a child of the request,
+     * so a result for a request that vanished in the meantime is simply dropped.
+     */
+    class StaticFileReply : public QObject
+    {
+        Q_OBJECT
+    public:
+        StaticFileReply( StaticContentProvider* provider, Request* request, const QString& path );
+
+    public slots:
+        void loaded();
+
+    private:
+        StaticContentProvider*  mProvider;
+        Request*                mRequest;
+        QString                 mPath;
+    };
+
+}
+
+#endif
@@ -0,0 +1,307 @@
+/*
+ * Modern CI
+ * Copyright (C) 2012-2013 Sascha Cunz <sascha@babbelbox.org>
+ *
+ * This program is free software; you can redistribute it and/or modify it under the terms of the
+ * GNU General Public License (Version 2) as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without
+ * even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this program; if
+ * not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <QTimerEvent>
+
+#include "libHttpServer/Internal/Http.hpp"
+#include "libHttpServer/Internal/Throttle.hpp"
+#include "libHttpServer/Internal/Connection.hpp"
+
+namespace HTTP
+{
+
+    TokenBucket::TokenBucket()
+        : mRate( 0 )
+        , mTokens( 0 )
+        , mLastRefill( -1 )
+        , mRemainder( 0 )
+    {
+    }
+
+    void TokenBucket::setRate( qint64 bytesPerSecond )
+    {
+        if( bytesPerSecond == mRate )
+        {
+            return;
+        }
+
+        mRate = qMax( bytesPerSecond, Q_INT64_C( 0 ) );
+        mTokens = qMin( mTokens, capacity() );
+    }
+
+    qint64 TokenBucket::rate() const
+    {
+        return mRate;
+    }
+
+    bool TokenBucket::isLimited() const
+    {
+        return mRate > 0;
+    }
+
+    bool TokenBucket::isFull() const
+    {
+        return mTokens >= capacity();
+    }
+
+    qint64 TokenBucket::capacity() const
+    {
+        return qMax( mRate / 5, Q_INT64_C( 1 ) );
+    }
+
+    /*
+     * Time only ever moves forward here; a caller with an older timestamp gets nothing. What does
+     * not add up to a whole byte yet is kept, so slow rates work with frequent refills, too.
+     */
+    void TokenBucket::refill( qint64 nowMSecs )
+    {
+        if( mLastRefill < 0 )
+        {
+            // A fresh bucket starts full
+            mTokens = capacity();
+            mRemainder = 0;
+            mLastRefill = nowMSecs;
+        }
+        else if( nowMSecs > mLastRefill )
+        {
+            qint64 earned = mRate * ( nowMSecs - mLastRefill ) + mRemainder;
+            mTokens += earned / 1000;
+            mRemainder = earned % 1000;
+
+            if( mTokens >= capacity() )
+            {
+                mTokens = capacity();
+                mRemainder = 0;
+            }
+
+            mLastRefill = nowMSecs;
+        }
+    }
+
+    qint64 TokenBucket::available() const
+    {
+        return mTokens;
+    }
+
+    void TokenBucket::consume( qint64 bytes )
+    {
+        mTokens -= bytes;
+    }
+
+    BandwidthLimits::BandwidthLimits()
+        : mLimited( 0 )
+        , mConnectionRate( 0 )
+        , mRemoteRate( 0 )
+        , mAcquiresSincePurge( 0 )
+    {
+        mClock.start();
+    }
+
+    void BandwidthLimits::setGlobalRate( qint64 bytesPerSecond )
+    {
+        QMutexLocker l( &mMutex );
+        mGlobal.setRate( bytesPerSecond );
+        updateLimited();
+    }
+
+    qint64 BandwidthLimits::globalRate() const
+    {
+        QMutexLocker l( &mMutex );
+        return mGlobal.rate();
+    }
+
+    void BandwidthLimits::setConnectionRate( qint64 bytesPerSecond )
+    {
+        QMutexLocker l( &mMutex );
+        mConnectionRate = qMax( bytesPerSecond, Q_INT64_C( 0 ) );
+        updateLimited();
+    }
+
+    qint64 BandwidthLimits::connectionRate() const
+    {
+        QMutexLocker l( &mMutex );
+        return mConnectionRate;
+    }
+
+    void BandwidthLimits::setRemoteRate( qint64 bytesPerSecond )
+    {
+        QMutexLocker l( &mMutex );
+        mRemoteRate = qMax( bytesPerSecond, Q_INT64_C( 0 ) );
+
+        RemoteBuckets::Iterator it = mRemotes.begin();
+        while( it != mRemotes.end() )
+        {
+            it.value().setRate( mRemoteRate );
+            ++it;
+        }
+
+        updateLimited();
+    }
+
+    qint64 BandwidthLimits::remoteRate() const
+    {
+        QMutexLocker l( &mMutex );
+        return mRemoteRate;
+    }
+
+    void BandwidthLimits::updateLimited()
+    {
+        bool limited = mGlobal.isLimited() || mConnectionRate > 0 || mRemoteRate > 0;
+        mLimited.fetchAndStoreRelease( limited ? 1 : 0 );
+
+        if( !mRemoteRate )
+        {
+            mRemotes.clear();
+        }
+    }
+
+    /*
+     * Lock-free check for the common case of running without any limits at all.
+     */
+    bool BandwidthLimits::isLimited() const
+    {
+        return mLimited != 0;
+    }
+
+    /*
+     * Take up to the wanted number of bytes out of the global bucket and the remote address's
+     * bucket. Returns what was granted, which may be 0.
+     */
+    qint64 BandwidthLimits::acquire( const QHostAddress& remote, qint64 wanted )
+    {
+        QMutexLocker l( &mMutex );
+
+        // The threads' Shaper clocks started at different times; these buckets need one clock
+        qint64 nowMSecs = mClock.elapsed();
+
+        qint64 granted = wanted;
+
+        if( mGlobal.isLimited() )
+        {
+            mGlobal.refill( nowMSecs );
+            granted = qMin( granted, mGlobal.available() );
+        }
+
+        TokenBucket* remoteBucket = NULL;
+        if( mRemoteRate > 0 )
+        {
+            if( ++mAcquiresSincePurge >= 1024 )
+            {
+                purgeRemotes();
+            }
+
+            RemoteBuckets::Iterator it = mRemotes.find( remote );
+            if( it == mRemotes.end() )
+            {
+                it = mRemotes.insert( remote, TokenBucket() );
+                it.value().setRate( mRemoteRate );
+            }
+
+            remoteBucket = &it.value();
+            remoteBucket->refill( nowMSecs );
+            granted = qMin( granted, remoteBucket->available() );
+        }
+
+        granted = qMax( granted, Q_INT64_C( 0 ) );
+
+        if( mGlobal.isLimited() )
+        {
+            mGlobal.consume( granted );
+        }
+
+        if( remoteBucket )
+        {
+            remoteBucket->consume( granted );
+        }
+
+        return granted;
+    }
+
+    /*
+     * A full bucket is indistinguishable from a new one, so it can be dropped.
+     */
+    void BandwidthLimits::purgeRemotes()
+    {
+        mAcquiresSincePurge = 0;
+
+        RemoteBuckets::Iterator it = mRemotes.begin();
+        while( it != mRemotes.end() )
+        {
+            if( it.value().isFull() )
+                it = mRemotes.erase( it );
+            else
+                ++it;
+        }
+    }
+
+    Shaper::Shaper( QObject* parent )
+        : QObject( parent )
+    {
+        mClock.start();
+    }
+
+    qint64 Shaper::now() const
+    {
+        return mClock.elapsed();
+    }
+
+    void Shaper::wait( Connection* connection )
+    {
+        if( !mWaiting.contains( connection ) )
+        {
+            mWaiting.append( connection );
+        }
+
+        if( !mTick.isActive() )
+        {
+            mTick.start( sTickMSecs, this );
+        }
+    }
+
+    void Shaper::cancel( Connection* connection )
+    {
+        mWaiting.removeOne( connection );
+    }
+
+    void Shaper::timerEvent( QTimerEvent* event )
+    {
+        if( event->timerId() != mTick.timerId() )
+        {
+            QObject::timerEvent( event );
+            return;
+        }
+
+        // Connections that still have output pending re-register through maybeSend().
+        QList< Connection* > waiting;
+        waiting.swap( mWaiting );
+
+        foreach( Connection* connection, waiting )
+        {
+            connection->maybeSend();
+        }
+
+        if( mWaiting.isEmpty() )
+        {
+            mTick.stop();
+        }
+        else if( mWaiting.count() > 1 )
+        {
+            // Whoever came first this time gets served last on the next tick
+            mWaiting.append( mWaiting.takeFirst() );
+        }
+    }
+
+}
@@ -0,0 +1,132 @@
+/*
+ * Modern CI
+ * Copyright (C) 2012-2013 Sascha Cunz <sascha@babbelbox.org>
+ *
+ * This program is free software; you can redistribute it and/or modify it under the terms of the
+ * GNU General Public License (Version 2) as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without
+ * even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this program; if
+ * not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef HTTP_THROTTLE_HPP
+#define HTTP_THROTTLE_HPP
+
+#include <QObject>
+#include <QList>
+#include <QHash>
+#include <QMutex>
+#include <QAtomicInt>
+#include <QBasicTimer>
+#include <QElapsedTimer>
+#include <QHostAddress>
+
+namespace HTTP
+{
+
+    class Connection;
+
+    /*
+     * Classic token bucket. Tokens are bytes; the bucket holds at most 200ms worth of its rate, so
+     * an idle connection cannot save up for a large burst.
+     */
+    class TokenBucket
+    {
+    public:
+        TokenBucket();
+
+    public:
+        void setRate( qint64 bytesPerSecond );
+        qint64 rate() const;
+        bool isLimited() const;
+        bool isFull() const;
+
+        void refill( qint64 nowMSecs );
+        qint64 available() const;
+        void consume( qint64 bytes );
+
+    private:
+        qint64 capacity() const;
+
+    private:
+        qint64  mRate;          // Bytes per second; 0 = unlimited
+        qint64  mTokens;
+        qint64  mLastRefill;
+        qint64  mRemainder;     // Byte-milliseconds that did not make up a whole token yet
+    };
+
+    /*
+     * Rate limits that are shared between all worker threads: The global bucket and one bucket
+     * per remote address. The per connection rate is only stored here; its bucket lives in the
+     * Connection itself, as that is touched by one thread only.
+     */
+    class BandwidthLimits
+    {
+    public:
+        BandwidthLimits();
+
+    public:
+        void setGlobalRate( qint64 bytesPerSecond );
+        qint64 globalRate() const;
+
+        void setConnectionRate( qint64 bytesPerSecond );
+        qint64 connectionRate() const;
+
+        void setRemoteRate( qint64 bytesPerSecond );
+        qint64 remoteRate() const;
+
+        bool isLimited() const;
+
+        qint64 acquire( const QHostAddress& remote, qint64 wanted );
+
+    private:
+        void updateLimited();
+        void purgeRemotes();
+
+    private:
+        typedef QHash< QHostAddress, TokenBucket > RemoteBuckets;
+
+        mutable QMutex  mMutex;
+        QAtomicInt      mLimited;
+        TokenBucket     mGlobal;
+        qint64          mConnectionRate;
+        qint64          mRemoteRate;
+        RemoteBuckets   mRemotes;
+        int             mAcquiresSincePurge;
+        QElapsedTimer   mClock;         // One clock for all threads; read under mMutex
+    };
+
+    /*
+     * One per worker thread. Connections that ran out of tokens register here and are all
+     * resumed from a single shared tick, instead of each one running its own timer.
+     */
+    class Shaper : public QObject
+    {
+        Q_OBJECT
+    public:
+        Shaper( QObject* parent = 0 );
+
+    public:
+        qint64 now() const;
+        void wait( Connection* connection );
+        void cancel( Connection* connection );
+
+    protected:
+        void timerEvent( QTimerEvent* event );
+
+    private:
+        QElapsedTimer           mClock;
+        QBasicTimer             mTick;
+        QList< Connection* >    mWaiting;
+
+        static const int        sTickMSecs = 50;
+    };
+
+}
+
+#endif
@@ -0,0 +1,169 @@
+/*
+ * Modern CI
+ * Copyright (C) 2012-2013 Sascha Cunz <sascha@babbelbox.org>
+ *
+ * This program is free software; you can redistribute it and/or modify it under the terms of the
+ * GNU General Public License (Version 2) as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without
+ * even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this program; if
+ * not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <QTcpSocket>
+
+#ifdef Q_OS_UNIX
+#include <sys/socket.h>
+#include <netinet/in.h>
+#endif
+
+#include "libHttpServer/Internal/Transport.hpp"
+#include "libHttpServer/Internal/Connection.hpp"
+
+namespace HTTP
+{
+
+    Transport::Transport()
+        : mConnection( NULL )
+    {
+    }
+
+    Transport::~Transport()
+    {
+    }
+
+    void Transport::setConnection( Connection* connection )
+    {
+        mConnection = connection;
+    }
+
+    void Transport::release()
+    {
+        delete this;
+    }
+
+    /*
+     * For transports on raw descriptors; asked once per connection.
+     */
+    void Transport::socketPeer( int socketDescriptor, QHostAddress& address, quint16& port )
+    {
+        port = 0;
+
+        #ifdef Q_OS_UNIX
+        struct sockaddr_storage addr;
+        socklen_t length = sizeof( addr );
+        if( ::getpeername( socketDescriptor, reinterpret_cast< struct sockaddr* >( &addr ),
+                           &length ) != 0 )
+        {
+            return;
+        }
+
+        address.setAddress( reinterpret_cast< struct sockaddr* >( &addr ) );
+
+        if( addr.ss_family == AF_INET )
+        {
+            port = ntohs( reinterpret_cast< struct sockaddr_in* >( &addr )->sin_port );
+        }
+        else if( addr.ss_family == AF_INET6 )
+        {
+            port = ntohs( reinterpret_cast< struct sockaddr_in6* >( &addr )->sin6_port );
+        }
+        #else
+        Q_UNUSED( socketDescriptor );
+        Q_UNUSED( address );
+        #endif
+    }
+
+    void Transport::readable()
+    {
+        if( mConnection )
+        {
+            mConnection->dataArrived();
+        }
+    }
+
+    void Transport::written()
+    {
+        if( mConnection )
+        {
+            mConnection->socketBytesWritten();
+        }
+    }
+
+    void Transport::closed()
+    {
+        if( mConnection )
+        {
+            mConnection->socketLost();
+        }
+    }
+
+    QtTransport::QtTransport( QTcpSocket* socket )
+        : mSocket( socket )
+    {
+        connect( socket, SIGNAL(readyRead()), this, SLOT(socketReadyRead()) );
+        connect( socket, SIGNAL(disconnected()), this, SLOT(socketDisconnected()) );
+        connect( socket, SIGNAL(bytesWritten(qint64)), this, SLOT(socketBytesWritten()) );
+    }
+
+    QtTransport::~QtTransport()
+    {
+        delete mSocket;
+    }
+
+    qint64 QtTransport::read( char* data, qint64 maxLength )
+    {
+        qint64 n = mSocket->read( data, maxLength );
+        return n > 0 ? n : 0;
+    }
+
+    qint64 QtTransport::write( const char* data, qint64 length )
+    {
+        return mSocket->write( data, length );
+    }
+
+    qint64 QtTransport::bytesToWrite() const
+    {
+        return mSocket->bytesToWrite();
+    }
+
+    void QtTransport::disconnectFromHost()
+    {
+        mSocket->disconnectFromHost();
+    }
+
+    void QtTransport::abort()
+    {
+        mSocket->abort();
+    }
+
+    QHostAddress QtTransport::peerAddress() const
+    {
+        return mSocket->peerAddress();
+    }
+
+    quint16 QtTransport::peerPort() const
+    {
+        return mSocket->peerPort();
+    }
+
+    void QtTransport::socketReadyRead()
+    {
+        readable();
+    }
+
+    void QtTransport::socketBytesWritten()
+    {
+        written();
+    }
+
+    void QtTransport::socketDisconnected()
+    {
+        closed();
+    }
+
+}
@@ -0,0 +1,98 @@
+/*
+ * Modern CI
+ * Copyright (C) 2012-2013 Sascha Cunz <sascha@babbelbox.org>
+ *
+ * This program is free software; you can redistribute it and/or modify it under the terms of the
+ * GNU General Public License (Version 2) as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without
+ * even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this program; if
+ * not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef HTTP_TRANSPORT_HPP
+#define HTTP_TRANSPORT_HPP
+
+#include <QObject>
+#include <QHostAddress>
+
+class QTcpSocket;
+
+namespace HTTP
+{
+
+    class Connection;
+
+    /*
+     * The byte stream below a Connection. Implementations report events straight to the
+     * connection; nothing in between is queued or signalled.
+     */
+    class Transport
+    {
+    public:
+        Transport();
+        virtual ~Transport();
+
+    public:
+        void setConnection( Connection* connection );
+
+        // Returns 0 if nothing is available right now
+        virtual qint64 read( char* data, qint64 maxLength ) = 0;
+        virtual qint64 write( const char* data, qint64 length ) = 0;
+        virtual qint64 bytesToWrite() const = 0;
+
+        // Closes once everything written was sent
+        virtual void disconnectFromHost() = 0;
+        virtual void abort() = 0;
+
+        virtual QHostAddress peerAddress() const = 0;
+        virtual quint16 peerPort() const = 0;
+
+        // Called instead of deleting the transport
+        virtual void release();
+
+    protected:
+        static void socketPeer( int socketDescriptor, QHostAddress& address, quint16& port );
+        void readable();
+        void written();
+        void closed();
+
+    protected:
+        Connection*     mConnection;
+    };
+
+    /*
+     * Runs on a QTcpSocket and the Qt event loop; available everywhere.
+     */
+    class QtTransport : public QObject, public Transport
+    {
+        Q_OBJECT
+    public:
+        QtTransport( QTcpSocket* socket );
+        ~QtTransport();
+
+    public:
+        qint64 read( char* data, qint64 maxLength );
+        qint64 write( const char* data, qint64 length );
+        qint64 bytesToWrite() const;
+        void disconnectFromHost();
+        void abort();
+        QHostAddress peerAddress() const;
+        quint16 peerPort() const;
+
+    private slots:
+        void socketReadyRead();
+        void socketBytesWritten();
+        void socketDisconnected();
+
+    private:
+        QTcpSocket*     mSocket;
+    };
+
+}
+
+#endif
@@ -0,0 +1,592 @@
+/*
+ * Modern CI
+ * Copyright (C) 2012-2013 Sascha Cunz <sascha@babbelbox.org>
+ *
+ * This program is free software; you can redistribute it and/or modify it under the terms of the
+ * GNU General Public License (Version 2) as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without
+ * even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this program; if
+ * not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+
+#include <QSocketNotifier>
+
+#include "libHttpServer/Internal/UringEngine.hpp"
+
+namespace HTTP
+{
+
+    UringLoop::UringLoop( QObject* parent )
+        : QObject( parent )
+        , mRingFd( -1 )
+        , mEventFd( -1 )
+        , mNotifier( NULL )
+        , mSqRing( NULL )
+        , mSqRingSize( 0 )
+        , mCqRing( NULL )
+        , mCqRingSize( 0 )
+        , mSqes( NULL )
+        , mSqesSize( 0 )
+        , mQueued( 0 )
+        , mOperations( 0 )
+        , mSubmitPosted( false )
+        , mReaping( false )
+    {
+        if( !setUp() )
+        {
+            tearDown();
+        }
+    }
+
+    /*
+     * Nothing may be in flight when the ring goes away, since the kernel would still use the
+     * transports' buffers. So we shut all sockets down and collect what comes back first.
+     */
+    UringLoop::~UringLoop()
+    {
+        if( mRingFd != -1 )
+        {
+            foreach( UringTransport* t, mTransports )
+            {
+                t->shutDown();
+            }
+
+            submit();
+            while( mOperations > 0 && enter( 0, 1, IORING_ENTER_GETEVENTS ) >= 0 )
+            {
+                reap();
+            }
+        }
+
+        foreach( UringTransport* t, mTransports )
+        {
+            t->detach();
+        }
+
+        tearDown();
+    }
+
+    bool UringLoop::isValid() const
+    {
+        return mRingFd != -1;
+    }
+
+    bool UringLoop::setUp()
+    {
+        struct io_uring_params p;
+        memset( &p, 0, sizeof( p ) );
+
+        // Fails with ENOSYS on old kernels and EPERM where seccomp or sysctl forbid io_uring
+        mRingFd = int( ::syscall( __NR_io_uring_setup, unsigned( Entries ), &p ) );
+        if( mRingFd < 0 )
+        {
+            mRingFd = -1;
+            return false;
+        }
+
+        mSqRingSize = p.sq_off.array + p.sq_entries * sizeof( unsigned );
+        mCqRingSize = p.cq_off.cqes + p.cq_entries * sizeof( struct io_uring_cqe );
+
+        bool singleMap = p.features & IORING_FEAT_SINGLE_MMAP;
+        if( singleMap )
+        {
+            mSqRingSize = mCqRingSize = qMax( mSqRingSize, mCqRingSize );
+        }
+
+        mSqRing = ::mmap( NULL, mSqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                          mRingFd, IORING_OFF_SQ_RING );
+        if( mSqRing == MAP_FAILED )
+        {
+            mSqRing = NULL;
+            return false;
+        }
+
+        if( singleMap )
+        {
+            mCqRing = mSqRing;
+        }
+        else
+        {
+            mCqRing = ::mmap( NULL, mCqRingSize, PROT_READ | PROT_WRITE,
+                              MAP_SHARED | MAP_POPULATE, mRingFd, IORING_OFF_CQ_RING );
+            if( mCqRing == MAP_FAILED )
+            {
+                mCqRing = NULL;
+                return false;
+            }
+        }
+
+        mSqesSize = p.sq_entries * sizeof( struct io_uring_sqe );
+        void* sqes = ::mmap( NULL, mSqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                             mRingFd, IORING_OFF_SQES );
+        if( sqes == MAP_FAILED )
+        {
+            return false;
+        }
+        mSqes = static_cast< struct io_uring_sqe* >( sqes );
+
+        char* sq = static_cast< char* >( mSqRing );
+        mSqHead = reinterpret_cast< unsigned* >( sq + p.sq_off.head );
+        mSqTail = reinterpret_cast< unsigned* >( sq + p.sq_off.tail );
+        mSqMask = reinterpret_cast< unsigned* >( sq + p.sq_off.ring_mask );
+        mSqArray = reinterpret_cast< unsigned* >( sq + p.sq_off.array );
+        mSqEntries = p.sq_entries;
+
+        char* cq = static_cast< char* >( mCqRing );
+        mCqHead = reinterpret_cast< unsigned* >( cq + p.cq_off.head );
+        mCqTail = reinterpret_cast< unsigned* >( cq + p.cq_off.tail );
+        mCqMask = reinterpret_cast< unsigned* >( cq + p.cq_off.ring_mask );
+        mCqes = reinterpret_cast< struct io_uring_cqe* >( cq + p.cq_off.cqes );
+
+        // Socket send and receive arrived with Linux 5.6, as did probing
+        if( !supports( IORING_OP_RECV ) || !supports( IORING_OP_SEND ) )
+        {
+            return false;
+        }
+
+        mEventFd = ::eventfd( 0, EFD_NONBLOCK | EFD_CLOEXEC );
+        if( mEventFd == -1 ||
+                ::syscall( __NR_io_uring_register, mRingFd, IORING_REGISTER_EVENTFD,
+                           &mEventFd, 1 ) != 0 )
+        {
+            return false;
+        }
+
+        mNotifier = new QSocketNotifier( mEventFd, QSocketNotifier::Read, this );
+        connect( mNotifier, SIGNAL(activated(int)), this, SLOT(eventFdActivated()) );
+        return true;
+    }
+
+    void UringLoop::tearDown()
+    {
+        delete mNotifier;
+        mNotifier = NULL;
+
+        if( mSqes )
+        {
+            ::munmap( mSqes, mSqesSize );
+            mSqes = NULL;
+        }
+
+        if( mCqRing && mCqRing != mSqRing )
+        {
+            ::munmap( mCqRing, mCqRingSize );
+        }
+        mCqRing = NULL;
+
+        if( mSqRing )
+        {
+            ::munmap( mSqRing, mSqRingSize );
+            mSqRing = NULL;
+        }
+
+        if( mEventFd != -1 )
+        {
+            ::close( mEventFd );
+            mEventFd = -1;
+        }
+
+        if( mRingFd != -1 )
+        {
+            ::close( mRingFd );
+            mRingFd = -1;
+        }
+    }
+
+    bool UringLoop::supports( int opcode )
+    {
+        const int count = 256;
+        size_t size = sizeof( struct io_uring_probe ) + count * sizeof( struct io_uring_probe_op );
+
+        QByteArray buffer( int( size ), 0 );
+        struct io_uring_probe* probe = reinterpret_cast< struct io_uring_probe* >( buffer.data() );
+
+        if( ::syscall( __NR_io_uring_register, mRingFd, IORING_REGISTER_PROBE, probe, count ) != 0 )
+        {
+            return false;
+        }
+
+        return opcode <= probe->last_op && ( probe->ops[ opcode ].flags & IO_URING_OP_SUPPORTED );
+    }
+
+    int UringLoop::enter( unsigned toSubmit, unsigned minComplete, unsigned flags )
+    {
+        int result;
+        do
+        {
+            result = int( ::syscall( __NR_io_uring_enter, mRingFd, toSubmit, minComplete, flags,
+                                     NULL, 0 ) );
+        } while( result < 0 && errno == EINTR );
+
+        return result;
+    }
+
+    void UringLoop::add( UringTransport* transport )
+    {
+        mTransports.insert( transport );
+    }
+
+    void UringLoop::remove( UringTransport* transport )
+    {
+        mTransports.remove( transport );
+    }
+
+    /*
+     * A free submission entry, cleared. It counts as an operation in flight from here on. Returns
+     * NULL only if the kernel does not take anything off a full queue.
+     */
+    struct io_uring_sqe* UringLoop::sqe()
+    {
+        unsigned head = __atomic_load_n( mSqHead, __ATOMIC_ACQUIRE );
+        unsigned tail = *mSqTail + mQueued;
+
+        if( tail - head >= mSqEntries )
+        {
+            submit();
+
+            head = __atomic_load_n( mSqHead, __ATOMIC_ACQUIRE );
+            tail = *mSqTail;
+            if( tail - head >= mSqEntries )
+            {
+                return NULL;
+            }
+        }
+
+        unsigned index = tail & *mSqMask;
+        struct io_uring_sqe* s = &mSqes[ index ];
+        memset( s, 0, sizeof( *s ) );
+        mSqArray[ index ] = index;
+
+        mQueued++;
+        mOperations++;
+
+        // reap() submits on its way out anyway
+        if( !mReaping && !mSubmitPosted )
+        {
+            mSubmitPosted = true;
+            QMetaObject::invokeMethod( this, "submit", Qt::QueuedConnection );
+        }
+
+        return s;
+    }
+
+    /*
+     * Hands everything queued to the kernel at once. Entries it did not take stay in the ring and
+     * are offered again next time.
+     */
+    void UringLoop::submit()
+    {
+        mSubmitPosted = false;
+
+        if( mQueued )
+        {
+            __atomic_store_n( mSqTail, *mSqTail + mQueued, __ATOMIC_RELEASE );
+            mQueued = 0;
+        }
+
+        unsigned pending = *mSqTail - __atomic_load_n( mSqHead, __ATOMIC_ACQUIRE );
+        if( pending )
+        {
+            enter( pending, 0, 0 );
+        }
+    }
+
+    void UringLoop::eventFdActivated()
+    {
+        quint64 count;
+        ssize_t n = ::read( mEventFd, &count, sizeof( count ) );
+        Q_UNUSED( n );
+
+        reap();
+    }
+
+    /*
+     * The operation is encoded in the lowest bit of the transport's address.
+     */
+    void UringLoop::reap()
+    {
+        mReaping = true;
+
+        unsigned head = *mCqHead;
+        forever
+        {
+            unsigned tail = __atomic_load_n( mCqTail, __ATOMIC_ACQUIRE );
+            if( head == tail )
+            {
+                break;
+            }
+
+            const struct io_uring_cqe* cqe = &mCqes[ head & *mCqMask ];
+            quint64 data = cqe->user_data;
+            int result = cqe->res;
+
+            __atomic_store_n( mCqHead, ++head, __ATOMIC_RELEASE );
+            mOperations--;
+
+            UringTransport* t = reinterpret_cast< UringTransport* >( quintptr( data & ~quint64( 1 ) ) );
+            t->completed( UringTransport::Operation( data & 1 ), result );
+        }
+
+        mReaping = false;
+        submit();
+    }
+
+    UringTransport::UringTransport( int socketDescriptor, UringLoop* loop )
+        : mFd( socketDescriptor )
+        , mLoop( loop )
+        , mInFlight( 0 )
+        , mReleased( false )
+        , mShutDown( false )
+        , mClosing( false )
+        , mRecvLength( 0 )
+        , mRecvOffset( 0 )
+        , mSendOffset( 0 )
+        , mPeerPort( 0 )
+    {
+        socketPeer( mFd, mPeerAddress, mPeerPort );
+        mLoop->add( this );
+    }
+
+    UringTransport::~UringTransport()
+    {
+        if( mLoop )
+        {
+            mLoop->remove( this );
+        }
+
+        ::close( mFd );
+    }
+
+    void UringTransport::start()
+    {
+        receive();
+    }
+
+    void UringTransport::receive()
+    {
+        struct io_uring_sqe* s = mLoop ? mLoop->sqe() : NULL;
+        if( !s )
+        {
+            shutDown();
+            return;
+        }
+
+        s->opcode = IORING_OP_RECV;
+        s->fd = mFd;
+        s->addr = quint64( quintptr( mRecvBuffer ) );
+        s->len = BufferSize;
+        s->user_data = quint64( quintptr( this ) ) | Receive;
+        mInFlight++;
+    }
+
+    void UringTransport::send()
+    {
+        struct io_uring_sqe* s = mLoop ? mLoop->sqe() : NULL;
+        if( !s )
+        {
+            shutDown();
+            return;
+        }
+
+        s->opcode = IORING_OP_SEND;
+        s->fd = mFd;
+        s->addr = quint64( quintptr( mSending.constData() + mSendOffset ) );
+        s->len = unsigned( mSending.count() - mSendOffset );
+        s->msg_flags = MSG_NOSIGNAL;
+        s->user_data = quint64( quintptr( this ) ) | Send;
+        mInFlight++;
+    }
+
+    void UringTransport::completed( Operation op, int result )
+    {
+        mInFlight--;
+
+        if( mReleased || mShutDown )
+        {
+            finishIfUnused();
+            return;
+        }
+
+        if( op == Receive )
+        {
+            if( result > 0 )
+            {
+                mRecvLength = result;
+                mRecvOffset = 0;
+                readable();
+
+                // Whatever the connection left in the buffer, it did not want anymore
+                if( !mShutDown && mRecvOffset == mRecvLength )
+                {
+                    receive();
+                }
+            }
+            else if( result == -EINTR || result == -EAGAIN )
+            {
+                receive();
+            }
+            else
+            {
+                // Like QTcpSocket, we give up on the connection when the peer stops sending
+                shutDown();
+            }
+            return;
+        }
+
+        if( result < 0 )
+        {
+            if( result == -EINTR || result == -EAGAIN )
+            {
+                send();
+            }
+            else
+            {
+                shutDown();
+            }
+            return;
+        }
+
+        mSendOffset += result;
+        if( mSendOffset < mSending.count() )
+        {
+            send();
+            return;
+        }
+
+        mSending.clear();
+        mSendOffset = 0;
+
+        if( !mQueued.isEmpty() )
+        {
+            qSwap( mSending, mQueued );
+            send();
+        }
+
+        written();
+
+        if( mClosing && mSending.isEmpty() )
+        {
+            shutDown();
+        }
+    }
+
+    qint64 UringTransport::read( char* data, qint64 maxLength )
+    {
+        qint64 n = qMin( maxLength, qint64( mRecvLength - mRecvOffset ) );
+        if( n > 0 )
+        {
+            memcpy( data, mRecvBuffer + mRecvOffset, size_t( n ) );
+            mRecvOffset += int( n );
+        }
+        return n;
+    }
+
+    qint64 UringTransport::write( const char* data, qint64 length )
+    {
+        if( mShutDown || mClosing )
+        {
+            return -1;
+        }
+
+        if( mSending.isEmpty() )
+        {
+            mSending = QByteArray( data, int( length ) );
+            mSendOffset = 0;
+            send();
+        }
+        else
+        {
+            mQueued.append( data, int( length ) );
+        }
+
+        return length;
+    }
+
+    qint64 UringTransport::bytesToWrite() const
+    {
+        return mSending.count() - mSendOffset + mQueued.count();
+    }
+
+    void UringTransport::disconnectFromHost()
+    {
+        mClosing = true;
+
+        if( mSending.isEmpty() )
+        {
+            shutDown();
+        }
+    }
+
+    void UringTransport::abort()
+    {
+        mQueued.clear();
+        shutDown();
+    }
+
+    QHostAddress UringTransport::peerAddress() const
+    {
+        return mPeerAddress;
+    }
+
+    quint16 UringTransport::peerPort() const
+    {
+        return mPeerPort;
+    }
+
+    /*
+     * Operations still in flight come back with an error or end of file after this.
+     */
+    void UringTransport::shutDown()
+    {
+        if( mShutDown )
+        {
+            return;
+        }
+
+        mShutDown = true;
+        ::shutdown( mFd, SHUT_RDWR );
+
+        closed();
+    }
+
+    void UringTransport::release()
+    {
+        mConnection = NULL;
+        mReleased = true;
+
+        shutDown();
+        finishIfUnused();
+    }
+
+    /*
+     * The loop goes away, but had everything of ours completed before.
+     */
+    void UringTransport::detach()
+    {
+        mLoop = NULL;
+        finishIfUnused();
+    }
+
+    void UringTransport::finishIfUnused()
+    {
+        if( mReleased && !mInFlight )
+        {
+            delete this;
+        }
+    }
+
+}
@@ -0,0 +1,162 @@
+/*
+ * Modern CI
+ * Copyright (C) 2012-2013 Sascha Cunz <sascha@babbelbox.org>
+ *
+ * This program is free software; you can redistribute it and/or modify it under the terms of the
+ * GNU General Public License (Version 2) as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without
+ * even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this program; if
+ * not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef HTTP_URING_ENGINE_HPP
+#define HTTP_URING_ENGINE_HPP
+
+#include <QObject>
+#include <QByteArray>
+#include <QSet>
+
+#include "libHttpServer/Internal/Transport.hpp"
+
+class QSocketNotifier;
+
+struct io_uring_sqe;
+struct io_uring_cqe;
+
+namespace HTTP
+{
+
+    class UringTransport;
+
+    /*
+     * One io_uring per worker thread. Operations are only queued while the thread works; they
+     * are handed to the kernel with a single io_uring_enter() once the batch of completions at
+     * hand is handled (or, if they were queued from elsewhere, when control is back in the event
+     * loop). Completions are signalled through an eventfd, which is all Qt sees of the ring.
+     *
+     * We talk to the kernel directly, so there is no dependency on liburing.
+     */
+    class UringLoop : public QObject
+    {
+        Q_OBJECT
+    public:
+        UringLoop( QObject* parent );
+        ~UringLoop();
+
+    public:
+        bool isValid() const;
+
+        io_uring_sqe* sqe();
+        void add( UringTransport* transport );
+        void remove( UringTransport* transport );
+
+    private slots:
+        void eventFdActivated();
+        void submit();
+
+    private:
+        void reap();
+        bool setUp();
+        void tearDown();
+        bool supports( int opcode );
+        int enter( unsigned toSubmit, unsigned minComplete, unsigned flags );
+
+    private:
+        enum { Entries = 1024 };
+
+        int                 mRingFd;
+        int                 mEventFd;
+        QSocketNotifier*    mNotifier;
+
+        void*               mSqRing;
+        size_t              mSqRingSize;
+        void*               mCqRing;
+        size_t              mCqRingSize;
+        io_uring_sqe*       mSqes;
+        size_t              mSqesSize;
+
+        unsigned*           mSqHead;
+        unsigned*           mSqTail;
+        unsigned*           mSqMask;
+        unsigned*           mSqArray;
+        unsigned            mSqEntries;
+        unsigned*           mCqHead;
+        unsigned*           mCqTail;
+        unsigned*           mCqMask;
+        io_uring_cqe*       mCqes;
+
+        unsigned            mQueued;        // Prepared, but not submitted yet
+        int                 mOperations;    // Submitted or queued, but not completed
+        bool                mSubmitPosted;
+        bool                mReaping;
+        QSet< UringTransport* > mTransports;
+    };
+
+    /*
+     * A socket served by an UringLoop. At most one receive and one send are in flight, each on a
+     * buffer of our own. As the kernel may still write into them, we cannot go away before both
+     * came back: release() only shuts the socket down then, and the last completion deletes us.
+     */
+    class UringTransport : public Transport
+    {
+    public:
+        UringTransport( int socketDescriptor, UringLoop* loop );
+
+    public:
+        qint64 read( char* data, qint64 maxLength );
+        qint64 write( const char* data, qint64 length );
+        qint64 bytesToWrite() const;
+        void disconnectFromHost();
+        void abort();
+        QHostAddress peerAddress() const;
+        quint16 peerPort() const;
+        void release();
+
+    public:
+        enum Operation
+        {
+            Receive = 0,
+            Send    = 1
+        };
+
+        void start();
+        void completed( Operation op, int result );
+        void shutDown();
+        void detach();
+
+    private:
+        ~UringTransport();
+        void receive();
+        void send();
+        void finishIfUnused();
+
+    private:
+        enum { BufferSize = 16 * 1024 };
+
+        int             mFd;
+        UringLoop*      mLoop;
+        int             mInFlight;
+        bool            mReleased;      // The connection is gone
+        bool            mShutDown;
+        bool            mClosing;       // Close once everything is sent
+
+        char            mRecvBuffer[ BufferSize ];
+        int             mRecvLength;
+        int             mRecvOffset;
+
+        QByteArray      mSending;       // Owned by the kernel while a send is in flight
+        int             mSendOffset;
+        QByteArray      mQueued;
+
+        QHostAddress    mPeerAddress;
+        quint16         mPeerPort;
+    };
+
+}
+
+#endif
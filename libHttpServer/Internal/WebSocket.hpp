@@ -0,0 +1,94 @@
+/*
+ * Modern CI
+ * Copyright (C) 2012-2013 Sascha Cunz <sascha@babbelbox.org>
+ *
+ * This program is free software; you can redistribute it and/or modify it under the terms of the
+ * GNU General Public License (Version 2) as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without
+ * even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this program; if
+ * not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef HTTP_WEBSOCKET_PRIVATE_HPP
+#define HTTP_WEBSOCKET_PRIVATE_HPP
+
+#include <QByteArray>
+#include <QHostAddress>
+
+#include "libHttpServer/WebSocket.hpp"
+
+#include "libHttpServer/Internal/WebSocketFrame.hpp"
+
+namespace HTTP
+{
+
+    class Connection;
+
+    class WebSocket::Data
+    {
+    public:
+        Data( Connection* connection );
+
+    public:
+        enum State
+        {
+            Open,
+            Closing,        // We sent a close frame and wait for the client's
+            Closed
+        };
+
+        void received( const char* data, size_t length );
+        void connectionLost();
+        bool send( WebSocketFrame::Opcode opcode, const QByteArray& payload );
+        void sendClose( int code, const QByteArray& reason );
+        void fail( int code );
+
+        static StatusCode handshake( Method method, Version version, const HeadersHash& headers,
+                                     QByteArray& accept );
+
+    private:
+        bool startFrame();
+        bool endFrame();
+        bool deliverMessage();
+        bool receivedClose();
+        void finish( int code, const QString& reason );
+
+    public:
+        WebSocket*      mSocket;
+        Connection*     mConnection;    // NULL once the connection was lost
+        QByteArray      mUrl;
+        HeadersHash     mHeaders;
+        QByteArray      mProtocol;
+        QHostAddress    mRemoteAddr;
+        quint16         mRemotePort;
+        State           mState;
+        int             mMaxMessageSize;
+
+        // The frame being received
+        unsigned char   mHeader[ WebSocketFrame::MaxHeaderSize ];
+        int             mHeaderLength;  // Bytes of mHeader received so far
+        int             mOpcode;
+        unsigned char   mKey[ 4 ];
+        qint64          mRemaining;     // Payload bytes still to come
+        int             mPhase;         // Position in mKey of the next payload byte
+        QByteArray*     mTarget;        // Where the payload is unmasked to
+        int             mTargetOffset;
+
+        QByteArray      mControl;       // Payload of a control frame
+        QByteArray      mMessage;       // Data frames of the message so far, unmasked
+        int             mMessageOpcode; // Text or Binary; Continuation if none is in progress
+        bool            mMessageFin;    // The current frame is the message's last
+
+        static const int sDefaultMaxMessageSize = 16 * 1024 * 1024;
+        static const int sCloseTimeout = 5000;  // msecs the client gets to answer a close
+        static const int sCopyThreshold = 1024; // Smaller payloads are copied behind the header
+    };
+
+}
+
+#endif
@@ -0,0 +1,213 @@
+/*
+ * Modern CI
+ * Copyright (C) 2012-2013 Sascha Cunz <sascha@babbelbox.org>
+ *
+ * This program is free software; you can redistribute it and/or modify it under the terms of the
+ * GNU General Public License (Version 2) as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without
+ * even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this program; if
+ * not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <string.h>
+
+#include <QCryptographicHash>
+
+#include "libHttpServer/Internal/WebSocketFrame.hpp"
+
+#if defined( __SSE2__ ) || defined( _M_X64 )
+#include <emmintrin.h>
+#define HTTP_WEBSOCKET_SSE2
+#endif
+
+namespace HTTP
+{
+
+    namespace WebSocketFrame
+    {
+
+        int headerSize( unsigned char secondByte )
+        {
+            int size = 2;
+
+            switch( secondByte & 0x7f )
+            {
+            case 126:   size += 2; break;
+            case 127:   size += 8; break;
+            default:    break;
+            }
+
+            if( secondByte & 0x80 )
+            {
+                size += 4;  // Masking key
+            }
+
+            return size;
+        }
+
+        QByteArray header( Opcode opcode, qint64 payloadLength )
+        {
+            char buffer[ MaxHeaderSize ];
+            int size = 2;
+
+            buffer[ 0 ] = char( 0x80 | opcode );  // FIN; we never fragment
+
+            if( payloadLength < 126 )
+            {
+                buffer[ 1 ] = char( payloadLength );
+            }
+            else if( payloadLength < 0x10000 )
+            {
+                buffer[ 1 ] = 126;
+                buffer[ 2 ] = char( payloadLength >> 8 );
+                buffer[ 3 ] = char( payloadLength );
+                size = 4;
+            }
+            else
+            {
+                buffer[ 1 ] = 127;
+                for( int i = 0; i < 8; i++ )
+                {
+                    buffer[ 2 + i ] = char( quint64( payloadLength ) >> ( 56 - 8 * i ) );
+                }
+                size = 10;
+            }
+
+            return QByteArray( buffer, size );
+        }
+
+        void unmaskScalar( char* dst, const char* src, qint64 length,
+                           const unsigned char key[ 4 ], int phase )
+        {
+            for( qint64 i = 0; i < length; i++ )
+            {
+                dst[ i ] = char( src[ i ] ^ key[ ( phase + i ) & 3 ] );
+            }
+        }
+
+        /*
+         * Client payloads are masked, so every byte we receive passes through here once, on its way
+         * from the read buffer into the message. The key is rotated to the phase once, then applied
+         * 16 bytes at a time.
+         */
+        void unmask( char* dst, const char* src, qint64 length, const unsigned char key[ 4 ],
+                     int phase )
+        {
+            unsigned char rotated[ 16 ];
+            for( int i = 0; i < 16; i++ )
+            {
+                rotated[ i ] = key[ ( phase + i ) & 3 ];
+            }
+
+            qint64 i = 0;
+
+            #ifdef HTTP_WEBSOCKET_SSE2
+            const __m128i mask = _mm_loadu_si128( reinterpret_cast< const __m128i* >( rotated ) );
+            for( ; i + 16 <= length; i += 16 )
+            {
+                __m128i v = _mm_loadu_si128( reinterpret_cast< const __m128i* >( src + i ) );
+                _mm_storeu_si128( reinterpret_cast< __m128i* >( dst + i ), _mm_xor_si128( v, mask ) );
+            }
+            #else
+            quint64 mask;
+            memcpy( &mask, rotated, sizeof( mask ) );
+            for( ; i + 8 <= length; i += 8 )
+            {
+                quint64 v;
+                memcpy( &v, src + i, sizeof( v ) );
+                v ^= mask;
+                memcpy( dst + i, &v, sizeof( v ) );
+            }
+            #endif
+
+            // Whole blocks keep the phase
+            unmaskScalar( dst + i, src + i, length - i, key, phase );
+        }
+
+        /*
+         * Rejects overlong forms, surrogates and code points beyond U+10FFFF, as RFC 6455 requires
+         * for text messages and close reasons.
+         */
+        bool isValidUtf8( const char* data, int length )
+        {
+            const unsigned char* p = reinterpret_cast< const unsigned char* >( data );
+            const unsigned char* end = p + length;
+
+            while( p < end )
+            {
+                // Runs of ASCII are the common case
+                if( *p < 0x80 )
+                {
+                    p++;
+                    continue;
+                }
+
+                int more;
+                unsigned char min = 0x80, max = 0xbf;   // Range of the second byte
+
+                if( *p >= 0xc2 && *p <= 0xdf )
+                {
+                    more = 1;
+                }
+                else if( *p >= 0xe0 && *p <= 0xef )
+                {
+                    more = 2;
+                    if( *p == 0xe0 ) min = 0xa0;
+                    if( *p == 0xed ) max = 0x9f;
+                }
+                else if( *p >= 0xf0 && *p <= 0xf4 )
+                {
+                    more = 3;
+                    if( *p == 0xf0 ) min = 0x90;
+                    if( *p == 0xf4 ) max = 0x8f;
+                }
+                else
+                {
+                    return false;
+                }
+
+                if( end - p <= more || p[ 1 ] < min || p[ 1 ] > max )
+                {
+                    return false;
+                }
+
+                for( int i = 2; i <= more; i++ )
+                {
+                    if( ( p[ i ] & 0xc0 ) != 0x80 )
+                    {
+                        return false;
+                    }
+                }
+
+                p += more + 1;
+            }
+
+            return true;
+        }
+
+        bool isValidCloseCode( quint16 code )
+        {
+            // 1004 is reserved, 1005 and 1006 must not be sent, 1015 is for TLS failures
+            if( code >= 1000 && code <= 1011 )
+            {
+                return code != 1004 && code != 1005 && code != 1006;
+            }
+
+            return code >= 3000 && code <= 4999;
+        }
+
+        QByteArray acceptKey( const QByteArray& key )
+        {
+            static const char sGuid[] = "258EAFA5-E914-47DA-95CA-C5AB0DC85B11";
+
+            return QCryptographicHash::hash( key + sGuid, QCryptographicHash::Sha1 ).toBase64();
+        }
+
+    }
+
+}
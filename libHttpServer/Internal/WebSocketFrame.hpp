@@ -0,0 +1,73 @@
+/*
+ * Modern CI
+ * Copyright (C) 2012-2013 Sascha Cunz <sascha@babbelbox.org>
+ *
+ * This program is free software; you can redistribute it and/or modify it under the terms of the
+ * GNU General Public License (Version 2) as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without
+ * even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this program; if
+ * not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef HTTP_WEBSOCKET_FRAME_HPP
+#define HTTP_WEBSOCKET_FRAME_HPP
+
+#include <QByteArray>
+
+namespace HTTP
+{
+
+    /*
+     * The bits of RFC 6455 that do not depend on a connection.
+     */
+    namespace WebSocketFrame
+    {
+
+        enum Opcode
+        {
+            Continuation    = 0x0,
+            Text            = 0x1,
+            Binary          = 0x2,
+            Close           = 0x8,
+            Ping            = 0x9,
+            Pong            = 0xA
+        };
+
+        enum
+        {
+            MaxHeaderSize       = 14,
+            MaxControlPayload   = 125
+        };
+
+        // Bytes of the header, once its first two are known
+        int headerSize( unsigned char secondByte );
+
+        // Header of an unfragmented, unmasked frame, as the server sends it
+        QByteArray header( Opcode opcode, qint64 payloadLength );
+
+        /*
+         * Copies `length` bytes from `src` to `dst`, XOR-ing them with the masking key. `phase` is
+         * the position in the key of the first byte, so a payload can be unmasked piece by piece.
+         * `dst` may be `src`.
+         */
+        void unmask( char* dst, const char* src, qint64 length, const unsigned char key[ 4 ],
+                     int phase );
+        void unmaskScalar( char* dst, const char* src, qint64 length,
+                           const unsigned char key[ 4 ], int phase );
+
+        bool isValidUtf8( const char* data, int length );
+        bool isValidCloseCode( quint16 code );
+
+        // The Sec-WebSocket-Accept value for a client's Sec-WebSocket-Key
+        QByteArray acceptKey( const QByteArray& key );
+
+    }
+
+}
+
+#endif
@@ -22,6 +22,7 @@
  * IN THE SOFTWARE.
  */
 #include "http_parser.h"
+#include "http_scan.h"
 #include <assert.h>
 #include <stddef.h>
 #include <ctype.h>
@@ -108,6 +109,22 @@ do {                                                                 \
 #define CALLBACK_DATA_NOADVANCE(FOR)                                 \
     CALLBACK_DATA_(FOR, p - FOR##_mark, p - data)
 
+/* How far a vectorized scan may skip ahead from the current byte: to the end
+ * of the data, but not beyond the point where the header size limit would
+ * hit, so that is still found by the byte-by-byte loop.
+ */
+#define SCAN_LIMIT()                                                 \
+  MIN((size_t)(data + len - p - 1),                                  \
+      (size_t)(HTTP_MAX_HEADER_SIZE - parser->nread))
+
+/* Skips the run the given scanner finds after the current byte */
+#define SCAN_AHEAD(SCANNER)                                          \
+do {                                                                 \
+  size_t run_ = SCANNER(p + 1, SCAN_LIMIT());                        \
+  parser->nread += (uint32_t)run_;                                   \
+  p += run_;                                                         \
+} while (0)
+
 /* Set the mark FOR; non-destructive if mark is already set */
 #define MARK(FOR)                                                    \
 do {                                                                 \
@@ -116,6 +133,49 @@ do {                                                                 \
   }                                                                  \
 } while (0)
 
+/* Header data goes into spans while batching, or straight to the per-field
+ * callback otherwise. Running out of spans ends the batch: what was
+ * collected so far is flushed through the callbacks.
+ */
+#define HEADER_DATA_(FOR, LEN, ER)                                   \
+do {                                                                 \
+  if (span_count >= 0 && FOR##_mark) {                               \
+    if (add_span(spans, &span_count, FOR##_mark, (LEN),              \
+                 &FOR##_mark == &header_field_mark)) {               \
+      FOR##_mark = NULL;                                             \
+    } else {                                                         \
+      END_BATCH(ER);                                                 \
+      CALLBACK_DATA_(FOR, LEN, ER);                                  \
+    }                                                                \
+  } else {                                                           \
+    CALLBACK_DATA_(FOR, LEN, ER);                                    \
+  }                                                                  \
+} while (0)
+
+#define HEADER_DATA(FOR)                                             \
+    HEADER_DATA_(FOR, p - FOR##_mark, p - data + 1)
+
+#define HEADER_DATA_NOADVANCE(FOR)                                   \
+    HEADER_DATA_(FOR, p - FOR##_mark, p - data)
+
+/* Flushes the spans collected so far and stops batching */
+#define END_BATCH(ER)                                                \
+do {                                                                 \
+  int count_ = span_count;                                           \
+  span_count = NO_BATCH;                                             \
+  if (count_ > 0 && flush_spans(parser, settings, spans, count_)) {  \
+    return (ER);                                                     \
+  }                                                                  \
+} while (0)
+
+/* Batching only starts with a message, so the whole head is in this call */
+#define BEGIN_BATCH()                                                \
+do {                                                                 \
+  span_count = settings->on_headers ? 0 : NO_BATCH;                  \
+} while (0)
+
+#define NO_BATCH (-1)
+
 
 #define PROXY_CONNECTION "proxy-connection"
 #define CONNECTION "connection"
@@ -569,6 +629,66 @@ parse_url_char(enum state s, const char ch)
   return s_dead;
 }
 
+/* Adds a header name or value to the batch; returns 0 if it is full */
+static int
+add_span (struct http_header_span *spans, int *count, const char *at,
+          size_t len, int is_name)
+{
+  struct http_header_span *last = *count ? &spans[*count - 1] : NULL;
+
+  if (!is_name && last && last->name && !last->value) {
+    last->value = at;
+    last->value_len = len;
+    return 1;
+  }
+
+  if (*count == HTTP_MAX_HEADER_SPANS) {
+    return 0;
+  }
+
+  last = &spans[(*count)++];
+  last->name = is_name ? at : NULL;
+  last->name_len = is_name ? len : 0;
+  last->value = is_name ? NULL : at;
+  last->value_len = is_name ? 0 : len;
+  return 1;
+}
+
+/* Replays batched headers through the per-field callbacks; returns non-zero
+ * if one failed or paused the parser
+ */
+static int
+flush_spans (http_parser *parser, const http_parser_settings *settings,
+             const struct http_header_span *spans, int count)
+{
+  int i;
+
+  for (i = 0; i < count; i++) {
+    if (spans[i].name && settings->on_header_field) {
+      if (0 != settings->on_header_field(parser, spans[i].name,
+                                         spans[i].name_len)) {
+        SET_ERRNO(HPE_CB_header_field);
+      }
+      if (HTTP_PARSER_ERRNO(parser) != HPE_OK) {
+        return 1;
+      }
+    }
+
+    if (spans[i].value && settings->on_header_value) {
+      if (0 != settings->on_header_value(parser, spans[i].value,
+                                         spans[i].value_len)) {
+        SET_ERRNO(HPE_CB_header_value);
+      }
+      if (HTTP_PARSER_ERRNO(parser) != HPE_OK) {
+        return 1;
+      }
+    }
+  }
+
+  return 0;
+}
+
+
 size_t http_parser_execute (http_parser *parser,
                             const http_parser_settings *settings,
                             const char *data,
@@ -581,6 +701,8 @@ size_t http_parser_execute (http_parser *parser,
   const char *header_value_mark = 0;
   const char *url_mark = 0;
   const char *body_mark = 0;
+  struct http_header_span spans[HTTP_MAX_HEADER_SPANS];
+  int span_count = NO_BATCH;
 
   /* We're in an error state. Don't bother doing anything. */
   if (HTTP_PARSER_ERRNO(parser) != HPE_OK) {
@@ -665,6 +787,7 @@ size_t http_parser_execute (http_parser *parser,
           parser->state = s_res_or_resp_H;
 
           CALLBACK_NOTIFY(message_begin);
+          BEGIN_BATCH();
         } else {
           parser->type = HTTP_REQUEST;
           parser->state = s_start_req;
@@ -711,6 +834,7 @@ size_t http_parser_execute (http_parser *parser,
         }
 
         CALLBACK_NOTIFY(message_begin);
+        BEGIN_BATCH();
         break;
       }
 
@@ -905,6 +1029,7 @@ size_t http_parser_execute (http_parser *parser,
         parser->state = s_req_method;
 
         CALLBACK_NOTIFY(message_begin);
+        BEGIN_BATCH();
 
         break;
       }
@@ -1044,6 +1169,10 @@ size_t http_parser_execute (http_parser *parser,
               SET_ERRNO(HPE_INVALID_URL);
               goto error;
             }
+            if (parser->state == s_req_path ||
+                parser->state == s_req_query_string) {
+              SCAN_AHEAD(http_scan_url);
+            }
         }
         break;
       }
@@ -1227,6 +1356,7 @@ size_t http_parser_execute (http_parser *parser,
         if (c) {
           switch (parser->header_state) {
             case h_general:
+              SCAN_AHEAD(http_scan_header_field);
               break;
 
             case h_C:
@@ -1330,19 +1460,19 @@ size_t http_parser_execute (http_parser *parser,
 
         if (ch == ':') {
           parser->state = s_header_value_start;
-          CALLBACK_DATA(header_field);
+          HEADER_DATA(header_field);
           break;
         }
 
         if (ch == CR) {
           parser->state = s_header_almost_done;
-          CALLBACK_DATA(header_field);
+          HEADER_DATA(header_field);
           break;
         }
 
         if (ch == LF) {
           parser->state = s_header_field_start;
-          CALLBACK_DATA(header_field);
+          HEADER_DATA(header_field);
           break;
         }
 
@@ -1362,13 +1492,13 @@ size_t http_parser_execute (http_parser *parser,
         if (ch == CR) {
           parser->header_state = h_general;
           parser->state = s_header_almost_done;
-          CALLBACK_DATA(header_value);
+          HEADER_DATA(header_value);
           break;
         }
 
         if (ch == LF) {
           parser->state = s_header_field_start;
-          CALLBACK_DATA(header_value);
+          HEADER_DATA(header_value);
           break;
         }
 
@@ -1422,13 +1552,13 @@ size_t http_parser_execute (http_parser *parser,
 
         if (ch == CR) {
           parser->state = s_header_almost_done;
-          CALLBACK_DATA(header_value);
+          HEADER_DATA(header_value);
           break;
         }
 
         if (ch == LF) {
           parser->state = s_header_almost_done;
-          CALLBACK_DATA_NOADVANCE(header_value);
+          HEADER_DATA_NOADVANCE(header_value);
           goto reexecute_byte;
         }
 
@@ -1436,6 +1566,7 @@ size_t http_parser_execute (http_parser *parser,
 
         switch (parser->header_state) {
           case h_general:
+            SCAN_AHEAD(http_scan_header_value);
             break;
 
           case h_connection:
@@ -1566,6 +1697,18 @@ size_t http_parser_execute (http_parser *parser,
         parser->upgrade =
           (parser->flags & F_UPGRADE || parser->method == HTTP_CONNECT);
 
+        if (span_count >= 0) {
+          size_t count = (size_t)span_count;
+          span_count = NO_BATCH;
+
+          if (0 != settings->on_headers(parser, spans, count)) {
+            SET_ERRNO(HPE_CB_headers);
+          }
+          if (HTTP_PARSER_ERRNO(parser) != HPE_OK) {
+            return p - data;
+          }
+        }
+
         /* Here we call the headers_complete callback. This is somewhat
          * different than other callbacks because if the user returns 1, we
          * will interpret that as saying that this message has no body. This
@@ -1828,6 +1971,9 @@ size_t http_parser_execute (http_parser *parser,
           (url_mark ? 1 : 0)  +
           (body_mark ? 1 : 0)) <= 1);
 
+  /* The message head did not fit into this call after all */
+  END_BATCH(p - data);
+
   CALLBACK_DATA_NOADVANCE(header_field);
   CALLBACK_DATA_NOADVANCE(header_value);
   CALLBACK_DATA_NOADVANCE(url);
@@ -53,6 +53,13 @@ typedef unsigned __int64 uint64_t;
 /* Maximium header size allowed */
 #define HTTP_MAX_HEADER_SIZE (80*1024)
 
+/* Maximum number of headers handed to on_headers at once; more are reported
+ * through the per-field callbacks
+ */
+#ifndef HTTP_MAX_HEADER_SPANS
+# define HTTP_MAX_HEADER_SPANS 64
+#endif
+
 
 typedef struct http_parser http_parser;
 typedef struct http_parser_settings http_parser_settings;
@@ -75,6 +82,27 @@ typedef int (*http_data_cb) (http_parser*, const char *at, size_t length);
 typedef int (*http_cb) (http_parser*);
 
 
+/* A header as found in the input. A value without a name continues the
+ * value before it (obsolete line folding). An empty value has no data.
+ */
+struct http_header_span {
+  const char *name;
+  size_t name_len;
+  const char *value;
+  size_t value_len;
+};
+
+/* on_headers is called right before on_headers_complete with all headers of
+ * the message, in place of on_header_field and on_header_value. That only
+ * works if the whole message head is passed to one http_parser_execute()
+ * call and it has at most HTTP_MAX_HEADER_SPANS headers; otherwise, the
+ * per-field callbacks are used as usual.
+ */
+typedef int (*http_headers_cb) (http_parser*,
+                                const struct http_header_span *headers,
+                                size_t count);
+
+
 /* Request Methods */
 #define HTTP_METHOD_MAP(XX)         \
   XX(0,  DELETE,      DELETE)       \
@@ -144,6 +172,7 @@ enum flags
   XX(CB_url, "the on_url callback failed")                           \
   XX(CB_header_field, "the on_header_field callback failed")         \
   XX(CB_header_value, "the on_header_value callback failed")         \
+  XX(CB_headers, "the on_headers callback failed")                   \
   XX(CB_headers_complete, "the on_headers_complete callback failed") \
   XX(CB_body, "the on_body callback failed")                         \
   XX(CB_message_complete, "the on_message_complete callback failed") \
@@ -226,6 +255,7 @@ struct http_parser_settings {
   http_cb      on_headers_complete;
   http_data_cb on_body;
   http_cb      on_message_complete;
+  http_headers_cb on_headers;   /* optional; see above */
 };
 
 
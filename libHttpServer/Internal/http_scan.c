@@ -0,0 +1,276 @@
+/*
+ * Modern CI
+ * Copyright (C) 2012-2013 Sascha Cunz <sascha@babbelbox.org>
+ *
+ * This program is free software; you can redistribute it and/or modify it under the terms of the
+ * GNU General Public License (Version 2) as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without
+ * even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this program; if
+ * not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "http_scan.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+# define HTTP_SCAN_X86 1
+# include <immintrin.h>
+#else
+# define HTTP_SCAN_X86 0
+#endif
+
+typedef size_t (*scan_fn)(const char *p, size_t len);
+
+/* Where measured, AVX2 did not beat SSE4.2 on real headers: most runs end
+ * within the first block, and the wider loads only add latency there.
+ */
+#define HTTP_SCAN_DEFAULT HTTP_SCAN_SSE42
+
+/* Header names, as 8 ranges for PCMPESTRI. This leaves out '~' (it does not
+ * fit), so scanning just stops early there.
+ */
+static const char field_ranges[16] =
+  "!!" "#'" "*+" "-." "09" "AZ" "^z" "||";
+
+
+static int is_value_char(unsigned char c)
+{
+  return c != '\r' && c != '\n';
+}
+
+static int is_field_char(unsigned char c)
+{
+  int i;
+  for (i = 0; i < 16; i += 2) {
+    if (c >= (unsigned char)field_ranges[i] &&
+        c <= (unsigned char)field_ranges[i + 1]) {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+/* Also stops at 0x80 and above, which only non-strict parsers accept */
+static int is_url_char(unsigned char c)
+{
+  return c > ' ' && c < 0x7f && c != '?' && c != '#';
+}
+
+static size_t value_scalar(const char *p, size_t len)
+{
+  size_t i = 0;
+  while (i < len && is_value_char((unsigned char)p[i])) i++;
+  return i;
+}
+
+static size_t field_scalar(const char *p, size_t len)
+{
+  size_t i = 0;
+  while (i < len && is_field_char((unsigned char)p[i])) i++;
+  return i;
+}
+
+static size_t url_scalar(const char *p, size_t len)
+{
+  size_t i = 0;
+  while (i < len && is_url_char((unsigned char)p[i])) i++;
+  return i;
+}
+
+#if HTTP_SCAN_X86
+
+/* The vector loops only run on whole blocks and leave the tail (and short
+ * runs, which are the common case for values like "keep-alive") to the
+ * scalar versions.
+ */
+
+__attribute__((target("sse4.2")))
+static size_t value_sse42(const char *p, size_t len)
+{
+  const __m128i cr = _mm_set1_epi8('\r');
+  const __m128i lf = _mm_set1_epi8('\n');
+  size_t i = 0;
+
+  for (; i + 16 <= len; i += 16) {
+    __m128i v = _mm_loadu_si128((const __m128i *)(p + i));
+    int mask = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(v, cr),
+                                              _mm_cmpeq_epi8(v, lf)));
+    if (mask) {
+      return i + __builtin_ctz(mask);
+    }
+  }
+
+  return i + value_scalar(p + i, len - i);
+}
+
+__attribute__((target("sse4.2")))
+static size_t field_sse42(const char *p, size_t len)
+{
+  const __m128i ranges = _mm_loadu_si128((const __m128i *)field_ranges);
+  size_t i = 0;
+
+  for (; i + 16 <= len; i += 16) {
+    __m128i v = _mm_loadu_si128((const __m128i *)(p + i));
+    int n = _mm_cmpestri(ranges, 16, v, 16,
+                         _SIDD_UBYTE_OPS | _SIDD_CMP_RANGES |
+                         _SIDD_NEGATIVE_POLARITY | _SIDD_LEAST_SIGNIFICANT);
+    if (n != 16) {
+      return i + n;
+    }
+  }
+
+  return i + field_scalar(p + i, len - i);
+}
+
+/* Signed compare: bytes of 0x80 and above are negative, so they stop too */
+__attribute__((target("sse4.2")))
+static size_t url_sse42(const char *p, size_t len)
+{
+  const __m128i low = _mm_set1_epi8('!');
+  const __m128i del = _mm_set1_epi8(0x7f);
+  const __m128i question = _mm_set1_epi8('?');
+  const __m128i hash = _mm_set1_epi8('#');
+  size_t i = 0;
+
+  for (; i + 16 <= len; i += 16) {
+    __m128i v = _mm_loadu_si128((const __m128i *)(p + i));
+    __m128i stop = _mm_or_si128(
+      _mm_or_si128(_mm_cmplt_epi8(v, low), _mm_cmpeq_epi8(v, del)),
+      _mm_or_si128(_mm_cmpeq_epi8(v, question), _mm_cmpeq_epi8(v, hash)));
+    int mask = _mm_movemask_epi8(stop);
+    if (mask) {
+      return i + __builtin_ctz(mask);
+    }
+  }
+
+  return i + url_scalar(p + i, len - i);
+}
+
+__attribute__((target("avx2")))
+static size_t value_avx2(const char *p, size_t len)
+{
+  const __m256i cr = _mm256_set1_epi8('\r');
+  const __m256i lf = _mm256_set1_epi8('\n');
+  size_t i = 0;
+
+  for (; i + 32 <= len; i += 32) {
+    __m256i v = _mm256_loadu_si256((const __m256i *)(p + i));
+    unsigned mask = (unsigned)_mm256_movemask_epi8(
+      _mm256_or_si256(_mm256_cmpeq_epi8(v, cr), _mm256_cmpeq_epi8(v, lf)));
+    if (mask) {
+      return i + __builtin_ctz(mask);
+    }
+  }
+
+  return i + value_sse42(p + i, len - i);
+}
+
+__attribute__((target("avx2")))
+static size_t url_avx2(const char *p, size_t len)
+{
+  const __m256i low = _mm256_set1_epi8('!');
+  const __m256i del = _mm256_set1_epi8(0x7f);
+  const __m256i question = _mm256_set1_epi8('?');
+  const __m256i hash = _mm256_set1_epi8('#');
+  size_t i = 0;
+
+  for (; i + 32 <= len; i += 32) {
+    __m256i v = _mm256_loadu_si256((const __m256i *)(p + i));
+    __m256i stop = _mm256_or_si256(
+      _mm256_or_si256(_mm256_cmpgt_epi8(low, v), _mm256_cmpeq_epi8(v, del)),
+      _mm256_or_si256(_mm256_cmpeq_epi8(v, question), _mm256_cmpeq_epi8(v, hash)));
+    unsigned mask = (unsigned)_mm256_movemask_epi8(stop);
+    if (mask) {
+      return i + __builtin_ctz(mask);
+    }
+  }
+
+  return i + url_sse42(p + i, len - i);
+}
+
+#endif /* HTTP_SCAN_X86 */
+
+
+/* Always valid, so there is nothing to resolve lazily (and no race between the
+ * parsing threads doing so). The default level is selected once, while the
+ * library is loaded.
+ */
+static scan_fn scan_value = value_scalar;
+static scan_fn scan_field = field_scalar;
+static scan_fn scan_url = url_scalar;
+static enum http_scan_level scan_level = HTTP_SCAN_SCALAR;
+
+#if HTTP_SCAN_X86
+__attribute__((constructor))
+static void scan_init(void)
+{
+  http_scan_set_level(HTTP_SCAN_DEFAULT);
+}
+#endif
+
+size_t http_scan_header_value(const char *p, size_t len)
+{
+  return scan_value(p, len);
+}
+
+size_t http_scan_header_field(const char *p, size_t len)
+{
+  return scan_field(p, len);
+}
+
+size_t http_scan_url(const char *p, size_t len)
+{
+  return scan_url(p, len);
+}
+
+enum http_scan_level http_scan_best_level(void)
+{
+#if HTTP_SCAN_X86
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2")) return HTTP_SCAN_AVX2;
+  if (__builtin_cpu_supports("sse4.2")) return HTTP_SCAN_SSE42;
+#endif
+  return HTTP_SCAN_SCALAR;
+}
+
+enum http_scan_level http_scan_set_level(enum http_scan_level level)
+{
+  enum http_scan_level best = http_scan_best_level();
+  if (level > best) level = best;
+
+  switch (level) {
+#if HTTP_SCAN_X86
+    case HTTP_SCAN_AVX2:
+      /* Names are too short for 32 byte blocks to pay off */
+      scan_value = value_avx2;
+      scan_field = field_sse42;
+      scan_url = url_avx2;
+      break;
+
+    case HTTP_SCAN_SSE42:
+      scan_value = value_sse42;
+      scan_field = field_sse42;
+      scan_url = url_sse42;
+      break;
+#endif
+
+    default:
+      level = HTTP_SCAN_SCALAR;
+      scan_value = value_scalar;
+      scan_field = field_scalar;
+      scan_url = url_scalar;
+      break;
+  }
+
+  scan_level = level;
+  return level;
+}
+
+enum http_scan_level http_scan_current_level(void)
+{
+  return scan_level;
+}
@@ -0,0 +1,61 @@
+/*
+ * Modern CI
+ * Copyright (C) 2012-2013 Sascha Cunz <sascha@babbelbox.org>
+ *
+ * This program is free software; you can redistribute it and/or modify it under the terms of the
+ * GNU General Public License (Version 2) as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without
+ * even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this program; if
+ * not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef HTTP_SCAN_H
+#define HTTP_SCAN_H
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Vectorized runs for http_parser.c. Each scanner returns the length of the
+ * run at `p` (at most `len` bytes) that leaves the parser's state alone. A
+ * scanner may stop early, e.g. at a byte that is valid but rare; the parser
+ * then simply continues byte by byte.
+ */
+
+enum http_scan_level
+  { HTTP_SCAN_SCALAR = 0
+  , HTTP_SCAN_SSE42           /* 16 bytes at a time */
+  , HTTP_SCAN_AVX2            /* 32 bytes at a time where it pays off */
+  };
+
+/* Up to the CR or LF that ends a header value */
+size_t http_scan_header_value(const char *p, size_t len);
+
+/* Over characters of a header name */
+size_t http_scan_header_field(const char *p, size_t len);
+
+/* Over characters of a URL's path or query string, up to ' ', '?' or '#' */
+size_t http_scan_url(const char *p, size_t len);
+
+/* The best level this CPU supports */
+enum http_scan_level http_scan_best_level(void);
+
+/* Selects the implementation; clamped to the best level. Not thread safe, so
+ * call it before anything is parsed. Without a call, SSE4.2 is selected while the
+ * library is loaded, where the CPU has it.
+ */
+enum http_scan_level http_scan_set_level(enum http_scan_level level);
+enum http_scan_level http_scan_current_level(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
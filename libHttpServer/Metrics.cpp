@@ -0,0 +1,189 @@
+/*
+ * Modern CI
+ * Copyright (C) 2012-2013 Sascha Cunz <sascha@babbelbox.org>
+ *
+ * This program is free software; you can redistribute it and/or modify it under the terms of the
+ * GNU General Public License (Version 2) as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without
+ * even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this program; if
+ * not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <QUrl>
+
+#include "libHttpServer/Metrics.hpp"
+#include "libHttpServer/Server.hpp"
+#include "libHttpServer/Request.hpp"
+#include "libHttpServer/Response.hpp"
+
+namespace HTTP
+{
+
+    LatencySummary::LatencySummary()
+        : mCount( 0 )
+        , mSum( 0 )
+        , mP50( 0 )
+        , mP99( 0 )
+        , mP999( 0 )
+        , mMax( 0 )
+    {
+    }
+
+    ServerMetrics::ServerMetrics()
+        : mAcceptedConnections( 0 )
+        , mRequests( 0 )
+        , mBytesIn( 0 )
+        , mBytesOut( 0 )
+        , mParserErrors( 0 )
+        , mShapedBytes( 0 )
+        , mShaperWaits( 0 )
+    {
+    }
+
+    static void addMetric( QByteArray& out, const char* name, const char* type, const char* help )
+    {
+        out += "# HELP ";
+        out += name;
+        out += ' ';
+        out += help;
+        out += "\n# TYPE ";
+        out += name;
+        out += ' ';
+        out += type;
+        out += '\n';
+    }
+
+    static void addValue( QByteArray& out, const char* name, qint64 value,
+                          const char* label = NULL, int labelValue = 0 )
+    {
+        out += name;
+        if( label )
+        {
+            out += '{';
+            out += label;
+            out += "=\"";
+            out += QByteArray::number( labelValue );
+            out += "\"}";
+        }
+        out += ' ';
+        out += QByteArray::number( value );
+        out += '\n';
+    }
+
+    static void addCounter( QByteArray& out, const char* name, const char* help, qint64 value )
+    {
+        addMetric( out, name, "counter", help );
+        addValue( out, name, value );
+    }
+
+    static void addSummary( QByteArray& out, const char* name, const QByteArray& labels,
+                            const LatencySummary& s )
+    {
+        const char* quantiles[ 4 ] = { "0.5", "0.99", "0.999", "1" };
+        const qint64 values[ 4 ] = { s.mP50, s.mP99, s.mP999, s.mMax };
+
+        for( int i = 0; i < 4; i++ )
+        {
+            out += name;
+            out += '{';
+            out += labels;
+            out += ",quantile=\"";
+            out += quantiles[ i ];
+            out += "\"} ";
+            out += QByteArray::number( values[ i ] );
+            out += '\n';
+        }
+
+        out += name;
+        out += "_sum{";
+        out += labels;
+        out += "} ";
+        out += QByteArray::number( s.mSum );
+        out += '\n';
+
+        out += name;
+        out += "_count{";
+        out += labels;
+        out += "} ";
+        out += QByteArray::number( s.mCount );
+        out += '\n';
+    }
+
+    QByteArray ServerMetrics::toText() const
+    {
+        QByteArray out;
+
+        addCounter( out, "http_connections_accepted_total",
+                    "Connections accepted by the listening socket.", mAcceptedConnections );
+
+        addMetric( out, "http_connections_active", "gauge", "Open connections per worker thread." );
+        for( int i = 0; i < mActiveConnections.count(); i++ )
+        {
+            addValue( out, "http_connections_active", mActiveConnections[ i ], "thread", i );
+        }
+
+        addCounter( out, "http_requests_total", "Requests whose headers were parsed.", mRequests );
+
+        addMetric( out, "http_responses_total", "counter", "Responses by status code." );
+        QMap< int, qint64 >::ConstIterator it = mResponses.constBegin();
+        while( it != mResponses.constEnd() )
+        {
+            addValue( out, "http_responses_total", it.value(), "code", it.key() );
+            ++it;
+        }
+
+        addCounter( out, "http_received_bytes_total", "Bytes read from clients.", mBytesIn );
+        addCounter( out, "http_sent_bytes_total", "Bytes handed to client sockets.", mBytesOut );
+        addCounter( out, "http_parser_errors_total", "Connections closed due to malformed requests.",
+                    mParserErrors );
+        addCounter( out, "http_shaped_bytes_total", "Bytes sent subject to a bandwidth limit.",
+                    mShapedBytes );
+        addCounter( out, "http_shaper_waits_total",
+                    "Times a connection waited for bandwidth to become available.", mShaperWaits );
+
+        const char* latency = "http_request_duration_microseconds";
+        addMetric( out, latency, "summary",
+                   "Request latency per route and stage (parse, handler, total)." );
+        foreach( const RouteLatency& r, mLatencies )
+        {
+            QByteArray route = r.mRoute.toUtf8();
+            route.replace( '\\', "\\\\" ).replace( '"', "\\\"" );
+            route = "route=\"" + route + "\",stage=";
+
+            addSummary( out, latency, route + "\"parse\"", r.mParse );
+            addSummary( out, latency, route + "\"handler\"", r.mHandler );
+            addSummary( out, latency, route + "\"total\"", r.mTotal );
+        }
+
+        return out;
+    }
+
+    MetricsContentProvider::MetricsContentProvider( Server* server, const QString& path,
+                                                    QObject* parent )
+        : ContentProvider( parent )
+        , mServer( server )
+        , mPath( path )
+    {
+    }
+
+    bool MetricsContentProvider::canHandle( const QUrl& url ) const
+    {
+        return url.path() == mPath;
+    }
+
+    void MetricsContentProvider::newRequest( Request* request )
+    {
+        Response* res = request->response();
+
+        res->addHeader( "Content-Type", "text/plain; version=0.0.4" );
+        res->addHeader( "Cache-Control", "no-cache" );
+        res->addBody( mServer->metrics().toText() );
+        res->finish( HTTP::Ok );
+    }
+
+}
@@ -0,0 +1,101 @@
+/*
+ * Modern CI
+ * Copyright (C) 2012-2013 Sascha Cunz <sascha@babbelbox.org>
+ *
+ * This program is free software; you can redistribute it and/or modify it under the terms of the
+ * GNU General Public License (Version 2) as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without
+ * even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this program; if
+ * not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef HTTP_METRICS_HPP
+#define HTTP_METRICS_HPP
+
+#include <QList>
+#include <QMap>
+
+#include "libHttpServer/ContentProvider.hpp"
+
+namespace HTTP
+{
+
+    class Server;
+
+    /*
+     * Percentiles of one latency histogram, in microseconds. They are bucket boundaries, so they
+     * may be up to about 3% larger than the value actually recorded.
+     */
+    class HTTP_SERVER_API LatencySummary
+    {
+    public:
+        LatencySummary();
+
+    public:
+        qint64      mCount;
+        qint64      mSum;
+        qint64      mP50;
+        qint64      mP99;
+        qint64      mP999;
+        qint64      mMax;
+    };
+
+    class HTTP_SERVER_API RouteLatency
+    {
+    public:
+        QString         mRoute;     // The provider's objectName(), or a generated one
+        LatencySummary  mParse;
+        LatencySummary  mHandler;
+        LatencySummary  mTotal;
+    };
+
+    /*
+     * A snapshot of the server's counters, merged from all worker threads. All values except
+     * mActiveConnections count since the server was created.
+     */
+    class HTTP_SERVER_API ServerMetrics
+    {
+    public:
+        ServerMetrics();
+
+    public:
+        QByteArray toText() const;
+
+    public:
+        qint64              mAcceptedConnections;
+        QList< qint64 >     mActiveConnections;     // One entry per worker thread
+        qint64              mRequests;
+        QMap< int, qint64 > mResponses;             // By status code
+        qint64              mBytesIn;
+        qint64              mBytesOut;
+        qint64              mParserErrors;
+        qint64              mShapedBytes;
+        qint64              mShaperWaits;
+        QList< RouteLatency > mLatencies;
+    };
+
+    /*
+     * Serves Server::metrics() in Prometheus' text exposition format at exactly one path.
+     */
+    class HTTP_SERVER_API MetricsContentProvider : public ContentProvider
+    {
+    public:
+        MetricsContentProvider( Server* server, const QString& path, QObject* parent );
+
+    public:
+        bool canHandle( const QUrl& url ) const;
+        void newRequest( Request* request );
+
+    private:
+        Server*     mServer;
+        QString     mPath;
+    };
+
+}
+
+#endif
@@ -0,0 +1,48 @@
+/*
+ * Modern CI
+ * Copyright (C) 2012-2013 Sascha Cunz <sascha@babbelbox.org>
+ *
+ * This program is free software; you can redistribute it and/or modify it under the terms of the
+ * GNU General Public License (Version 2) as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without
+ * even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this program; if
+ * not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef HTTP_OFFLOAD_JOB_HPP
+#define HTTP_OFFLOAD_JOB_HPP
+
+#include "libHttpServer/Http.hpp"
+
+namespace HTTP
+{
+
+    class Request;
+
+    /*
+     * CPU heavy work for a request, see Request::offload(). run() is called on one of the
+     * server's compute threads and must not touch the request or its response; copy whatever it
+     * needs into the job beforehand. completed() is then called back on the connection's thread,
+     * where the response can be sent as usual.
+     *
+     * If the request is gone by then (the client went away), completed() is skipped. Either way
+     * the job is deleted afterwards.
+     */
+    class HTTP_SERVER_API OffloadJob
+    {
+    public:
+        virtual ~OffloadJob();
+
+    public:
+        virtual void run() = 0;
+        virtual void completed( Request* request ) = 0;
+    };
+
+}
+
+#endif
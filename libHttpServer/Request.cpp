@@ -16,34 +16,56 @@
 
 #include <QUrl>
 
+#include "libHttpServer/ContentProvider.hpp"
+#include "libHttpServer/OffloadJob.hpp"
+
 #include "libHttpServer/Internal/Request.hpp"
 #include "libHttpServer/Internal/Response.hpp"
 #include "libHttpServer/Internal/Connection.hpp"
+#include "libHttpServer/Internal/RequestPool.hpp"
 
 namespace HTTP
 {
 
     Request::Data::Data()
     {
-        mState = ReceivingHeaders;
         mRequest = NULL;
+        mGeneration = 0;
+        reset();
+    }
+
+    /*
+     * Brings a recycled request back into the state of a new one; mRequest stays.
+     */
+    void Request::Data::reset()
+    {
+        mState = ReceivingHeaders;
+        mUrl.clear();
+        mHeaders.clear();
+        mBodyData.clear();
         mResponse = NULL;
+        mVersion = V_Unknown;
+        mRemotePort = 0;
+        mRemoteAddr.clear();
+        mMethod = Get;
+        mProvider = NULL;
+        mHandler = NULL;
+        mWebSocketHandler = NULL;
+        mHeadersDone = 0;
+        mBytesIn = 0;
+        mRetired = false;
+        mGeneration++;
     }
 
     void Request::Data::appendHeaderData( const HeaderName& header, const QByteArray& data )
     {
-        if( !mHeaders.contains( header ) )
-        {
-            mHeaders.insert( header, data );
-        }
-        else
-        {
-            mHeaders[ header ].append( data );
-        }
+        // Appending to a new (null) value just shares data
+        mHeaders[ header ].append( data );
     }
 
     void Request::Data::appendBodyData( const QByteArray& data )
     {
+        mBytesIn += data.count();
         mBodyData.append( data );
     }
 
@@ -72,6 +94,12 @@ namespace HTTP
 
     Request::~Request()
     {
+        // A response that is not sent yet still belongs to its handler; it deletes itself once
+        // it is sent and finds the connection gone.
+        if( d->mResponse && d->mResponse->d->mFlags.testFlag( Response::Data::Sent ) )
+        {
+            delete d->mResponse;
+        }
         delete d;
     }
 
@@ -79,9 +107,16 @@ namespace HTTP
     {
         if( !d->mResponse )
         {
-            Response::Data* rd = new Response::Data;
+            Connection* c = qobject_cast< Connection* >( parent() );
+            Response* res = c ? c->pool()->takeResponse() : new Response( new Response::Data );
+
+            Response::Data* rd = res->d;
             rd->mRequest = this;
-            rd->mConnection = qobject_cast< Connection* >( parent() );
+            rd->mConnection = c;
+            if( d->mProvider )
+            {
+                rd->mBandwidthLimit = d->mProvider->mBandwidthLimit;
+            }
 
             if( d->mVersion < V_1_1 )
             {
@@ -95,16 +130,42 @@ namespace HTTP
                 rd->mFlags |= Response::Data::ReadyToSend;
             }
 
-            d->mResponse = new Response( rd );
+            d->mResponse = res;
         }
         return d->mResponse;
     }
 
+    /*
+     * Runs job on one of the server's compute threads, so CPU heavy work does not hold up the
+     * other connections of this thread. The job is owned by the server from here on.
+     */
+    void Request::offload( OffloadJob* job )
+    {
+        Connection* c = qobject_cast< Connection* >( parent() );
+        if( !c )
+        {
+            job->run();
+            job->completed( this );
+            delete job;
+            return;
+        }
+
+        c->offload( this, job );
+    }
+
     QByteArray Request::urlText() const
     {
         return d->mUrl;
     }
 
+    /*
+     * Changes each time the request is recycled; see the class comment.
+     */
+    quint32 Request::generation() const
+    {
+        return d->mGeneration;
+    }
+
     QUrl Request::url() const
     {
         return QUrl::fromEncoded( d->mUrl );
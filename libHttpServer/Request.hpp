@@ -27,7 +27,15 @@ namespace HTTP
 
     class Connection;
     class Response;
-
+    class OffloadJob;
+
+    /*
+     * Requests and their Responses are pooled per worker thread: once a response was sent and
+     * its request received completely, both are reset and handed out again, possibly for a
+     * request on another connection. A QPointer to either does not become NULL then. Code that
+     * keeps one for deferred work must remember generation() along with it and compare before
+     * using it; a different value means the object serves someone else by now.
+     */
     class HTTP_SERVER_API Request : public QObject
     {
         Q_OBJECT
@@ -63,11 +71,21 @@ namespace HTTP
         QHostAddress remoteAddr() const;
         quint16 remotePort() const;
 
+        void offload( OffloadJob* job );
+
+        quint32 generation() const;
+
     signals:
         void completed( HTTP::Request* request );
 
     private:
         friend class Connection;
+        friend class ServerPrivate;
+        friend class Response;
+        friend class MicroBenchmarkAccess;
+        friend class RequestPool;
+        friend class RequestView;
+        friend class OffloadTask;
         class Data;
         Request( Connection* parent, Data* data );
         Data* d;
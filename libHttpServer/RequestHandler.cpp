@@ -0,0 +1,139 @@
+/*
+ * Modern CI
+ * Copyright (C) 2012-2013 Sascha Cunz <sascha@babbelbox.org>
+ *
+ * This program is free software; you can redistribute it and/or modify it under the terms of the
+ * GNU General Public License (Version 2) as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without
+ * even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this program; if
+ * not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <QStringBuilder>
+
+#include "libHttpServer/RequestHandler.hpp"
+
+#include "libHttpServer/Internal/Http.hpp"
+#include "libHttpServer/Internal/Request.hpp"
+#include "libHttpServer/Internal/Connection.hpp"
+
+namespace HTTP
+{
+
+    RequestView::RequestView( const Request* request )
+        : mRequest( request )
+    {
+    }
+
+    QByteArray RequestView::urlText() const
+    {
+        return mRequest->d->mUrl;
+    }
+
+    QByteArray RequestView::path() const
+    {
+        int query = mRequest->d->mUrl.indexOf( '?' );
+        return query == -1 ? mRequest->d->mUrl : mRequest->d->mUrl.left( query );
+    }
+
+    bool RequestView::hasHeader( const HeaderName& header ) const
+    {
+        return mRequest->d->mHeaders.contains( header );
+    }
+
+    HeaderValue RequestView::header( const HeaderName& header ) const
+    {
+        return mRequest->d->mHeaders.value( header );
+    }
+
+    QByteArray RequestView::bodyData() const
+    {
+        return mRequest->d->mBodyData;
+    }
+
+    Version RequestView::httpVersion() const
+    {
+        return mRequest->d->mVersion;
+    }
+
+    Method RequestView::method() const
+    {
+        return mRequest->d->mMethod;
+    }
+
+    QHostAddress RequestView::remoteAddr() const
+    {
+        return mRequest->d->mRemoteAddr;
+    }
+
+    quint16 RequestView::remotePort() const
+    {
+        return mRequest->d->mRemotePort;
+    }
+
+    ResponseWriter::ResponseWriter()
+        : mStatus( Ok )
+    {
+    }
+
+    void ResponseWriter::setStatus( StatusCode code )
+    {
+        mStatus = code;
+    }
+
+    StatusCode ResponseWriter::status() const
+    {
+        return mStatus;
+    }
+
+    void ResponseWriter::addHeader( const HeaderName& header, const HeaderValue& value )
+    {
+        mHeaders += header % ": " % value % CRLF;
+    }
+
+    void ResponseWriter::addBody( const QByteArray& data )
+    {
+        mBody += data;
+    }
+
+    void ResponseWriter::addBody( const char* data, int length )
+    {
+        mBody.append( data, length );
+    }
+
+    /*
+     * The complete response in one buffer, so it reaches the socket with a single write.
+     */
+    QByteArray ResponseWriter::serialize( bool close ) const
+    {
+        QByteArray length = QByteArray::number( mBody.count() );
+        const char* text = code2Text( mStatus );
+
+        QByteArray out;
+        out.reserve( 64 + mHeaders.count() + length.count() + mBody.count() );
+
+        out += "HTTP/1.1 ";
+        out += QByteArray::number( mStatus );
+        out += ' ';
+        out += text ? text : "";
+        out += CRLF;
+        out += mHeaders;
+        out += "Content-Length: ";
+        out += length;
+        out += CRLF;
+        if( close )
+        {
+            out += "Connection: Close" CRLF;
+        }
+        out += CRLF;
+        out += mBody;
+
+        return out;
+    }
+
+}
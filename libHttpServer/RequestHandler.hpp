@@ -0,0 +1,104 @@
+/*
+ * Modern CI
+ * Copyright (C) 2012-2013 Sascha Cunz <sascha@babbelbox.org>
+ *
+ * This program is free software; you can redistribute it and/or modify it under the terms of the
+ * GNU General Public License (Version 2) as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without
+ * even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this program; if
+ * not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef HTTP_REQUEST_HANDLER_HPP
+#define HTTP_REQUEST_HANDLER_HPP
+
+#include <QHostAddress>
+
+#include "libHttpServer/Http.hpp"
+
+namespace HTTP
+{
+
+    class Request;
+
+    /*
+     * Read only access to a request that is handled by an IRequestHandler. Only valid during
+     * IRequestHandler::handle().
+     */
+    class HTTP_SERVER_API RequestView
+    {
+    public:
+        QByteArray urlText() const;
+        QByteArray path() const;
+
+        bool hasHeader( const HeaderName& header ) const;
+        HeaderValue header( const HeaderName& header ) const;
+        QByteArray bodyData() const;
+
+        Version httpVersion() const;
+        Method method() const;
+
+        QHostAddress remoteAddr() const;
+        quint16 remotePort() const;
+
+    private:
+        friend class Connection;
+        RequestView( const Request* request );
+        RequestView( const RequestView& );
+        RequestView& operator=( const RequestView& );
+
+        const Request* mRequest;
+    };
+
+    /*
+     * Collects a response of an IRequestHandler; it is sent as soon as handle() returns. Headers
+     * are written out in the order they are added and are not checked: Content-Length and
+     * Connection are added by the server and must not be set here.
+     */
+    class HTTP_SERVER_API ResponseWriter
+    {
+    public:
+        void setStatus( StatusCode code );
+        StatusCode status() const;
+
+        void addHeader( const HeaderName& header, const HeaderValue& value );
+        void addBody( const QByteArray& data );
+        void addBody( const char* data, int length );
+
+    private:
+        friend class Connection;
+        ResponseWriter();
+        ResponseWriter( const ResponseWriter& );
+        ResponseWriter& operator=( const ResponseWriter& );
+
+        QByteArray serialize( bool close ) const;
+
+        StatusCode  mStatus;
+        QByteArray  mHeaders;
+        QByteArray  mBody;
+    };
+
+    /*
+     * A handler for endpoints that need the highest request rate. Unlike a ContentProvider, it is
+     * called directly from the parser once a request was received completely. The Request it
+     * reads from is only storage taken from the connection's pool and handed back right after;
+     * no Response object is created, no signals are emitted and nothing is deferred to the event
+     * loop.
+     *
+     * handle() is called on the connection's worker thread, so with several worker threads it
+     * must be thread safe. It has to answer synchronously.
+     */
+    class IRequestHandler
+    {
+    public:
+        virtual void handle( const RequestView& request, ResponseWriter& response ) = 0;
+    };
+
+}
+
+#endif
@@ -17,9 +17,12 @@
 #include <QStringBuilder>
 
 #include "libHttpServer/Internal/Http.hpp"
+#include "libHttpServer/Internal/Request.hpp"
 #include "libHttpServer/Internal/Response.hpp"
 #include "libHttpServer/Internal/Connection.hpp"
 #include "libHttpServer/Internal/Server.hpp"
+#include "libHttpServer/Internal/Metrics.hpp"
+#include "libHttpServer/Internal/AllocStats.hpp"
 
 namespace HTTP
 {
@@ -73,80 +76,86 @@ namespace HTTP
         return dt.toLocalTime();
     }
 
-    Response::Response( Data* data )
-        : d( data )
+    Response::Data::Data()
     {
+        mGeneration = 0;
+        reset();
     }
 
-    Response::~Response()
+    void Response::Data::reset()
     {
-        delete d;
+        mConnection = NULL;
+        mRequest = NULL;
+        mBandwidthLimit.clear();
+        mFlags = 0;
+        mHeaders.clear();
+        mBody.clear();
+        mStatus = Ok;
+        mBytesOut = 0;
+        mFirstByteTime = 0;
+        mGeneration++;
     }
 
-    void Response::addHeader( const HeaderName& header, const HeaderValue& value )
+    int Response::Data::bodySize() const
     {
-        d->mHeaders[ header ] = value;
+        int size = 0;
+        foreach( const BodySegment& segment, mBody )
+        {
+            size += segment.mData.count();
+        }
+        return size;
     }
 
-    void Response::addHeader( const HeaderName& header, const QDateTime& value )
+    /*
+     * All output of a response goes through here, so we know its size and can tag it with the
+     * provider's bandwidth limit.
+     */
+    void Response::Data::write( BodySegment segment )
     {
-        addHeader( header, toRfc1123date( value ) );
-    }
+        if( !mConnection )
+        {
+            return;
+        }
 
-    bool Response::headersSent() const
-    {
-        return d->mFlags.testFlag( Data::HeadersWritten );
-    }
+        HTTP_ALLOC_STAGE( Write );
 
-    bool Response::hasHeader( const HeaderName& name ) const
-    {
-        return d->mHeaders.contains( name.toLower() );
+        segment.mRateLimit = mBandwidthLimit ? int( *mBandwidthLimit ) : 0;
+        mBytesOut += segment.mData.count();
+        mConnection->write( segment );
     }
 
-    void Response::addBody( const QByteArray& data )
+    /*
+     * Builds the status line and header block; also decides on Content-Length and the connection
+     * flags. Kept apart from sending so it can be measured on its own.
+     */
+    QByteArray Response::Data::serializeHeaders( StatusCode code )
     {
-        Q_ASSERT( !d->mFlags.testFlag( Data::BodyIsFixed ) );
-        Q_ASSERT( !d->mFlags.testFlag( Data::DataIsCompressed ) );
-        Q_ASSERT( !headersSent() || d->mFlags.testFlag( Data::ChunkedEncoding ) ||
-                  !d->mFlags.testFlag( Data::KeepAlive ) );
-
-        d->mBodyData.append( data );
-    }
-
-    void Response::sendHeaders( StatusCode code )
-    {
-        Q_ASSERT( !headersSent() );
-        Q_ASSERT( !d->mFlags.testFlag( Data::SendAtOnce ) );
-        //Q_ASSERT( d->mFlags.testFlag( Data::ReadyToSend ) );
-        Q_ASSERT( d->mFlags.testFlag( Data::ChunkedEncoding ) || hasHeader( "Content-Length" ) ||
-                  !d->mFlags.testFlag( Data::KeepAlive ) || d->mFlags.testFlag( Data::BodyIsFixed ) );
-
-        if( !d->mFlags.testFlag( Data::ChunkedEncoding ) && !hasHeader( "Content-Length" ) &&
-                d->mFlags.testFlag( Data::BodyIsFixed ) )
+        if( !mFlags.testFlag( ChunkedEncoding ) && !mHeaders.contains( "content-length" ) &&
+                mFlags.testFlag( BodyIsFixed ) )
         {
-            addHeader( "Content-Length", QByteArray::number( d->mBodyData.count() ) );
+            mHeaders[ "Content-Length" ] = QByteArray::number( bodySize() );
         }
 
         bool sentKeepAlive = false;
         bool sentContentLength = false;
 
         QByteArray out = "HTTP/1.1 " % QByteArray::number( code ) % " " % code2Text( code ) % CRLF;
-        foreach( HeaderName name, d->mHeaders.keys() )
+        foreach( HeaderName name, mHeaders.keys() )
         {
-            const QByteArray& value = d->mHeaders.value( name );
+            const QByteArray& value = mHeaders.value( name );
 
             if( name.toLower() == "connection" )
             {
                 if( value.toLower() == "keep-alive" )
                 {
-                    Q_ASSERT( !d->mFlags.testFlag( Data::Close ) );
-                    d->mFlags = d->mFlags | Data::KeepAlive;
+                    Q_ASSERT( !mFlags.testFlag( Close ) );
+                    mFlags = mFlags | KeepAlive;
                     sentKeepAlive = true;
                 }
                 else if( value.toLower() == "close" )
                 {
-                    Q_ASSERT( !d->mFlags.testFlag( Data::KeepAlive ) );
-                    d->mFlags = d->mFlags | Data::Close;
+                    Q_ASSERT( !mFlags.testFlag( KeepAlive ) );
+                    mFlags = mFlags | Close;
                     sentKeepAlive = true;
                 }
                 out += name % ": " % value % CRLF;
@@ -162,25 +171,124 @@ namespace HTTP
             }
         }
 
-        if( !d->mFlags.testFlag( Data::ChunkedEncoding ) )
+        if( !sentKeepAlive && mFlags.testFlag( Close ) )
         {
-            if( !sentKeepAlive && d->mFlags.testFlag( Data::Close ) )
-            {
-                out += "Connection: Close" CRLF;
-            }
+            out += "Connection: Close" CRLF;
+        }
 
-            if( !sentContentLength )
+        if( mFlags.testFlag( ChunkedEncoding ) )
+        {
+            out += "Transfer-Encoding: chunked" CRLF;
+        }
+        else
+        {
+            // A streamed response without chunked encoding is delimited by closing the connection
+            if( !sentContentLength && !mFlags.testFlag( Streaming ) )
             {
-                out += "Content-Length: " % QByteArray::number( d->mBodyData.count() ) % CRLF;
+                out += "Content-Length: " % QByteArray::number( bodySize() ) % CRLF;
             }
         }
 
         out += CRLF;
 
+        return out;
+    }
+
+    Response::Response( Data* data )
+        : d( data )
+    {
+    }
+
+    Response::~Response()
+    {
+        delete d;
+    }
+
+    void Response::addHeader( const HeaderName& header, const HeaderValue& value )
+    {
+        d->mHeaders[ header ] = value;
+    }
+
+    void Response::addHeader( const HeaderName& header, const QDateTime& value )
+    {
+        addHeader( header, toRfc1123date( value ) );
+    }
+
+    bool Response::headersSent() const
+    {
+        return d->mFlags.testFlag( Data::HeadersWritten );
+    }
+
+    bool Response::isSent() const
+    {
+        return d->mFlags.testFlag( Data::Sent );
+    }
+
+    bool Response::hasHeader( const HeaderName& name ) const
+    {
+        return d->mHeaders.contains( name.toLower() );
+    }
+
+    void Response::addBody( const QByteArray& data )
+    {
+        Q_ASSERT( !d->mFlags.testFlag( Data::BodyIsFixed ) );
+        Q_ASSERT( !d->mFlags.testFlag( Data::DataIsCompressed ) );
+        Q_ASSERT( !headersSent() || d->mFlags.testFlag( Data::ChunkedEncoding ) ||
+                  !d->mFlags.testFlag( Data::KeepAlive ) );
+
+        if( data.isEmpty() )
+        {
+            return;
+        }
+
+        if( d->mBody.isEmpty() || d->mBody.last().mMapping )
+        {
+            d->mBody.append( BodySegment( data ) );
+        }
+        else
+        {
+            d->mBody.last().mData.append( data );
+        }
+    }
+
+    void Response::addMappedBody( const QSharedPointer< MappedFile >& mapping )
+    {
+        Q_ASSERT( !d->mFlags.testFlag( Data::BodyIsFixed ) );
+        Q_ASSERT( !d->mFlags.testFlag( Data::DataIsCompressed ) );
+        Q_ASSERT( !headersSent() );
+
+        d->mBody.append( BodySegment( mapping ) );
+    }
+
+    void Response::sendHeaders( StatusCode code )
+    {
+        Q_ASSERT( !headersSent() );
+        Q_ASSERT( !d->mFlags.testFlag( Data::SendAtOnce ) );
+        //Q_ASSERT( d->mFlags.testFlag( Data::ReadyToSend ) );
+        Q_ASSERT( d->mFlags.testFlag( Data::ChunkedEncoding ) || hasHeader( "Content-Length" ) ||
+                  !d->mFlags.testFlag( Data::KeepAlive ) || d->mFlags.testFlag( Data::BodyIsFixed ) );
+
+        // A draining connection is closed after this response
+        if( d->mConnection && d->mConnection->isDraining() &&
+                d->mFlags.testFlag( Data::KeepAlive ) && !d->mHeaders.contains( "Connection" ) )
+        {
+            d->mFlags &= ~Data::KeepAlive;
+            d->mFlags |= Data::Close;
+        }
+
+        QByteArray out = d->serializeHeaders( code );
+
         HTTP_DBG( "Out: %s", out.constData() );
 
-        d->mConnection->write(out);
+        d->write( out );
         d->mFlags |= Data::HeadersWritten;
+        d->mStatus = code;
+        d->mConnection->metrics()->countResponse( code );
+
+        if( d->mRequest )
+        {
+            d->mFirstByteTime = d->mRequest->d->mTimer.nsecsElapsed() / 1000;
+        }
 
         Server* svr = d->mConnection->server();
         IAccessLog* log = svr->accessLog();
@@ -223,14 +331,142 @@ namespace HTTP
         Q_ASSERT( !d->mFlags.testFlag( Data::SendAtOnce ) );
         //Q_ASSERT( d->mFlags.testFlag( Data::ReadyToSend ) );
 
-        if( d->mFlags.testFlag( Data::ChunkedEncoding ) )
+        if( d->mFlags.testFlag( Data::Streaming ) )
         {
+            flush();
+
+            if( d->mFlags.testFlag( Data::ChunkedEncoding ) )
+            {
+                d->write( QByteArray( "0" CRLF CRLF ) );
+            }
         }
         else
         {
-            d->mConnection->write( d->mBodyData );
+            foreach( const BodySegment& segment, d->mBody )
+            {
+                d->write( segment );
+            }
+        }
+
+        d->mFlags |= Data::Sent;
+
+        if( d->mConnection )
+        {
+            if( d->mRequest )
+            {
+                d->mConnection->responseCompleted( d->mRequest, d->mStatus, d->mBytesOut,
+                                                   d->mFirstByteTime );
+            }
+
+            if( d->mFlags.testFlag( Data::Close ) )
+            {
+                d->mConnection->closeWhenDone();
+            }
+        }
+
+        // Normally the request takes us along when it is recycled (or deleted)
+        if( d->mConnection && d->mRequest )
+        {
+            d->mConnection->retire( d->mRequest );
+        }
+        else
+        {
+            deleteLater();
+        }
+    }
+
+    /*
+     * Turns this into a streamed response: After sendHeaders(), every flush() sends whatever was
+     * added with addBody() since the last one, and send() ends the stream. HTTP/1.1 clients get
+     * chunked encoding; for older ones the end of the stream is marked by closing the connection.
+     *
+     * Producers should stop adding data while isWritable() returns false and continue once
+     * writable() is emitted, otherwise the output just piles up in memory.
+     */
+    void Response::setStreaming()
+    {
+        Q_ASSERT( !headersSent() );
+
+        d->mFlags |= Data::Streaming;
+        d->mFlags &= ~Data::SendAtOnce;
+
+        if( d->mFlags.testFlag( Data::KeepAlive ) )
+        {
+            d->mFlags |= Data::ChunkedEncoding;
+        }
+
+        if( d->mConnection )
+        {
+            connect( d->mConnection, SIGNAL(writable()), this, SLOT(connectionWritable()) );
+        }
+    }
+
+    void Response::flush()
+    {
+        Q_ASSERT( headersSent() );
+        Q_ASSERT( d->mFlags.testFlag( Data::Streaming ) );
+
+        int size = d->bodySize();
+
+        // An empty chunk would end the stream
+        if( !size || !d->mConnection )
+        {
+            d->mBody.clear();
+            return;
+        }
+
+        bool chunked = d->mFlags.testFlag( Data::ChunkedEncoding );
+
+        if( chunked )
+        {
+            d->write( QByteArray::number( size, 16 ) + CRLF );
+        }
+
+        foreach( const BodySegment& segment, d->mBody )
+        {
+            d->write( segment );
+        }
+
+        if( chunked )
+        {
+            d->write( QByteArray( CRLF ) );
         }
-        deleteLater();
+
+        d->mBody.clear();
+    }
+
+    /*
+     * For streamed content that goes to many responses alike: `chunk` is `data` already framed
+     * for chunked encoding, so whichever is sent is just shared. Returns false once the stream
+     * should end, because the connection is gone or draining.
+     */
+    bool Response::writeShared( const QByteArray& data, const QByteArray& chunk )
+    {
+        Q_ASSERT( headersSent() );
+        Q_ASSERT( d->mFlags.testFlag( Data::Streaming ) );
+
+        if( !d->mConnection || d->mConnection->isDraining() )
+        {
+            return false;
+        }
+
+        d->write( BodySegment( d->mFlags.testFlag( Data::ChunkedEncoding ) ? chunk : data ) );
+        return true;
+    }
+
+    quint32 Response::generation() const
+    {
+        return d->mGeneration;
+    }
+
+    bool Response::isWritable() const
+    {
+        return d->mConnection && d->mConnection->isWritable();
+    }
+
+    void Response::connectionWritable()
+    {
+        emit writable( this );
     }
 
 }
@@ -18,12 +18,19 @@
 #define HTTP_RESPONSE_HPP
 
 #include <QDateTime>
+#include <QSharedPointer>
 
 #include "libHttpServer/Http.hpp"
 
 namespace HTTP
 {
 
+    class MappedFile;
+
+    /*
+     * Pooled along with its Request, so a QPointer to a sent response may point to another
+     * request's response later on; compare generation() as described for Request.
+     */
     class HTTP_SERVER_API Response : public QObject
     {
         Q_OBJECT
@@ -35,6 +42,7 @@ namespace HTTP
         void addHeader( const HeaderName& header, const QDateTime& value );
         bool hasHeader( const HeaderName& name ) const;
         bool headersSent() const;
+        bool isSent() const;
 
         void addBody( const QByteArray& data );
         void fixBody();
@@ -44,10 +52,29 @@ namespace HTTP
         void finish( StatusCode code );
         void send();
 
+        void setStreaming();
+        void flush();
+        bool isWritable() const;
+
+        quint32 generation() const;
+
+    signals:
+        void writable( HTTP::Response* response );
+
+    private slots:
+        void connectionWritable();
+
     private:
         friend class Request;
+        friend class Connection;
+        friend class StaticContentProvider;
+        friend class EventStreamBucket;
+        friend class MicroBenchmarkAccess;
+        friend class RequestPool;
         class Data;
         Response( Data* d );
+        void addMappedBody( const QSharedPointer< MappedFile >& mapping );
+        bool writeShared( const QByteArray& data, const QByteArray& chunk );
         Data* d;
     };
 
@@ -15,14 +15,26 @@
  */
 
 #include <QStringBuilder>
+#include <QTimer>
+
+#ifdef Q_OS_UNIX
+#include <fcntl.h>
+#include <stdlib.h>
+#include <unistd.h>
+#endif
 
 #include "libHttpServer/Internal/Server.hpp"
 #include "libHttpServer/Internal/Connection.hpp"
+#include "libHttpServer/Internal/Request.hpp"
+#include "libHttpServer/Internal/AllocStats.hpp"
 #include "libHttpServer/ContentProvider.hpp"
+#include "libHttpServer/Metrics.hpp"
 
 namespace HTTP
 {
 
+    static const int sListenFdsStart = 3;   // SD_LISTEN_FDS_START
+
     class AccessLogDebug : public IAccessLog
     {
     public:
@@ -40,6 +52,34 @@ namespace HTTP
         }
     };
 
+    RequestRecord::RequestRecord()
+        : mConnectionId( 0 )
+        , mVersion( V_Unknown )
+        , mMethod( Get )
+        , mRemotePort( 0 )
+        , mStatus( Ok )
+        , mBytesIn( 0 )
+        , mBytesOut( 0 )
+        , mHeaderParseTime( 0 )
+        , mHandlerTime( 0 )
+        , mTimeToFirstByte( 0 )
+        , mTotalTime( 0 )
+    {
+    }
+
+    ServerPrivate::ServerPrivate( Server* server )
+        : mHttpServer( server )
+        , mTcpServer( NULL )
+        , mAccessLog( NULL )
+        , mRequestLog( NULL )
+        , mWorkerCount( 0 )
+        , mEventEngine( QtEventEngine )
+        , mOpenConnections( 0 )
+        , mDraining( 0 )
+        , mDrained( false )
+    {
+    }
+
     void ServerPrivate::newRequest( Request* request )
     {
         QUrl u = request->url();
@@ -47,29 +87,160 @@ namespace HTTP
         {
             if( cp->canHandle( u ) )
             {
+                request->d->mProvider = cp;
+
+                HTTP_ALLOC_STAGE( Build );
                 cp->newRequest( request );
                 return;
             }
         }
 
+        HTTP_ALLOC_STAGE( Build );
         mHttpServer->newRequest( request );
     }
 
+    /*
+     * Handlers registered with addHandler() are matched against the raw request target before any
+     * ContentProvider gets a chance, so they never have to build a QUrl.
+     */
+    IRequestHandler* ServerPrivate::handlerFor( const QByteArray& url ) const
+    {
+        foreach( const HandlerRoute& route, mHandlers )
+        {
+            if( url.startsWith( route.mPrefix ) )
+            {
+                return route.mHandler;
+            }
+        }
+        return NULL;
+    }
+
+    /*
+     * Only asked for requests that want to upgrade their connection.
+     */
+    IWebSocketHandler* ServerPrivate::webSocketHandlerFor( const QByteArray& url ) const
+    {
+        foreach( const WebSocketRoute& route, mWebSocketHandlers )
+        {
+            if( url.startsWith( route.mPrefix ) )
+            {
+                return route.mHandler;
+            }
+        }
+        return NULL;
+    }
+
+    QString ServerPrivate::routeName( const void* route ) const
+    {
+        if( !route )
+        {
+            return QLatin1String( "unrouted" );
+        }
+
+        foreach( const HandlerRoute& handler, mHandlers )
+        {
+            if( handler.mHandler == route )
+            {
+                return QString::fromUtf8( handler.mPrefix.constData() );
+            }
+        }
+
+        foreach( const WebSocketRoute& handler, mWebSocketHandlers )
+        {
+            if( handler.mHandler == route )
+            {
+                return QString::fromUtf8( handler.mPrefix.constData() );
+            }
+        }
+
+        const ContentProvider* provider = static_cast< const ContentProvider* >( route );
+        if( !provider->objectName().isEmpty() )
+        {
+            return provider->objectName();
+        }
+
+        return QString( QLatin1String( "provider%1" ) )
+                .arg( mProviders.indexOf( const_cast< ContentProvider* >( provider ) ) );
+    }
+
+    LatencySummary ServerPrivate::latency( const void* route, LatencyStage stage ) const
+    {
+        RouteHistogramsHash routes;
+        mMetrics.collect( routes );
+
+        LatencySummary s;
+        RouteHistograms* r = routes.value( route );
+        if( r )
+        {
+            switch( stage )
+            {
+            case ParseLatency:      s = r->mParse.summary();    break;
+            case HandlerLatency:    s = r->mHandler.summary();  break;
+            case TotalLatency:      s = r->mTotal.summary();    break;
+            }
+        }
+
+        qDeleteAll( routes );
+        return s;
+    }
+
     Server::Server( QObject* parent )
         : QObject( parent )
-        , d( new ServerPrivate )
+        , d( new ServerPrivate( this ) )
     {
-        d->mHttpServer = this;
-        d->mTcpServer = NULL;
-        d->mAccessLog = NULL;
-        d->mThrottledTo = 0;
     }
 
     Server::~Server()
     {
+        if( d->mTcpServer )
+        {
+            d->mTcpServer->close();
+        }
+
+        // Results still arriving are dropped along with the Establishers
+        d->mExecutor.stop();
+
+        foreach( QThread* t, d->mWorkers )
+        {
+            t->quit();
+            t->wait();
+        }
+
+        // Connections still refer to d, so they have to go first
+        delete d->mTcpServer;
+        qDeleteAll( d->mWorkers );
         delete d;
     }
 
+    void ServerPrivate::startWorkers( RoundRobinServer* tcpServer )
+    {
+        if( !mWorkerCount )
+        {
+            tcpServer->addThread( QThread::currentThread() );
+        }
+
+        for( int i = 0; i < mWorkerCount; i++ )
+        {
+            QThread* t = new QThread;
+            t->start();
+            tcpServer->addThread( t );
+            mWorkers.append( t );
+        }
+
+        mTcpServer = tcpServer;
+    }
+
+    /*
+     * Called by every connection as it goes away, on its own thread.
+     */
+    void ServerPrivate::connectionClosed()
+    {
+        if( !mOpenConnections.deref() && mDraining )
+        {
+            QMetaObject::invokeMethod( mHttpServer, "drainFinished", Qt::QueuedConnection );
+        }
+    }
+
     bool Server::listen( quint16 port )
     {
         return listen( QHostAddress::Any, port );
@@ -83,15 +254,183 @@ namespace HTTP
         }
 
         RoundRobinServer* tcpServer = new RoundRobinServer( this, d );
-        tcpServer->addThread( QThread::currentThread() );
+        if( !tcpServer->listen( addr, port ) )
+        {
+            delete tcpServer;
+            return false;
+        }
+
+        d->startWorkers( tcpServer );
+        return true;
+    }
+
+    /*
+     * Serves an already listening socket, for example one inherited from the process we replace
+     * (see inheritedSockets()).
+     */
+    bool Server::setSocketDescriptor( int socketDescriptor )
+    {
+        if( d->mTcpServer )
+        {
+            return false;
+        }
+
+        RoundRobinServer* tcpServer = new RoundRobinServer( this, d );
+        if( !tcpServer->setSocketDescriptor( socketDescriptor ) )
+        {
+            delete tcpServer;
+            return false;
+        }
+
+        d->startWorkers( tcpServer );
+        return true;
+    }
+
+    /*
+     * The listening socket, to be handed to a successor process. It is opened with close-on-exec,
+     * so it has to be cleared before exec'ing the successor.
+     */
+    int Server::socketDescriptor() const
+    {
+        return d->mTcpServer ? d->mTcpServer->socketDescriptor() : -1;
+    }
+
+    /*
+     * Listening sockets passed by systemd socket activation (LISTEN_FDS, LISTEN_PID), starting at
+     * descriptor 3. The variables are removed, so child processes do not pick them up again.
+     */
+    QList< int > Server::inheritedSockets()
+    {
+        QList< int > sockets;
+
+        #ifdef Q_OS_UNIX
+        QByteArray pid = qgetenv( "LISTEN_PID" );
+        QByteArray fds = qgetenv( "LISTEN_FDS" );
 
-        if( tcpServer->listen( addr, port ) )
+        if( pid.isEmpty() || fds.isEmpty() || pid.toLongLong() != qint64( getpid() ) )
         {
-            d->mTcpServer = tcpServer;
-            return true;
+            return sockets;
         }
 
-        return false;
+        int count = fds.toInt();
+        for( int fd = sListenFdsStart; fd < sListenFdsStart + count; fd++ )
+        {
+            ::fcntl( fd, F_SETFD, FD_CLOEXEC );
+            sockets.append( fd );
+        }
+
+        ::unsetenv( "LISTEN_PID" );
+        ::unsetenv( "LISTEN_FDS" );
+        ::unsetenv( "LISTEN_FDNAMES" );
+        #endif
+
+        return sockets;
+    }
+
+    /*
+     * Stops accepting connections and lets the open ones finish: each gets "Connection: Close"
+     * on its next response, idle keep-alive connections are closed right away and ones that never
+     * sent a request after a short grace period. drained() is emitted once all connections are
+     * gone; whatever is left after msecs is aborted.
+     */
+    void Server::drain( int msecs )
+    {
+        if( d->mDraining.fetchAndStoreOrdered( 1 ) )
+        {
+            return;
+        }
+
+        if( d->mTcpServer )
+        {
+            d->mTcpServer->close();
+            d->mTcpServer->invokeOnEstablishers( "drain" );
+        }
+
+        QTimer::singleShot( msecs, this, SLOT(drainTimedOut()) );
+
+        if( !d->mOpenConnections )
+        {
+            QMetaObject::invokeMethod( this, "drainFinished", Qt::QueuedConnection );
+        }
+    }
+
+    bool Server::isDraining() const
+    {
+        return d->mDraining;
+    }
+
+    void Server::drainTimedOut()
+    {
+        if( !d->mDrained && d->mTcpServer )
+        {
+            d->mTcpServer->invokeOnEstablishers( "abortConnections" );
+        }
+    }
+
+    void Server::drainFinished()
+    {
+        if( d->mDrained || d->mOpenConnections )
+        {
+            return;
+        }
+
+        d->mDrained = true;
+        emit drained();
+    }
+
+    quint16 Server::serverPort() const
+    {
+        return d->mTcpServer ? d->mTcpServer->serverPort() : 0;
+    }
+
+    /*
+     * By default, connections are served on the thread that called listen(). With a count > 0,
+     * the server starts that many threads of its own instead and hands out new connections round
+     * robin. Must be called before listen().
+     */
+    void Server::setWorkerThreads( int count )
+    {
+        Q_ASSERT( !d->mTcpServer );
+        d->mWorkerCount = qMax( count, 0 );
+    }
+
+    int Server::workerThreads() const
+    {
+        return d->mWorkerCount;
+    }
+
+    /*
+     * Threads for Request::offload(); by default one per core. They are started with the first
+     * offloaded job, so this must be called before that.
+     */
+    void Server::setComputeThreads( int count )
+    {
+        d->mExecutor.setThreadCount( count );
+    }
+
+    int Server::computeThreads() const
+    {
+        return d->mExecutor.threadCount();
+    }
+
+    /*
+     * How connections do their I/O. The epoll engine bypasses QTcpSocket; where it is not
+     * available, the Qt engine is used instead. Must be called before listen().
+     */
+    void Server::setEventEngine( EventEngine engine )
+    {
+        Q_ASSERT( !d->mTcpServer );
+
+        #ifdef Q_OS_LINUX
+        d->mEventEngine = engine;
+        #else
+        Q_UNUSED( engine );
+        #endif
+    }
+
+    EventEngine Server::eventEngine() const
+    {
+        return d->mEventEngine;
     }
 
     void Server::setAccessLog( IAccessLog* log )
@@ -105,11 +444,128 @@ namespace HTTP
         return d->mAccessLog ? d->mAccessLog : &dbg;
     }
 
+    /*
+     * Unlike the access log, which is called when the response headers are sent, the request log
+     * is called once a response has been written out completely. It is called on the connection's
+     * worker thread and there is no default.
+     */
+    void Server::setRequestLog( IRequestLog* log )
+    {
+        d->mRequestLog = log;
+    }
+
+    IRequestLog* Server::requestLog() const
+    {
+        return d->mRequestLog;
+    }
+
     void Server::addProvider( ContentProvider* provider )
     {
         d->mProviders.append( provider );
     }
 
+    /*
+     * Requests whose target starts with pathPrefix go to handler, which is not owned. Handlers
+     * have to be added before listen().
+     */
+    void Server::addHandler( const QByteArray& pathPrefix, IRequestHandler* handler )
+    {
+        ServerPrivate::HandlerRoute route;
+        route.mPrefix = pathPrefix;
+        route.mHandler = handler;
+        d->mHandlers.append( route );
+    }
+
+    /*
+     * Handshakes for targets starting with pathPrefix go to handler, which is not owned. Like
+     * handlers, it has to be added before listen().
+     */
+    void Server::addWebSocketHandler( const QByteArray& pathPrefix, IWebSocketHandler* handler )
+    {
+        ServerPrivate::WebSocketRoute route;
+        route.mPrefix = pathPrefix;
+        route.mHandler = handler;
+        d->mWebSocketHandlers.append( route );
+    }
+
+    /*
+     * Limits are in bytes per second; 0 means unlimited. All of them may be changed at any time
+     * from any thread. The global limit caps the server's total output, the connection limit
+     * each single connection and the remote limit everything sent to one remote address.
+     * ContentProvider::setBandwidthLimit() additionally caps the responses of one provider.
+     */
+    void Server::setBandwidthLimit( qint64 bytesPerSecond )
+    {
+        d->mLimits.setGlobalRate( bytesPerSecond );
+    }
+
+    qint64 Server::bandwidthLimit() const
+    {
+        return d->mLimits.globalRate();
+    }
+
+    void Server::setConnectionBandwidthLimit( qint64 bytesPerSecond )
+    {
+        d->mLimits.setConnectionRate( bytesPerSecond );
+    }
+
+    qint64 Server::connectionBandwidthLimit() const
+    {
+        return d->mLimits.connectionRate();
+    }
+
+    void Server::setRemoteBandwidthLimit( qint64 bytesPerSecond )
+    {
+        d->mLimits.setRemoteRate( bytesPerSecond );
+    }
+
+    qint64 Server::remoteBandwidthLimit() const
+    {
+        return d->mLimits.remoteRate();
+    }
+
+    /*
+     * Merges the counters of all worker threads. Cheap enough to be called for every scrape, but
+     * not meant for the request path.
+     */
+    ServerMetrics Server::metrics() const
+    {
+        ServerMetrics m;
+        d->mMetrics.collect( m );
+
+        RouteHistogramsHash routes;
+        d->mMetrics.collect( routes );
+
+        RouteHistogramsHash::ConstIterator it = routes.constBegin();
+        while( it != routes.constEnd() )
+        {
+            RouteLatency r;
+            r.mRoute = d->routeName( it.key() );
+            r.mParse = it.value()->mParse.summary();
+            r.mHandler = it.value()->mHandler.summary();
+            r.mTotal = it.value()->mTotal.summary();
+            m.mLatencies.append( r );
+            ++it;
+        }
+        qDeleteAll( routes );
+
+        return m;
+    }
+
+    /*
+     * Percentiles for the requests a provider handled, merged over all worker threads. Pass NULL
+     * for those that were handed to the newRequest() signal instead.
+     */
+    LatencySummary Server::latency( const ContentProvider* provider, LatencyStage stage ) const
+    {
+        return d->latency( provider, stage );
+    }
+
+    LatencySummary Server::latency( const IRequestHandler* handler, LatencyStage stage ) const
+    {
+        return d->latency( handler, stage );
+    }
+
     QByteArray Server::methodName( Method method )
     {
         return method2text( method );
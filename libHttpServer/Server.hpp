@@ -27,6 +27,10 @@ namespace HTTP
     class Request;
     class Connection;
     class ContentProvider;
+    class IRequestHandler;
+    class IWebSocketHandler;
+    class ServerMetrics;
+    class LatencySummary;
 
     class IAccessLog
     {
@@ -36,6 +40,41 @@ namespace HTTP
                              StatusCode response ) = 0;
     };
 
+    /*
+     * Everything we know about a request once its response has been handed to the socket
+     * completely. Durations are in microseconds and measured with a monotonic clock, starting at
+     * the first byte of the request.
+     */
+    class HTTP_SERVER_API RequestRecord
+    {
+    public:
+        RequestRecord();
+
+    public:
+        int             mConnectionId;
+        Version         mVersion;
+        Method          mMethod;
+        QByteArray      mUrl;
+        QHostAddress    mRemoteAddr;
+        quint16         mRemotePort;
+        StatusCode      mStatus;
+        QByteArray      mUserAgent;
+        QByteArray      mReferer;
+        qint64          mBytesIn;           // Request headers and body
+        qint64          mBytesOut;          // Response headers and body
+        qint64          mHeaderParseTime;   // Until the request headers were complete
+        qint64          mHandlerTime;       // From dispatching the request until the response
+                                            // was finished
+        qint64          mTimeToFirstByte;   // Until the response headers were queued
+        qint64          mTotalTime;         // Until the last byte was handed to the socket
+    };
+
+    class IRequestLog
+    {
+    public:
+        virtual void requestCompleted( const RequestRecord& record ) = 0;
+    };
+
     class ServerPrivate;
     class HTTP_SERVER_API Server : public QObject
     {
@@ -47,14 +86,49 @@ namespace HTTP
     public:
         bool listen( const QHostAddress& addr, quint16 port = 0 );
         bool listen( quint16 port = 0 );
+        bool setSocketDescriptor( int socketDescriptor );
+        int socketDescriptor() const;
+        static QList< int > inheritedSockets();
+        quint16 serverPort() const;
+
+        void drain( int msecs = 30000 );
+        bool isDraining() const;
+
+        void setWorkerThreads( int count );
+        int workerThreads() const;
+        void setComputeThreads( int count );
+        int computeThreads() const;
+        void setEventEngine( EventEngine engine );
+        EventEngine eventEngine() const;
+
         void setAccessLog( IAccessLog* log );
         IAccessLog* accessLog() const;
+        void setRequestLog( IRequestLog* log );
+        IRequestLog* requestLog() const;
         static QByteArray methodName( Method method );
 
         void addProvider( ContentProvider* provider );
+        void addHandler( const QByteArray& pathPrefix, IRequestHandler* handler );
+        void addWebSocketHandler( const QByteArray& pathPrefix, IWebSocketHandler* handler );
+
+        void setBandwidthLimit( qint64 bytesPerSecond );
+        qint64 bandwidthLimit() const;
+        void setConnectionBandwidthLimit( qint64 bytesPerSecond );
+        qint64 connectionBandwidthLimit() const;
+        void setRemoteBandwidthLimit( qint64 bytesPerSecond );
+        qint64 remoteBandwidthLimit() const;
+
+        ServerMetrics metrics() const;
+        LatencySummary latency( const ContentProvider* provider, LatencyStage stage ) const;
+        LatencySummary latency( const IRequestHandler* handler, LatencyStage stage ) const;
 
     signals:
         void newRequest( HTTP::Request* request );
+        void drained();
+
+    private slots:
+        void drainTimedOut();
+        void drainFinished();
 
     private:
         friend class ServerPrivate;
@@ -0,0 +1,546 @@
+/*
+ * Modern CI
+ * Copyright (C) 2012-2013 Sascha Cunz <sascha@babbelbox.org>
+ *
+ * This program is free software; you can redistribute it and/or modify it under the terms of the
+ * GNU General Public License (Version 2) as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without
+ * even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this program; if
+ * not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <string.h>
+
+#include <QTimer>
+
+#include "libHttpServer/WebSocket.hpp"
+
+#include "libHttpServer/Internal/WebSocket.hpp"
+#include "libHttpServer/Internal/Connection.hpp"
+
+namespace HTTP
+{
+
+    /*
+     * The handshake's headers are spelled differently by different clients.
+     */
+    static HeaderValue findHeader( const HeadersHash& headers, const char* name )
+    {
+        HeadersHash::const_iterator it = headers.constBegin();
+        for( ; it != headers.constEnd(); ++it )
+        {
+            if( qstricmp( it.key().constData(), name ) == 0 )
+            {
+                return it.value();
+            }
+        }
+        return HeaderValue();
+    }
+
+    static bool hasToken( const HeaderValue& value, const char* token )
+    {
+        foreach( const QByteArray& part, value.split( ',' ) )
+        {
+            if( qstricmp( part.trimmed().constData(), token ) == 0 )
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    WebSocket::Data::Data( Connection* connection )
+        : mSocket( NULL )
+        , mConnection( connection )
+        , mRemotePort( 0 )
+        , mState( Open )
+        , mMaxMessageSize( sDefaultMaxMessageSize )
+        , mHeaderLength( 0 )
+        , mOpcode( WebSocketFrame::Continuation )
+        , mRemaining( -1 )
+        , mPhase( 0 )
+        , mTarget( NULL )
+        , mTargetOffset( 0 )
+        , mMessageOpcode( WebSocketFrame::Continuation )
+        , mMessageFin( false )
+    {
+        memset( mKey, 0, sizeof( mKey ) );
+    }
+
+    /*
+     * Checks a client's opening handshake (RFC 6455, 4.2.1) and computes the accept key for it.
+     */
+    StatusCode WebSocket::Data::handshake( Method method, Version version,
+                                           const HeadersHash& headers, QByteArray& accept )
+    {
+        if( method != Get || version != V_1_1 ||
+                !hasToken( findHeader( headers, "Upgrade" ), "websocket" ) ||
+                !hasToken( findHeader( headers, "Connection" ), "Upgrade" ) )
+        {
+            return BadRequest;
+        }
+
+        if( findHeader( headers, "Sec-WebSocket-Version" ).trimmed() != "13" )
+        {
+            return UpgradeRequired;
+        }
+
+        // 16 random bytes, base64 encoded
+        QByteArray key = findHeader( headers, "Sec-WebSocket-Key" ).trimmed();
+        if( QByteArray::fromBase64( key ).size() != 16 )
+        {
+            return BadRequest;
+        }
+
+        accept = WebSocketFrame::acceptKey( key );
+        return SwitchProtocols;
+    }
+
+    /*
+     * Frames are taken apart as the bytes arrive. Payloads are unmasked straight from the read
+     * buffer into the message, which is allocated once per frame; there are no other copies.
+     */
+    void WebSocket::Data::received( const char* data, size_t length )
+    {
+        while( mState != Closed )
+        {
+            if( mRemaining < 0 )
+            {
+                // The first two bytes tell how long the header is
+                int needed = mHeaderLength < 2 ? 2 : WebSocketFrame::headerSize( mHeader[ 1 ] );
+                if( mHeaderLength < needed )
+                {
+                    if( !length )
+                    {
+                        return;
+                    }
+
+                    int n = int( qMin( size_t( needed - mHeaderLength ), length ) );
+                    memcpy( mHeader + mHeaderLength, data, n );
+                    mHeaderLength += n;
+                    data += n;
+                    length -= n;
+                    continue;
+                }
+
+                if( !startFrame() )
+                {
+                    return;
+                }
+            }
+
+            if( mRemaining > 0 )
+            {
+                if( !length )
+                {
+                    return;
+                }
+
+                qint64 n = qMin( qint64( length ), mRemaining );
+                WebSocketFrame::unmask( mTarget->data() + mTargetOffset, data, n, mKey, mPhase );
+                mTargetOffset += int( n );
+                mPhase = int( ( mPhase + n ) & 3 );
+                mRemaining -= n;
+                data += n;
+                length -= size_t( n );
+                continue;
+            }
+
+            mRemaining = -1;
+            mHeaderLength = 0;
+
+            if( !endFrame() )
+            {
+                return;
+            }
+        }
+    }
+
+    bool WebSocket::Data::startFrame()
+    {
+        unsigned char b0 = mHeader[ 0 ];
+        unsigned char b1 = mHeader[ 1 ];
+        bool fin = b0 & 0x80;
+        mOpcode = b0 & 0x0f;
+
+        // No extension was negotiated that could use the RSV bits; clients must mask
+        if( ( b0 & 0x70 ) || !( b1 & 0x80 ) )
+        {
+            fail( ProtocolError );
+            return false;
+        }
+
+        quint64 length = b1 & 0x7f;
+        int pos = 2;
+
+        if( length == 126 )
+        {
+            length = ( quint64( mHeader[ 2 ] ) << 8 ) | mHeader[ 3 ];
+            pos = 4;
+        }
+        else if( length == 127 )
+        {
+            length = 0;
+            for( int i = 0; i < 8; i++ )
+            {
+                length = ( length << 8 ) | mHeader[ 2 + i ];
+            }
+            pos = 10;
+        }
+
+        memcpy( mKey, mHeader + pos, sizeof( mKey ) );
+        mPhase = 0;
+
+        if( mOpcode & 0x8 )
+        {
+            if( !fin || length > WebSocketFrame::MaxControlPayload ||
+                    ( mOpcode != WebSocketFrame::Close && mOpcode != WebSocketFrame::Ping &&
+                      mOpcode != WebSocketFrame::Pong ) )
+            {
+                fail( ProtocolError );
+                return false;
+            }
+
+            mControl.resize( int( length ) );
+            mTarget = &mControl;
+            mTargetOffset = 0;
+            mRemaining = qint64( length );
+            return true;
+        }
+
+        if( mOpcode == WebSocketFrame::Continuation )
+        {
+            if( mMessageOpcode == WebSocketFrame::Continuation )
+            {
+                fail( ProtocolError );
+                return false;
+            }
+        }
+        else if( mOpcode == WebSocketFrame::Text || mOpcode == WebSocketFrame::Binary )
+        {
+            if( mMessageOpcode != WebSocketFrame::Continuation )
+            {
+                fail( ProtocolError );
+                return false;
+            }
+            mMessageOpcode = mOpcode;
+        }
+        else
+        {
+            fail( ProtocolError );
+            return false;
+        }
+
+        if( mMessage.size() > mMaxMessageSize ||
+                length > quint64( mMaxMessageSize - mMessage.size() ) )
+        {
+            fail( MessageTooBig );
+            return false;
+        }
+
+        mMessageFin = fin;
+        mTarget = &mMessage;
+        mTargetOffset = mMessage.size();
+        mMessage.resize( mTargetOffset + int( length ) );
+        mRemaining = qint64( length );
+        return true;
+    }
+
+    /*
+     * Returns false if the socket was closed meanwhile; nothing must be read after that.
+     */
+    bool WebSocket::Data::endFrame()
+    {
+        switch( mOpcode )
+        {
+        case WebSocketFrame::Ping:
+            send( WebSocketFrame::Pong, mControl );
+            break;
+
+        case WebSocketFrame::Pong:
+            emit mSocket->pongReceived( mControl );
+            break;
+
+        case WebSocketFrame::Close:
+            return receivedClose();
+
+        default:
+            if( mMessageFin )
+            {
+                return deliverMessage();
+            }
+            break;
+        }
+
+        return mState != Closed;
+    }
+
+    bool WebSocket::Data::deliverMessage()
+    {
+        QByteArray message = mMessage;
+        int opcode = mMessageOpcode;
+
+        // The message now belongs to the receiver; the next one gets a buffer of its own
+        mMessage = QByteArray();
+        mMessageOpcode = WebSocketFrame::Continuation;
+
+        if( opcode == WebSocketFrame::Text )
+        {
+            if( !WebSocketFrame::isValidUtf8( message.constData(), message.size() ) )
+            {
+                fail( InvalidPayload );
+                return false;
+            }
+
+            emit mSocket->textReceived( QString::fromUtf8( message.constData(), message.size() ) );
+        }
+        else
+        {
+            emit mSocket->binaryReceived( message );
+        }
+
+        return mState != Closed;
+    }
+
+    bool WebSocket::Data::receivedClose()
+    {
+        int code = NoStatusReceived;
+        QString reason;
+
+        if( mControl.size() == 1 )
+        {
+            fail( ProtocolError );
+            return false;
+        }
+
+        if( mControl.size() >= 2 )
+        {
+            code = ( uchar( mControl[ 0 ] ) << 8 ) | uchar( mControl[ 1 ] );
+            if( !WebSocketFrame::isValidCloseCode( quint16( code ) ) )
+            {
+                fail( ProtocolError );
+                return false;
+            }
+
+            if( !WebSocketFrame::isValidUtf8( mControl.constData() + 2, mControl.size() - 2 ) )
+            {
+                fail( InvalidPayload );
+                return false;
+            }
+
+            reason = QString::fromUtf8( mControl.constData() + 2, mControl.size() - 2 );
+        }
+
+        // The client started closing; we answer with its code and are done
+        if( mState == Open )
+        {
+            sendClose( code == NoStatusReceived ? 0 : code, QByteArray() );
+        }
+
+        finish( code, reason );
+        return false;
+    }
+
+    /*
+     * Frames we send are never fragmented. Small payloads are copied behind the header, larger
+     * ones are queued as they are (QByteArray shares them).
+     */
+    bool WebSocket::Data::send( WebSocketFrame::Opcode opcode, const QByteArray& payload )
+    {
+        if( !mConnection || mState != Open )
+        {
+            return false;
+        }
+
+        QByteArray header = WebSocketFrame::header( opcode, payload.size() );
+
+        if( payload.size() < sCopyThreshold )
+        {
+            header.append( payload );
+            mConnection->write( header );
+        }
+        else
+        {
+            mConnection->write( header );
+            mConnection->write( payload );
+        }
+
+        return true;
+    }
+
+    void WebSocket::Data::sendClose( int code, const QByteArray& reason )
+    {
+        QByteArray payload;
+
+        if( code )
+        {
+            payload.append( char( code >> 8 ) );
+            payload.append( char( code ) );
+            payload.append( reason );
+        }
+
+        send( WebSocketFrame::Close, payload );
+        mState = Closing;
+    }
+
+    /*
+     * The client broke the protocol: tell it why and close.
+     */
+    void WebSocket::Data::fail( int code )
+    {
+        if( mState == Closed )
+        {
+            return;
+        }
+
+        if( mState == Open )
+        {
+            sendClose( code, QByteArray() );
+        }
+
+        finish( code, QString() );
+    }
+
+    void WebSocket::Data::finish( int code, const QString& reason )
+    {
+        mState = Closed;
+
+        if( mConnection )
+        {
+            mConnection->closeWhenDone();
+        }
+
+        emit mSocket->closed( code, reason );
+    }
+
+    void WebSocket::Data::connectionLost()
+    {
+        mConnection = NULL;
+
+        if( mState != Closed )
+        {
+            mState = Closed;
+            emit mSocket->closed( AbnormalClosure, QString() );
+        }
+    }
+
+    WebSocket::WebSocket( Connection* connection, Data* data )
+        : QObject( connection )
+        , d( data )
+    {
+        d->mSocket = this;
+        connect( connection, SIGNAL(writable()), this, SIGNAL(writable()) );
+    }
+
+    WebSocket::~WebSocket()
+    {
+        delete d;
+    }
+
+    QByteArray WebSocket::urlText() const
+    {
+        return d->mUrl;
+    }
+
+    HeaderValue WebSocket::header( const HeaderName& header ) const
+    {
+        return d->mHeaders.value( header );
+    }
+
+    QByteArray WebSocket::protocol() const
+    {
+        return d->mProtocol;
+    }
+
+    QHostAddress WebSocket::remoteAddr() const
+    {
+        return d->mRemoteAddr;
+    }
+
+    quint16 WebSocket::remotePort() const
+    {
+        return d->mRemotePort;
+    }
+
+    bool WebSocket::isOpen() const
+    {
+        return d->mState == Data::Open;
+    }
+
+    bool WebSocket::isWritable() const
+    {
+        return d->mConnection && d->mConnection->isWritable();
+    }
+
+    void WebSocket::setMaxMessageSize( int bytes )
+    {
+        d->mMaxMessageSize = bytes;
+    }
+
+    int WebSocket::maxMessageSize() const
+    {
+        return d->mMaxMessageSize;
+    }
+
+    void WebSocket::sendText( const QString& text )
+    {
+        d->send( WebSocketFrame::Text, text.toUtf8() );
+    }
+
+    void WebSocket::sendTextUtf8( const QByteArray& text )
+    {
+        d->send( WebSocketFrame::Text, text );
+    }
+
+    void WebSocket::sendBinary( const QByteArray& data )
+    {
+        d->send( WebSocketFrame::Binary, data );
+    }
+
+    void WebSocket::ping( const QByteArray& payload )
+    {
+        d->send( WebSocketFrame::Ping, payload.left( WebSocketFrame::MaxControlPayload ) );
+    }
+
+    /*
+     * Starts the closing handshake. The client gets a few seconds to answer before the
+     * connection is dropped.
+     */
+    void WebSocket::close( int code, const QString& reason )
+    {
+        if( d->mState != Data::Open )
+        {
+            return;
+        }
+
+        // The reason must fit into a control frame; cut it at a character boundary
+        QByteArray utf8 = reason.toUtf8();
+        int maxLength = WebSocketFrame::MaxControlPayload - 2;
+        if( utf8.size() > maxLength )
+        {
+            while( maxLength > 0 && ( uchar( utf8[ maxLength ] ) & 0xc0 ) == 0x80 )
+            {
+                maxLength--;
+            }
+            utf8.truncate( maxLength );
+        }
+
+        d->sendClose( code, utf8 );
+        QTimer::singleShot( Data::sCloseTimeout, this, SLOT(closeTimedOut()) );
+    }
+
+    void WebSocket::closeTimedOut()
+    {
+        if( d->mState == Data::Closing && d->mConnection )
+        {
+            d->mConnection->abort();
+            d->connectionLost();
+        }
+    }
+
+}
@@ -0,0 +1,124 @@
+/*
+ * Modern CI
+ * Copyright (C) 2012-2013 Sascha Cunz <sascha@babbelbox.org>
+ *
+ * This program is free software; you can redistribute it and/or modify it under the terms of the
+ * GNU General Public License (Version 2) as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without
+ * even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this program; if
+ * not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef HTTP_WEBSOCKET_HPP
+#define HTTP_WEBSOCKET_HPP
+
+#include <QObject>
+#include <QHostAddress>
+
+#include "libHttpServer/Http.hpp"
+
+namespace HTTP
+{
+
+    class Connection;
+    class RequestView;
+
+    /*
+     * One WebSocket (RFC 6455) on one of the server's connections. It is created by the server
+     * once the handshake succeeded and lives in the connection's worker thread; from other
+     * threads, use queued connections or QMetaObject::invokeMethod().
+     *
+     * Messages are delivered whole, after all their fragments arrived. Pings are answered by the
+     * server. After closed() was emitted, nothing can be sent anymore and the socket is deleted
+     * along with its connection, so keep it in a QPointer.
+     *
+     * No extensions (e.g. permessage-deflate) are negotiated.
+     */
+    class HTTP_SERVER_API WebSocket : public QObject
+    {
+        Q_OBJECT
+    public:
+        enum CloseCode
+        {
+            NormalClosure       = 1000,
+            GoingAway           = 1001,
+            ProtocolError       = 1002,
+            UnsupportedData     = 1003,
+            NoStatusReceived    = 1005,     // Reported only, never sent
+            AbnormalClosure     = 1006,     // Reported only: the connection was lost
+            InvalidPayload      = 1007,
+            PolicyViolation     = 1008,
+            MessageTooBig       = 1009,
+            InternalError       = 1011
+        };
+
+    public:
+        ~WebSocket();
+
+    public:
+        QByteArray urlText() const;
+        HeaderValue header( const HeaderName& header ) const;
+        QByteArray protocol() const;
+        QHostAddress remoteAddr() const;
+        quint16 remotePort() const;
+
+        bool isOpen() const;
+
+        // False while the connection's output is above its high water mark; see writable()
+        bool isWritable() const;
+
+        // Larger messages close the socket with MessageTooBig; default is 16 MiB
+        void setMaxMessageSize( int bytes );
+        int maxMessageSize() const;
+
+    public slots:
+        void sendText( const QString& text );
+        void sendTextUtf8( const QByteArray& text );
+        void sendBinary( const QByteArray& data );
+        void ping( const QByteArray& payload = QByteArray() );
+        void close( int code = NormalClosure, const QString& reason = QString() );
+
+    signals:
+        void textReceived( const QString& text );
+        void binaryReceived( const QByteArray& data );
+        void pongReceived( const QByteArray& payload );
+        void closed( int code, const QString& reason );
+        void writable();
+
+    private slots:
+        void closeTimedOut();
+
+    private:
+        friend class Connection;
+        friend class MicroBenchmarkAccess;
+        class Data;
+        WebSocket( Connection* connection, Data* data );
+        Data* d;
+    };
+
+    /*
+     * Accepts WebSockets on the paths it is registered for with Server::addWebSocketHandler().
+     * Both methods are called on the connection's worker thread, so with several worker threads
+     * they must be thread safe.
+     */
+    class IWebSocketHandler
+    {
+    public:
+        /*
+         * Called with the handshake request; refusing answers it with "403 Forbidden". A handler
+         * that speaks one of the subprotocols the client offered in Sec-WebSocket-Protocol puts
+         * it into `protocol`.
+         */
+        virtual bool accept( const RequestView& request, QByteArray& protocol ) = 0;
+
+        virtual void newSocket( WebSocket* socket ) = 0;
+    };
+
+}
+
+#endif